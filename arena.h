@@ -0,0 +1,126 @@
+/*
+ * Slab arena for tree nodes.
+ *
+ * Memory is mapped from the system in slabs of ARENA_SLAB_SIZE bytes and
+ * handed out with a bump pointer, so nodes carry no allocator header and
+ * consecutive allocations are adjacent. Sizes are rounded up to 16-byte size
+ * classes and each class keeps its own free list, so memory freed by a delete
+ * goes back to the next allocation of the same size. Freeing the whole
+ * tree is arena_destroy(): one munmap per slab, without visiting any nodes.
+ *
+ * With ARENA_HUGEPAGES, slabs are mapped from huge pages when the system has
+ * them reserved, and are otherwise advised for transparent huge pages.
+ *
+ * An arena is not thread-safe; it belongs to a single tree.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef ARENA_SLAB_SIZE
+#define ARENA_SLAB_SIZE ((size_t) 2 << 20)
+#endif
+
+#define ARENA_ALIGN 16
+#define ARENA_CLASSES 64 /* largest object is ARENA_CLASSES * ARENA_ALIGN bytes */
+
+#define ARENA_HUGEPAGES 1
+
+struct arena_slab {
+    struct arena_slab *next;
+};
+
+struct arena {
+    char *cursor; /* bump region in the newest slab */
+    char *limit;
+    void *free_lists[ARENA_CLASSES];
+    struct arena_slab *slabs;
+    size_t slab_count;
+    size_t bytes_used; /* handed out by the bump pointer, including freed objects */
+    unsigned flags;
+};
+
+static inline void arena_init(struct arena *a, unsigned flags) {
+    *a = (struct arena){.flags = flags};
+}
+
+static inline size_t arena_class(size_t size) {
+    assert(size > 0 && size <= ARENA_CLASSES * ARENA_ALIGN);
+    return (size - 1) / ARENA_ALIGN;
+}
+
+static void arena_grow(struct arena *a) {
+    void *p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (a->flags & ARENA_HUGEPAGES)
+        p = mmap(NULL, ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            abort();
+#ifdef MADV_HUGEPAGE
+        if (a->flags & ARENA_HUGEPAGES)
+            madvise(p, ARENA_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+    }
+
+    struct arena_slab *slab = p;
+    slab->next = a->slabs;
+    a->slabs = slab;
+    a->slab_count++;
+    a->cursor = (char *) p + ARENA_ALIGN;
+    a->limit = (char *) p + ARENA_SLAB_SIZE;
+}
+
+static inline void *arena_alloc(struct arena *a, size_t size) {
+    size_t class = arena_class(size);
+    void *p = a->free_lists[class];
+
+    if (p) {
+        a->free_lists[class] = *(void **) p;
+        return p;
+    }
+
+    size = (class + 1) * ARENA_ALIGN;
+    if ((size_t) (a->limit - a->cursor) < size)
+        arena_grow(a);
+    p = a->cursor;
+    a->cursor += size;
+    a->bytes_used += size;
+    return p;
+}
+
+static inline void *arena_calloc(struct arena *a, size_t size) {
+    return memset(arena_alloc(a, size), 0, size);
+}
+
+/* size must be what the object was allocated with */
+static inline void arena_free(struct arena *a, void *p, size_t size) {
+    size_t class = arena_class(size);
+    *(void **) p = a->free_lists[class];
+    a->free_lists[class] = p;
+}
+
+/* Release every object at once; the arena is empty and reusable afterwards */
+static inline void arena_destroy(struct arena *a) {
+    struct arena_slab *slab = a->slabs;
+
+    while (slab) {
+        struct arena_slab *next = slab->next;
+        munmap(slab, ARENA_SLAB_SIZE);
+        slab = next;
+    }
+    arena_init(a, a->flags);
+}
+
+#endif
@@ -1,110 +1,233 @@
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "arena.h"
+
+/*
+ * The balance factor, height(left) - height(right), is one of -1, 0 or +1.
+ * It is kept as balance + 1 in the two low bits of the parent pointer, which
+ * are always zero because nodes are at least 4-byte aligned.
+ */
 struct avl_tree_node {
     int data;
-    int height;
     struct avl_tree_node *left;
     struct avl_tree_node *right;
-    struct avl_tree_node *parent;
+    uintptr_t parent_balance;
 };
 
+_Static_assert(_Alignof(struct avl_tree_node) >= 4, "avl_tree_node alignment must leave two low bits free");
+
 struct avl_tree {
     struct avl_tree_node *root;
+    struct arena *arena; /* node storage, or NULL to use malloc */
 };
 
-static inline int height(struct avl_tree_node *node) {
-    return node ? node->height : 0;
+static inline struct avl_tree_node *avl_parent(const struct avl_tree_node *node) {
+    return (struct avl_tree_node *) (node->parent_balance & ~(uintptr_t) 3);
 }
 
-static inline int balance_factor(struct avl_tree_node *node) {
-    return node ? height(node->left) - height(node->right) : 0;
+static inline int avl_balance(const struct avl_tree_node *node) {
+    return (int) (node->parent_balance & 3) - 1;
 }
 
-static void update_height(struct avl_tree_node *node) {
-    if (node)
-        node->height =
-            1 + (height(node->left) > height(node->right) ? height(node->left)
-                                                          : height(node->right));
+static inline void avl_set_parent(struct avl_tree_node *node, struct avl_tree_node *parent) {
+    node->parent_balance = (uintptr_t) parent | (node->parent_balance & 3);
+}
+
+static inline void avl_set_balance(struct avl_tree_node *node, int balance) {
+    node->parent_balance = (node->parent_balance & ~(uintptr_t) 3) | (uintptr_t) (balance + 1);
+}
+
+static inline void change_child(struct avl_tree *tree, struct avl_tree_node *parent,
+                                struct avl_tree_node *old, struct avl_tree_node *new) {
+    if (!parent)
+        tree->root = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
 }
 
-void left_rotate(struct avl_tree *tree, struct avl_tree_node *x) {
+/* Pure link surgery: callers fix up the balance factors themselves */
+void avl_left_rotate(struct avl_tree *tree, struct avl_tree_node *x) {
     struct avl_tree_node *y = x->right;
+    struct avl_tree_node *parent = avl_parent(x);
+
     x->right = y->left;
     if (y->left)
-        y->left->parent = x;
+        avl_set_parent(y->left, x);
 
-    y->parent = x->parent;
-    if (!x->parent)
-        tree->root = y;
-    else if (x == x->parent->left)
-        x->parent->left = y;
-    else
-        x->parent->right = y;
+    avl_set_parent(y, parent);
+    change_child(tree, parent, x, y);
 
     y->left = x;
-    x->parent = y;
-
-    update_height(x);
-    update_height(y);
+    avl_set_parent(x, y);
 }
 
-void right_rotate(struct avl_tree *tree, struct avl_tree_node *y) {
+void avl_right_rotate(struct avl_tree *tree, struct avl_tree_node *y) {
     struct avl_tree_node *x = y->left;
+    struct avl_tree_node *parent = avl_parent(y);
+
     y->left = x->right;
     if (x->right)
-        x->right->parent = y;
+        avl_set_parent(x->right, y);
 
-    x->parent = y->parent;
-    if (!y->parent)
-        tree->root = x;
-    else if (y == y->parent->left)
-        y->parent->left = x;
-    else
-        y->parent->right = x;
+    avl_set_parent(x, parent);
+    change_child(tree, parent, y, x);
 
     x->right = y;
-    y->parent = x;
+    avl_set_parent(y, x);
+}
 
-    update_height(y);
-    update_height(x);
+/*
+ * x is two levels taller on the left. Rotate it back into balance, set the
+ * balance factors that changed and return the new root of the subtree. The
+ * subtree comes out one level shorter than it was at +2, except when the
+ * left child was itself balanced, which only happens on removal.
+ */
+static struct avl_tree_node *fix_left_heavy(struct avl_tree *tree, struct avl_tree_node *x) {
+    struct avl_tree_node *z = x->left;
+    int bz = avl_balance(z);
+
+    if (bz >= 0) {
+        avl_right_rotate(tree, x);
+        avl_set_balance(x, bz == 0 ? 1 : 0);
+        avl_set_balance(z, bz == 0 ? -1 : 0);
+        return z;
+    }
+
+    struct avl_tree_node *y = z->right;
+    int by = avl_balance(y);
+    avl_left_rotate(tree, z);
+    avl_right_rotate(tree, x);
+    avl_set_balance(z, by == -1 ? 1 : 0);
+    avl_set_balance(x, by == 1 ? -1 : 0);
+    avl_set_balance(y, 0);
+    return y;
 }
 
-void rebalance(struct avl_tree *tree, struct avl_tree_node *node) {
-    while (node) {
-        update_height(node);
-        int bf = balance_factor(node);
-
-        if (bf > 1) {
-            if (balance_factor(node->left) < 0)
-                left_rotate(tree, node->left);
-            right_rotate(tree, node);
-        } else if (bf < -1) {
-            if (balance_factor(node->right) > 0)
-                right_rotate(tree, node->right);
-            left_rotate(tree, node);
+static struct avl_tree_node *fix_right_heavy(struct avl_tree *tree, struct avl_tree_node *x) {
+    struct avl_tree_node *z = x->right;
+    int bz = avl_balance(z);
+
+    if (bz <= 0) {
+        avl_left_rotate(tree, x);
+        avl_set_balance(x, bz == 0 ? -1 : 0);
+        avl_set_balance(z, bz == 0 ? 1 : 0);
+        return z;
+    }
+
+    struct avl_tree_node *y = z->left;
+    int by = avl_balance(y);
+    avl_right_rotate(tree, z);
+    avl_left_rotate(tree, x);
+    avl_set_balance(z, by == 1 ? -1 : 0);
+    avl_set_balance(x, by == -1 ? 1 : 0);
+    avl_set_balance(y, 0);
+    return y;
+}
+
+/*
+ * node's subtree just grew by one level. Walk up only while that growth
+ * keeps propagating: it stops at the first ancestor that was leaning the
+ * other way, or after a single (double) rotation, which always restores the
+ * height the subtree had before the insert.
+ */
+static void retrace_insert(struct avl_tree *tree, struct avl_tree_node *node) {
+    struct avl_tree_node *parent;
+
+    for (; (parent = avl_parent(node)); node = parent) {
+        int balance = avl_balance(parent);
+
+        if (node == parent->left) {
+            if (balance == 1) {
+                fix_left_heavy(tree, parent);
+                return;
+            }
+            avl_set_balance(parent, balance + 1);
+        } else {
+            if (balance == -1) {
+                fix_right_heavy(tree, parent);
+                return;
+            }
+            avl_set_balance(parent, balance - 1);
         }
 
-        node = node->parent;
+        if (balance != 0)
+            return;
     }
 }
 
-void avl_tree_insert(struct avl_tree *tree, int data) {
-    struct avl_tree_node *new_node = malloc(sizeof(struct avl_tree_node));
+/*
+ * One side of parent just lost a level. Walk up while subtrees keep getting
+ * shorter; stop as soon as an ancestor absorbs the change, either by going
+ * from balanced to leaning or through a rotation that keeps the height.
+ */
+static void retrace_remove(struct avl_tree *tree, struct avl_tree_node *parent, int left_shrunk) {
+    while (parent) {
+        struct avl_tree_node *subtree = parent;
+        int balance = avl_balance(parent);
+
+        if (left_shrunk) {
+            if (balance == -1) {
+                int sibling_balance = avl_balance(parent->right);
+                subtree = fix_right_heavy(tree, parent);
+                if (sibling_balance == 0)
+                    return;
+            } else {
+                avl_set_balance(parent, balance - 1);
+                if (balance == 0)
+                    return;
+            }
+        } else {
+            if (balance == 1) {
+                int sibling_balance = avl_balance(parent->left);
+                subtree = fix_left_heavy(tree, parent);
+                if (sibling_balance == 0)
+                    return;
+            } else {
+                avl_set_balance(parent, balance + 1);
+                if (balance == 0)
+                    return;
+            }
+        }
+
+        parent = avl_parent(subtree);
+        if (parent)
+            left_shrunk = parent->left == subtree;
+    }
+}
+
+/* Start an empty tree whose nodes come from a private arena; see arena.h for the flags */
+void avl_tree_init_arena(struct avl_tree *tree, unsigned arena_flags) {
+    tree->root = NULL;
+    tree->arena = malloc(sizeof(struct arena));
+    arena_init(tree->arena, arena_flags);
+}
+
+/* Insert below start, which must be an ancestor of the key's leaf position */
+static struct avl_tree_node *insert_below(struct avl_tree *tree, struct avl_tree_node *start, int data) {
+    struct avl_tree_node *new_node = tree->arena ? arena_alloc(tree->arena, sizeof(struct avl_tree_node))
+                                                 : malloc(sizeof(struct avl_tree_node));
     new_node->data = data;
     new_node->left = new_node->right = NULL;
-    new_node->height = 1;
 
-    if (!tree->root) {
-        new_node->parent = NULL;
+    if (!start) {
+        new_node->parent_balance = 0;
+        avl_set_balance(new_node, 0);
         tree->root = new_node;
-        return;
+        return new_node;
     }
 
-    struct avl_tree_node *current = tree->root;
+    struct avl_tree_node *current = start;
     struct avl_tree_node *parent = NULL;
     while (current) {
         parent = current;
@@ -114,13 +237,19 @@ void avl_tree_insert(struct avl_tree *tree, int data) {
             current = current->right;
     }
 
-    new_node->parent = parent;
+    new_node->parent_balance = (uintptr_t) parent;
+    avl_set_balance(new_node, 0);
     if (data < parent->data)
         parent->left = new_node;
     else
         parent->right = new_node;
 
-    rebalance(tree, parent);
+    retrace_insert(tree, new_node);
+    return new_node;
+}
+
+void avl_tree_insert(struct avl_tree *tree, int data) {
+    insert_below(tree, tree->root, data);
 }
 
 static struct avl_tree_node *
@@ -134,55 +263,209 @@ static void
 transplant(struct avl_tree *tree,
            struct avl_tree_node *u,
            struct avl_tree_node *v) {
-    if (!u->parent)
-        tree->root = v;
-    else if (u == u->parent->left)
-        u->parent->left = v;
-    else
-        u->parent->right = v;
+    struct avl_tree_node *parent = avl_parent(u);
+    change_child(tree, parent, u, v);
     if (v)
-        v->parent = u->parent;
+        avl_set_parent(v, parent);
 }
 
-void avl_tree_remove(struct avl_tree *tree, int data) {
+struct avl_tree_node *avl_tree_search(struct avl_tree *tree, int data) {
     struct avl_tree_node *node = tree->root;
     while (node && node->data != data)
         node = (data < node->data) ? node->left : node->right;
-    if (!node)
-        return;
+    return node;
+}
+
+#ifndef SEARCH_BATCH_LANES
+#define SEARCH_BATCH_LANES 16
+#endif
+
+/*
+ * Look up n keys at once, storing each match (or NULL) in results. Up to
+ * SEARCH_BATCH_LANES descents advance in lockstep, each prefetching the node
+ * it will visit on the next pass, so their cache misses overlap. Finished
+ * lanes are refilled with the next key straight away.
+ */
+void avl_tree_search_batch(struct avl_tree *tree, const int *keys, size_t n,
+                           struct avl_tree_node **results) {
+    struct {
+        struct avl_tree_node *node;
+        size_t idx;
+    } lanes[SEARCH_BATCH_LANES];
+    size_t next = 0;
+    int active = 0;
+
+    while (active < SEARCH_BATCH_LANES && next < n) {
+        lanes[active].node = tree->root;
+        lanes[active++].idx = next++;
+    }
+
+    while (active) {
+        for (int j = 0; j < active;) {
+            struct avl_tree_node *node = lanes[j].node;
+            int data = keys[lanes[j].idx];
 
-    struct avl_tree_node *rebalance_start = node->parent;
+            if (!node || node->data == data) {
+                results[lanes[j].idx] = node;
+                if (next < n) {
+                    lanes[j].node = tree->root;
+                    lanes[j++].idx = next++;
+                } else {
+                    lanes[j] = lanes[--active];
+                }
+                continue;
+            }
+
+            node = data < node->data ? node->left : node->right;
+            __builtin_prefetch(node);
+            lanes[j++].node = node;
+        }
+    }
+}
+
+static void remove_node(struct avl_tree *tree, struct avl_tree_node *node) {
+    struct avl_tree_node *parent;
+    int left_shrunk;
 
-    if (!node->left) {
-        transplant(tree, node, node->right);
-    } else if (!node->right) {
-        transplant(tree, node, node->left);
+    if (!node->left || !node->right) {
+        parent = avl_parent(node);
+        left_shrunk = parent && parent->left == node;
+        transplant(tree, node, node->left ? node->left : node->right);
     } else {
         struct avl_tree_node *succ = min_node(node->right);
-        struct avl_tree_node *rebalance_from = succ->parent;
 
-        if (succ->parent != node) {
+        if (avl_parent(succ) != node) {
+            /* succ leaves the left spine of node's right subtree */
+            parent = avl_parent(succ);
+            left_shrunk = 1;
             transplant(tree, succ, succ->right);
             succ->right = node->right;
-            if (succ->right)
-                succ->right->parent = succ;
+            avl_set_parent(succ->right, succ);
         } else {
-            rebalance_from = succ;
+            /* succ keeps its right subtree, which is one level short now */
+            parent = succ;
+            left_shrunk = 0;
         }
 
         transplant(tree, node, succ);
         succ->left = node->left;
-        if (succ->left)
-            succ->left->parent = succ;
+        avl_set_parent(succ->left, succ);
+        avl_set_balance(succ, avl_balance(node));
+    }
 
-        update_height(succ);
+    if (tree->arena)
+        arena_free(tree->arena, node, sizeof(struct avl_tree_node));
+    else
+        free(node);
+    retrace_remove(tree, parent, left_shrunk);
+}
 
-        rebalance_start = rebalance_from;
+/* Node with the smallest data >= data, or NULL */
+struct avl_tree_node *avl_tree_lower_bound(struct avl_tree *tree, int data) {
+    struct avl_tree_node *node = tree->root, *bound = NULL;
+    while (node) {
+        if (node->data < data) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
     }
+    return bound;
+}
+
+void avl_tree_remove(struct avl_tree *tree, int data) {
+    struct avl_tree_node *node = avl_tree_search(tree, data);
+    if (node)
+        remove_node(tree, node);
+}
+
+static struct avl_tree_node *max_node(struct avl_tree_node *node) {
+    while (node && node->right)
+        node = node->right;
+    return node;
+}
+
+struct avl_tree_node *avl_tree_next(struct avl_tree_node *node) {
+    if (node->right)
+        return min_node(node->right);
+
+    struct avl_tree_node *parent;
+    while ((parent = avl_parent(node)) && node == parent->right)
+        node = parent;
+    return parent;
+}
+
+struct avl_tree_node *avl_tree_prev(struct avl_tree_node *node) {
+    if (node->left)
+        return max_node(node->left);
+
+    struct avl_tree_node *parent;
+    while ((parent = avl_parent(node)) && node == parent->left)
+        node = parent;
+    return parent;
+}
+
+/*
+ * Find the lowest node at or above finger whose subtree spans data, which
+ * is where a descent for data can start. Going right, ancestors reached
+ * through right links say nothing new about the upper bound, so the climb
+ * skips over a whole run of them and only compares data against the parent
+ * that ends the run; going left is the mirror image.
+ *
+ * Without level links this is not an O(log d) finger search: two adjacent
+ * keys can meet only at the root, so the climb costs O(log n) parent hops
+ * and the descent from there O(log n) comparisons, the same bound as a root
+ * search. It pays off when successive keys usually share a low ancestor, as
+ * in sequential streams; on shuffled clusters it does not beat the root.
+ */
+static struct avl_tree_node *finger_start(struct avl_tree *tree, struct avl_tree_node *finger, int data) {
+    struct avl_tree_node *start = finger;
+
+    if (!start)
+        return tree->root;
+
+    while (data != start->data) {
+        int go_left = data < start->data;
+        struct avl_tree_node *x = start, *parent;
+
+        while ((parent = avl_parent(x)) && (go_left ? parent->left : parent->right) == x)
+            x = parent;
+
+        if (!parent || (go_left ? data > parent->data : data < parent->data))
+            break;
+        start = parent;
+    }
+    return start;
+}
+
+struct avl_tree_node *avl_tree_search_finger(struct avl_tree *tree, struct avl_tree_node *finger, int data) {
+    struct avl_tree_node *node = finger_start(tree, finger, data);
+    while (node && node->data != data)
+        node = (data < node->data) ? node->left : node->right;
+    return node;
+}
 
-    free(node);
-    if (rebalance_start)
-        rebalance(tree, rebalance_start);
+/* Returns the new node, which makes a good finger for the next nearby key */
+struct avl_tree_node *avl_tree_insert_finger(struct avl_tree *tree, struct avl_tree_node *finger, int data) {
+    return insert_below(tree, finger_start(tree, finger, data), data);
+}
+
+/*
+ * Remove data, searching from finger, and return a neighbour of the removed
+ * node to use as the next finger (NULL once the tree is empty). Returns
+ * finger unchanged when data is absent.
+ */
+struct avl_tree_node *avl_tree_remove_finger(struct avl_tree *tree, struct avl_tree_node *finger, int data) {
+    struct avl_tree_node *node = avl_tree_search_finger(tree, finger, data);
+    if (!node)
+        return finger;
+
+    struct avl_tree_node *neighbour = avl_tree_next(node);
+    if (!neighbour)
+        neighbour = avl_tree_prev(node);
+    remove_node(tree, node);
+    return neighbour;
 }
 
 int validate_avltree(struct avl_tree_node *node, int *height_out) {
@@ -203,18 +486,345 @@ int validate_avltree(struct avl_tree_node *node, int *height_out) {
         return 0;
     }
 
+    if (bf != avl_balance(node)) {
+        fprintf(stderr, "AVL stored balance mismatch at %d (stored %d, actual %d)\n",
+                node->data, avl_balance(node), bf);
+        return 0;
+    }
+
+    if ((node->left && avl_parent(node->left) != node) ||
+        (node->right && avl_parent(node->right) != node)) {
+        fprintf(stderr, "AVL parent link violation below %d\n", node->data);
+        return 0;
+    }
+
     *height_out = 1 + (lh > rh ? lh : rh);
     return 1;
 }
 
+/*
+ * Teardown without recursion: rotate left children up until the current node
+ * has none, then free it and continue with its right child. One linear pass
+ * in constant space, whatever the shape.
+ */
 void avl_tree_free(struct avl_tree_node *root) {
-    if (root == NULL)
-        return;
+    while (root) {
+        struct avl_tree_node *left = root->left;
 
-    avl_tree_free(root->left);
-    avl_tree_free(root->right);
-    root->left = root->right = NULL;
-    free(root);
+        if (left) {
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        } else {
+            struct avl_tree_node *right = root->right;
+            free(root);
+            root = right;
+        }
+    }
+}
+
+/* Free every node, all at once for an arena tree, and leave the tree empty */
+void avl_tree_clear(struct avl_tree *tree) {
+    if (tree->arena) {
+        arena_destroy(tree->arena);
+        free(tree->arena);
+        tree->arena = NULL;
+    } else {
+        avl_tree_free(tree->root);
+    }
+    tree->root = NULL;
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/* Height of the tree build_range() makes from n keys: the left half is never smaller */
+static inline int build_height(size_t n) {
+    return n ? 64 - __builtin_clzll(n) : 0;
+}
+
+static struct avl_tree_node *make_build_node(const int *keys, size_t n,
+                                             struct avl_tree_node *parent) {
+    size_t mid = n / 2;
+    struct avl_tree_node *node = malloc(sizeof(struct avl_tree_node));
+    node->data = keys[mid];
+    node->left = node->right = NULL;
+    node->parent_balance = (uintptr_t) parent;
+    avl_set_balance(node, build_height(mid) - build_height(n - mid - 1));
+    return node;
+}
+
+static struct avl_tree_node *build_range(const int *keys, size_t n, struct avl_tree_node *parent) {
+    if (!n)
+        return NULL;
+
+    struct avl_tree_node *node = make_build_node(keys, n, parent);
+    size_t mid = n / 2;
+    node->left = build_range(keys, mid, node);
+    node->right = build_range(keys + mid + 1, n - mid - 1, node);
+    return node;
+}
+
+#ifndef BUILD_CUTOFF
+#define BUILD_CUTOFF 4096
+#endif
+
+/* A deque never holds two tasks from the same level, so 64 slots always suffice */
+#define BUILD_DEQUE_SLOTS 64
+
+struct build_task {
+    const int *keys;
+    size_t n;
+    struct avl_tree_node *parent;
+    struct avl_tree_node **slot;
+};
+
+struct build_worker {
+    pthread_mutex_t lock;
+    struct build_task tasks[BUILD_DEQUE_SLOTS];
+    unsigned head, count; /* thieves take from head, the owner works at head + count */
+    struct build_pool *pool;
+    int id;
+    pthread_t thread;
+};
+
+struct build_pool {
+    struct build_worker *workers;
+    int nworkers;
+    atomic_size_t remaining; /* nodes not created yet */
+};
+
+static void build_push(struct build_worker *w, struct build_task task) {
+    pthread_mutex_lock(&w->lock);
+    assert(w->count < BUILD_DEQUE_SLOTS);
+    w->tasks[(w->head + w->count++) % BUILD_DEQUE_SLOTS] = task;
+    pthread_mutex_unlock(&w->lock);
+}
+
+static int build_pop(struct build_worker *w, struct build_task *task) {
+    int ok = 0;
+    pthread_mutex_lock(&w->lock);
+    if (w->count) {
+        *task = w->tasks[(w->head + --w->count) % BUILD_DEQUE_SLOTS];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+/* Steal the oldest, and so largest, task of some other worker */
+static int build_steal(struct build_worker *self, struct build_task *task) {
+    struct build_pool *pool = self->pool;
+
+    for (int i = 1; i < pool->nworkers; i++) {
+        struct build_worker *victim = &pool->workers[(self->id + i) % pool->nworkers];
+        int ok = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count) {
+            *task = victim->tasks[victim->head];
+            victim->head = (victim->head + 1) % BUILD_DEQUE_SLOTS;
+            victim->count--;
+            ok = 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (ok)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Create the root of the task's range and hand its right half to the deque,
+ * carrying on with the left half, until the range is small enough to finish
+ * sequentially. Children link themselves in through task.slot, so no task
+ * ever waits for another.
+ */
+static void build_run(struct build_worker *w, struct build_task task) {
+    while (task.n > BUILD_CUTOFF) {
+        size_t mid = task.n / 2;
+        struct avl_tree_node *node = make_build_node(task.keys, task.n, task.parent);
+        *task.slot = node;
+
+        build_push(w, (struct build_task) {task.keys + mid + 1, task.n - mid - 1, node, &node->right});
+        atomic_fetch_sub(&w->pool->remaining, 1);
+        task = (struct build_task) {task.keys, mid, node, &node->left};
+    }
+
+    *task.slot = build_range(task.keys, task.n, task.parent);
+    atomic_fetch_sub(&w->pool->remaining, task.n);
+}
+
+static void *build_worker_loop(void *arg) {
+    struct build_worker *w = arg;
+    struct build_task task;
+
+    while (atomic_load(&w->pool->remaining)) {
+        if (build_pop(w, &task) || build_steal(w, &task))
+            build_run(w, task);
+        else
+            sched_yield();
+    }
+    return NULL;
+}
+
+/* One slice of the parallel sort and dedup; which fields matter depends on the phase */
+struct sort_job {
+    int *src, *dst;
+    size_t lo, mid, hi;
+    size_t unique;
+    size_t out;
+};
+
+static void *sort_chunk(void *arg) {
+    struct sort_job *job = arg;
+    qsort(job->src + job->lo, job->hi - job->lo, sizeof(int), compare_int);
+    return NULL;
+}
+
+/* Merge sorted runs src[lo, mid) and src[mid, hi) into dst[lo, hi) */
+static void *merge_runs(void *arg) {
+    struct sort_job *job = arg;
+    size_t i = job->lo, j = job->mid, k = job->lo;
+
+    while (i < job->mid && j < job->hi)
+        job->dst[k++] = job->src[j] < job->src[i] ? job->src[j++] : job->src[i++];
+    while (i < job->mid)
+        job->dst[k++] = job->src[i++];
+    while (j < job->hi)
+        job->dst[k++] = job->src[j++];
+    return NULL;
+}
+
+/* An element survives dedup when it differs from the one before it */
+static void *count_unique(void *arg) {
+    struct sort_job *job = arg;
+    job->unique = 0;
+    for (size_t i = job->lo; i < job->hi; i++)
+        job->unique += i == 0 || job->src[i] != job->src[i - 1];
+    return NULL;
+}
+
+static void *write_unique(void *arg) {
+    struct sort_job *job = arg;
+    size_t k = job->out;
+    for (size_t i = job->lo; i < job->hi; i++)
+        if (i == 0 || job->src[i] != job->src[i - 1])
+            job->dst[k++] = job->src[i];
+    return NULL;
+}
+
+/* Run fn on every job, the first on the calling thread */
+static void run_jobs(void *(*fn)(void *), struct sort_job *jobs, int njobs) {
+    pthread_t *threads = malloc(njobs * sizeof(pthread_t));
+    for (int i = 1; i < njobs; i++)
+        pthread_create(&threads[i], NULL, fn, &jobs[i]);
+    fn(&jobs[0]);
+    for (int i = 1; i < njobs; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+/*
+ * Sort keys into a fresh array and drop duplicates, using up to `threads`
+ * threads: chunks are sorted independently, merged pairwise in log(threads)
+ * rounds, then compacted after a prefix sum of per-chunk unique counts.
+ */
+static int *sort_unique(const int *keys, size_t n, int threads, size_t *unique_out) {
+    int *a = malloc(n * sizeof(int));
+    int *b = malloc(n * sizeof(int));
+    struct sort_job *jobs = calloc(threads, sizeof(struct sort_job));
+    size_t *bounds = malloc((threads + 1) * sizeof(size_t));
+
+    memcpy(a, keys, n * sizeof(int));
+    for (int i = 0; i <= threads; i++)
+        bounds[i] = n * i / threads;
+
+    for (int i = 0; i < threads; i++)
+        jobs[i] = (struct sort_job) {.src = a, .lo = bounds[i], .hi = bounds[i + 1]};
+    run_jobs(sort_chunk, jobs, threads);
+
+    for (int width = 1; width < threads; width *= 2) {
+        int njobs = 0;
+        for (int i = 0; i < threads; i += 2 * width) {
+            size_t mid = bounds[i + width < threads ? i + width : threads];
+            size_t hi = bounds[i + 2 * width < threads ? i + 2 * width : threads];
+            jobs[njobs++] = (struct sort_job) {.src = a, .dst = b, .lo = bounds[i], .mid = mid, .hi = hi};
+        }
+        run_jobs(merge_runs, jobs, njobs);
+
+        int *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    for (int i = 0; i < threads; i++)
+        jobs[i] = (struct sort_job) {.src = a, .dst = b, .lo = bounds[i], .hi = bounds[i + 1]};
+    run_jobs(count_unique, jobs, threads);
+
+    size_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        jobs[i].out = total;
+        total += jobs[i].unique;
+    }
+    run_jobs(write_unique, jobs, threads);
+
+    free(bounds);
+    free(jobs);
+    free(a);
+    *unique_out = total;
+    return b;
+}
+
+/*
+ * Build a balanced AVL tree from n unsorted keys, duplicates dropped, using
+ * `threads` threads (all online CPUs if threads < 1). Nodes are ordinary
+ * malloc'd nodes with parent links and balance factors set, so the tree can
+ * go straight into avl_tree_insert/avl_tree_remove. Subtrees larger than
+ * BUILD_CUTOFF keys are spread over a work-stealing pool.
+ */
+struct avl_tree *avl_tree_build(const int *keys, size_t n, int threads) {
+    struct avl_tree *tree = malloc(sizeof(struct avl_tree));
+    tree->root = NULL;
+    tree->arena = NULL;
+    if (!n)
+        return tree;
+
+    if (threads < 1)
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    if ((size_t) threads > n)
+        threads = (int) n;
+
+    size_t unique;
+    int *sorted = sort_unique(keys, n, threads, &unique);
+
+    struct build_pool pool = {.nworkers = threads};
+    pool.workers = calloc(threads, sizeof(struct build_worker));
+    atomic_init(&pool.remaining, unique);
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool.workers[i].lock, NULL);
+        pool.workers[i].pool = &pool;
+        pool.workers[i].id = i;
+    }
+
+    build_push(&pool.workers[0], (struct build_task) {sorted, unique, NULL, &tree->root});
+    for (int i = 1; i < threads; i++)
+        pthread_create(&pool.workers[i].thread, NULL, build_worker_loop, &pool.workers[i]);
+    build_worker_loop(&pool.workers[0]);
+    for (int i = 1; i < threads; i++)
+        pthread_join(pool.workers[i].thread, NULL);
+
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_destroy(&pool.workers[i].lock);
+    free(pool.workers);
+    free(sorted);
+    return tree;
 }
 
 #define ANSI_RED "\033[31m"
@@ -224,18 +834,23 @@ void avl_tree_free(struct avl_tree_node *root) {
 #define RBT_RED ANSI_RED "R" ANSI_RESET
 #define RBT_BLACK ANSI_BOLD "B" ANSI_RESET
 
-void print_inorder(struct avl_tree_node *node) {
-    if (node == NULL)
-        return;
-    print_inorder(node->left);
-    printf("(%d) ", node->data);
-    print_inorder(node->right);
+/* avl_tree_next confined to the subtree at root */
+static struct avl_tree_node *avl_subtree_next(struct avl_tree_node *root, struct avl_tree_node *node) {
+    if (node->right)
+        return min_node(node->right);
+    while (node != root && node == avl_parent(node)->right)
+        node = avl_parent(node);
+    return node == root ? NULL : avl_parent(node);
 }
 
-void export_dot(FILE *fp, struct avl_tree_node *node) {
-    if (!node)
+void avl_print_inorder(struct avl_tree_node *node) {
+    if (node == NULL)
         return;
+    for (struct avl_tree_node *n = min_node(node); n; n = avl_subtree_next(node, n))
+        printf("(%d) ", n->data);
+}
 
+static void export_avl_dot_node(FILE *fp, struct avl_tree_node *node) {
     fprintf(fp,
             "    \"%d\" [label=\"%d\", color=\"gray\", fontcolor=\"white\", style=filled, "
             "fillcolor=\"#808080\"];\n",
@@ -243,7 +858,6 @@ void export_dot(FILE *fp, struct avl_tree_node *node) {
 
     if (node->left) {
         fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->left->data);
-        export_dot(fp, node->left);
     } else {
         fprintf(
             fp,
@@ -254,7 +868,6 @@ void export_dot(FILE *fp, struct avl_tree_node *node) {
 
     if (node->right) {
         fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->right->data);
-        export_dot(fp, node->right);
     } else {
         fprintf(
             fp,
@@ -264,7 +877,15 @@ void export_dot(FILE *fp, struct avl_tree_node *node) {
     }
 }
 
-void export_tree_to_dot(struct avl_tree *tree, const char *filename) {
+/* Emits the subtree in in-order by parent pointers, without recursion */
+void export_avl_dot(FILE *fp, struct avl_tree_node *node) {
+    if (!node)
+        return;
+    for (struct avl_tree_node *n = min_node(node); n; n = avl_subtree_next(node, n))
+        export_avl_dot_node(fp, n);
+}
+
+void export_avl_tree_to_dot(struct avl_tree *tree, const char *filename) {
     FILE *fp = fopen(filename, "w");
     if (!fp) {
         fprintf(stderr, "Error opening file for writing: %s\n", filename);
@@ -278,7 +899,7 @@ void export_tree_to_dot(struct avl_tree *tree, const char *filename) {
     fprintf(fp, "    edge [arrowsize=0.7];\n");
 
     if (tree->root)
-        export_dot(fp, tree->root);
+        export_avl_dot(fp, tree->root);
 
     fprintf(fp, "}\n");
     fclose(fp);
@@ -288,12 +909,146 @@ void export_tree_to_dot(struct avl_tree *tree, const char *filename) {
 #define NUM_INSERTS 100
 #endif
 
-#define NUM_REMOVES NUM_INSERTS / 2
+#define NUM_REMOVES (NUM_INSERTS / 2)
+
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef AVL_NO_MAIN
+#ifndef BENCH_BUILD_KEYS
+#define BENCH_BUILD_KEYS (1 << 18)
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#ifndef BENCH_FINGER_KEYS
+#define BENCH_FINGER_KEYS (1 << 18)
+#endif
+
+#define FINGER_CLUSTER 16
+
+/* Every key once: ascending, or clusters of FINGER_CLUSTER in random order */
+static void finger_stream(int *keys, int n, int clustered) {
+    for (int i = 0; i < n; i++)
+        keys[i] = i;
+    if (!clustered)
+        return;
+
+    int clusters = n / FINGER_CLUSTER;
+    int *order = malloc(clusters * sizeof(int));
+    for (int c = 0; c < clusters; c++)
+        order[c] = c;
+    for (int c = clusters - 1; c > 0; c--) {
+        int j = rand() % (c + 1);
+        int tmp = order[c];
+        order[c] = order[j];
+        order[j] = tmp;
+    }
+
+    for (int c = 0; c < clusters; c++) {
+        int *cluster = keys + c * FINGER_CLUSTER;
+        for (int j = 0; j < FINGER_CLUSTER; j++)
+            cluster[j] = order[c] * FINGER_CLUSTER + j;
+        for (int j = FINGER_CLUSTER - 1; j > 0; j--) {
+            int k = rand() % (j + 1);
+            int tmp = cluster[j];
+            cluster[j] = cluster[k];
+            cluster[k] = tmp;
+        }
+    }
+    free(order);
+}
+
+/* Insert, search and remove every key, with or without fingers; ns per op in out */
+static void run_finger_stream(const int *keys, int n, int use_finger, double out[3]) {
+    struct avl_tree tree = {NULL};
+    struct avl_tree_node *finger = NULL;
+
+    double start = now_ns();
+    for (int i = 0; i < n; i++) {
+        if (use_finger)
+            finger = avl_tree_insert_finger(&tree, finger, keys[i]);
+        else
+            avl_tree_insert(&tree, keys[i]);
+    }
+    out[0] = (now_ns() - start) / n;
+
+    start = now_ns();
+    for (int i = 0; i < n; i++) {
+        struct avl_tree_node *node = use_finger ? avl_tree_search_finger(&tree, finger, keys[i])
+                                                : avl_tree_search(&tree, keys[i]);
+        assert(node);
+        finger = node;
+    }
+    out[1] = (now_ns() - start) / n;
+
+    start = now_ns();
+    for (int i = 0; i < n; i++) {
+        if (use_finger)
+            finger = avl_tree_remove_finger(&tree, finger, keys[i]);
+        else
+            avl_tree_remove(&tree, keys[i]);
+    }
+    out[2] = (now_ns() - start) / n;
+    assert(!tree.root);
+}
+
+static void benchmark_finger(const char *name, int clustered) {
+    int n = BENCH_FINGER_KEYS / FINGER_CLUSTER * FINGER_CLUSTER;
+    int *keys = malloc(n * sizeof(int));
+    double plain[3], fingered[3];
+
+    finger_stream(keys, n, clustered);
+
+    /* The first pass only faults in the heap both timed passes reuse */
+    run_finger_stream(keys, n, 0, plain);
+    run_finger_stream(keys, n, 0, plain);
+    run_finger_stream(keys, n, 1, fingered);
+
+    printf("    %-10s insert %.1f/%.1f ns, search %.1f/%.1f ns, remove %.1f/%.1f ns (root/finger)\n",
+           name, plain[0], fingered[0], plain[1], fingered[1], plain[2], fingered[2]);
+    free(keys);
+}
+
+static void benchmark_build(void) {
+    int *keys = malloc(BENCH_BUILD_KEYS * sizeof(int));
+    for (int i = 0; i < BENCH_BUILD_KEYS; i++)
+        keys[i] = rand();
+
+    double start = now_ns();
+    struct avl_tree tree = {NULL};
+    for (int i = 0; i < BENCH_BUILD_KEYS; i++)
+        avl_tree_insert(&tree, keys[i]);
+    double insert_ms = (now_ns() - start) / 1e6;
+    avl_tree_free(tree.root);
+
+    start = now_ns();
+    struct avl_tree *serial = avl_tree_build(keys, BENCH_BUILD_KEYS, 1);
+    double serial_ms = (now_ns() - start) / 1e6;
+
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    start = now_ns();
+    struct avl_tree *parallel = avl_tree_build(keys, BENCH_BUILD_KEYS, threads);
+    double parallel_ms = (now_ns() - start) / 1e6;
+
+    printf("    %d keys: insert loop %.1f ms, build 1 thread %.1f ms, build %d threads %.1f ms\n",
+           BENCH_BUILD_KEYS, insert_ms, serial_ms, threads, parallel_ms);
+
+    avl_tree_free(serial->root);
+    avl_tree_free(parallel->root);
+    free(serial);
+    free(parallel);
+    free(keys);
+}
 
 int main() {
     printf("AVL tree... ");
     fflush(stdout);
     struct avl_tree *tree = malloc(sizeof(struct avl_tree));
+    tree->root = NULL;
+    tree->arena = NULL;
     int *values = malloc(NUM_INSERTS * sizeof(int));
 
     srand((unsigned) time(NULL));
@@ -313,6 +1068,8 @@ int main() {
 
         values[i++] = value;
         avl_tree_insert(tree, value);
+        int h;
+        assert(validate_avltree(tree->root, &h));
     }
 
     for (int i = NUM_INSERTS - 1; i > 0; i--) {
@@ -328,12 +1085,94 @@ int main() {
         assert(validate_avltree(tree->root, &h));
     }
 
-    export_tree_to_dot(tree, "avltree.dot");
+    struct avl_tree_node **found = malloc(NUM_INSERTS * sizeof(struct avl_tree_node *));
+    avl_tree_search_batch(tree, values, NUM_INSERTS, found);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        assert(found[i] == avl_tree_search(tree, values[i]));
+    free(found);
+
+    /* Finger operations must agree with plain ones from any starting node */
+    struct avl_tree_node *finger = NULL;
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        struct avl_tree_node *node = avl_tree_search_finger(tree, finger, values[i]);
+        assert(node == avl_tree_search(tree, values[i]));
+        if (node)
+            finger = node;
+    }
+
+    struct avl_tree near = {NULL};
+    int *stream = malloc(NUM_INSERTS / FINGER_CLUSTER * FINGER_CLUSTER * sizeof(int));
+    int stream_len = NUM_INSERTS / FINGER_CLUSTER * FINGER_CLUSTER;
+    finger_stream(stream, stream_len, 1);
+    finger = NULL;
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        finger = avl_tree_insert_finger(&near, finger, i < stream_len ? stream[i] : i);
+        int h;
+        assert(validate_avltree(near.root, &h));
+    }
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        int key = i < stream_len ? stream[i] : i;
+        assert(avl_tree_search_finger(&near, finger, key));
+        finger = avl_tree_remove_finger(&near, finger, key);
+        int h;
+        assert(validate_avltree(near.root, &h) && !avl_tree_search(&near, key));
+    }
+    assert(!near.root && !finger);
+    free(stream);
+
+    /* Bulk build from keys with duplicates, then keep updating the result */
+    int *bulk = malloc(2 * NUM_INSERTS * sizeof(int));
+    for (int i = 0; i < 2 * NUM_INSERTS; i++)
+        bulk[i] = rand() % NUM_INSERTS;
+
+    struct avl_tree *built = avl_tree_build(bulk, 2 * NUM_INSERTS, 4);
+    int h;
+    assert(validate_avltree(built->root, &h));
+    for (int i = 0; i < 2 * NUM_INSERTS; i++)
+        assert(avl_tree_search(built, bulk[i]));
+    for (struct avl_tree_node *node = min_node(built->root); node;) {
+        struct avl_tree_node *next = node->right ? min_node(node->right) : NULL;
+        for (struct avl_tree_node *child = node; !next && avl_parent(child); child = avl_parent(child))
+            if (avl_parent(child)->left == child)
+                next = avl_parent(child);
+        assert(!next || node->data < next->data);
+        node = next;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        avl_tree_remove(built, bulk[i]);
+        avl_tree_insert(built, NUM_INSERTS + i);
+        assert(validate_avltree(built->root, &h));
+    }
+    avl_tree_free(built->root);
+    free(built);
+    free(bulk);
+
+    /* Arena-backed nodes; a remove followed by an insert reuses the slot */
+    struct avl_tree pooled;
+    avl_tree_init_arena(&pooled, 0);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        avl_tree_insert(&pooled, values[i]);
+    size_t carved = pooled.arena->bytes_used;
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        avl_tree_remove(&pooled, values[i]);
+        avl_tree_insert(&pooled, NUM_INSERTS + i);
+        assert(validate_avltree(pooled.root, &h));
+    }
+    assert(pooled.arena->bytes_used == carved);
+    avl_tree_clear(&pooled);
+
+    export_avl_tree_to_dot(tree, "avltree.dot");
     printf("complete\n");
 
+    benchmark_build();
+    benchmark_finger("sequential", 0);
+    benchmark_finger("clustered", 1);
+
     avl_tree_free(tree->root);
     free(tree);
     free(values);
 
     return 0;
 }
+#endif
@@ -0,0 +1,701 @@
+/*
+ * Compact AVL tree: nodes live in one growable array and link to each other
+ * with 32-bit indices instead of pointers.
+ *
+ * A node is 16 bytes: the key, two child indices and the parent index with
+ * the balance factor packed into its two low bits, exactly like the parent
+ * pointer in avl.c. Index 0 is reserved as the null link, so a zeroed node is
+ * a detached leaf. Because links are relative to the array, the whole tree
+ * can be cloned or written out with a single memcpy/fwrite and is still
+ * valid wherever it lands.
+ *
+ * The pointer-based tree from avl.c is pulled in for the comparison at the
+ * end of main().
+ */
+
+#define AVL_NO_MAIN
+#include "avl.c"
+
+#include <string.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define AVL_NIL 0
+#define AVL_COMPACT_MAX_NODES (UINT32_MAX >> 2)
+
+struct avl_compact_node {
+    int data;
+    uint32_t left;
+    uint32_t right;
+    uint32_t parent_balance; /* parent index << 2 | (balance + 1) */
+};
+
+struct avl_compact_tree {
+    struct avl_compact_node *nodes; /* nodes[AVL_NIL] is never handed out */
+    uint32_t capacity;
+    uint32_t used;      /* slots handed out so far, including AVL_NIL */
+    uint32_t free_list; /* removed slots, chained through left */
+    uint32_t root;
+    uint32_t size;
+};
+
+_Static_assert(sizeof(struct avl_compact_node) == 16, "avl_compact_node must stay 16 bytes");
+
+struct avl_compact_tree *avl_compact_create(uint32_t capacity) {
+    struct avl_compact_tree *tree = calloc(1, sizeof(*tree));
+    if (capacity < 16)
+        capacity = 16;
+    tree->nodes = calloc(capacity, sizeof(struct avl_compact_node));
+    tree->capacity = capacity;
+    tree->used = 1;
+    return tree;
+}
+
+void avl_compact_destroy(struct avl_compact_tree *tree) {
+    free(tree->nodes);
+    free(tree);
+}
+
+static inline struct avl_compact_node *N(struct avl_compact_tree *tree, uint32_t idx) {
+    return &tree->nodes[idx];
+}
+
+static inline uint32_t cparent(struct avl_compact_tree *tree, uint32_t idx) {
+    return tree->nodes[idx].parent_balance >> 2;
+}
+
+static inline int cbalance(struct avl_compact_tree *tree, uint32_t idx) {
+    return (int) (tree->nodes[idx].parent_balance & 3) - 1;
+}
+
+static inline void cset_parent(struct avl_compact_tree *tree, uint32_t idx, uint32_t parent) {
+    struct avl_compact_node *node = N(tree, idx);
+    node->parent_balance = parent << 2 | (node->parent_balance & 3);
+}
+
+static inline void cset_balance(struct avl_compact_tree *tree, uint32_t idx, int balance) {
+    struct avl_compact_node *node = N(tree, idx);
+    node->parent_balance = (node->parent_balance & ~3u) | (uint32_t) (balance + 1);
+}
+
+/* May move the array, so callers must not hold node pointers across it */
+static uint32_t avl_compact_alloc(struct avl_compact_tree *tree) {
+    if (tree->free_list != AVL_NIL) {
+        uint32_t idx = tree->free_list;
+        tree->free_list = N(tree, idx)->left;
+        return idx;
+    }
+
+    if (tree->used == tree->capacity) {
+        if (tree->capacity >= AVL_COMPACT_MAX_NODES)
+            return AVL_NIL;
+        uint64_t grown = (uint64_t) tree->capacity * 2;
+        if (grown > AVL_COMPACT_MAX_NODES)
+            grown = AVL_COMPACT_MAX_NODES;
+        tree->nodes = realloc(tree->nodes, grown * sizeof(struct avl_compact_node));
+        tree->capacity = (uint32_t) grown;
+    }
+
+    return tree->used++;
+}
+
+static void avl_compact_release(struct avl_compact_tree *tree, uint32_t idx) {
+    N(tree, idx)->left = tree->free_list;
+    tree->free_list = idx;
+}
+
+static inline void cchange_child(struct avl_compact_tree *tree, uint32_t parent,
+                                 uint32_t old, uint32_t new) {
+    if (parent == AVL_NIL)
+        tree->root = new;
+    else if (N(tree, parent)->left == old)
+        N(tree, parent)->left = new;
+    else
+        N(tree, parent)->right = new;
+}
+
+static void compact_left_rotate(struct avl_compact_tree *tree, uint32_t x) {
+    uint32_t y = N(tree, x)->right;
+    uint32_t parent = cparent(tree, x);
+
+    N(tree, x)->right = N(tree, y)->left;
+    if (N(tree, y)->left != AVL_NIL)
+        cset_parent(tree, N(tree, y)->left, x);
+
+    cset_parent(tree, y, parent);
+    cchange_child(tree, parent, x, y);
+
+    N(tree, y)->left = x;
+    cset_parent(tree, x, y);
+}
+
+static void compact_right_rotate(struct avl_compact_tree *tree, uint32_t y) {
+    uint32_t x = N(tree, y)->left;
+    uint32_t parent = cparent(tree, y);
+
+    N(tree, y)->left = N(tree, x)->right;
+    if (N(tree, x)->right != AVL_NIL)
+        cset_parent(tree, N(tree, x)->right, y);
+
+    cset_parent(tree, x, parent);
+    cchange_child(tree, parent, y, x);
+
+    N(tree, x)->right = y;
+    cset_parent(tree, y, x);
+}
+
+/* Same case analysis as fix_left_heavy/fix_right_heavy in avl.c */
+static uint32_t compact_fix_left_heavy(struct avl_compact_tree *tree, uint32_t x) {
+    uint32_t z = N(tree, x)->left;
+    int bz = cbalance(tree, z);
+
+    if (bz >= 0) {
+        compact_right_rotate(tree, x);
+        cset_balance(tree, x, bz == 0 ? 1 : 0);
+        cset_balance(tree, z, bz == 0 ? -1 : 0);
+        return z;
+    }
+
+    uint32_t y = N(tree, z)->right;
+    int by = cbalance(tree, y);
+    compact_left_rotate(tree, z);
+    compact_right_rotate(tree, x);
+    cset_balance(tree, z, by == -1 ? 1 : 0);
+    cset_balance(tree, x, by == 1 ? -1 : 0);
+    cset_balance(tree, y, 0);
+    return y;
+}
+
+static uint32_t compact_fix_right_heavy(struct avl_compact_tree *tree, uint32_t x) {
+    uint32_t z = N(tree, x)->right;
+    int bz = cbalance(tree, z);
+
+    if (bz <= 0) {
+        compact_left_rotate(tree, x);
+        cset_balance(tree, x, bz == 0 ? -1 : 0);
+        cset_balance(tree, z, bz == 0 ? 1 : 0);
+        return z;
+    }
+
+    uint32_t y = N(tree, z)->left;
+    int by = cbalance(tree, y);
+    compact_right_rotate(tree, z);
+    compact_left_rotate(tree, x);
+    cset_balance(tree, z, by == 1 ? -1 : 0);
+    cset_balance(tree, x, by == -1 ? 1 : 0);
+    cset_balance(tree, y, 0);
+    return y;
+}
+
+static void compact_retrace_insert(struct avl_compact_tree *tree, uint32_t node) {
+    uint32_t parent;
+
+    for (; (parent = cparent(tree, node)) != AVL_NIL; node = parent) {
+        int balance = cbalance(tree, parent);
+
+        if (node == N(tree, parent)->left) {
+            if (balance == 1) {
+                compact_fix_left_heavy(tree, parent);
+                return;
+            }
+            cset_balance(tree, parent, balance + 1);
+        } else {
+            if (balance == -1) {
+                compact_fix_right_heavy(tree, parent);
+                return;
+            }
+            cset_balance(tree, parent, balance - 1);
+        }
+
+        if (balance != 0)
+            return;
+    }
+}
+
+static void compact_retrace_remove(struct avl_compact_tree *tree, uint32_t parent, int left_shrunk) {
+    while (parent != AVL_NIL) {
+        uint32_t subtree = parent;
+        int balance = cbalance(tree, parent);
+
+        if (left_shrunk) {
+            if (balance == -1) {
+                int sibling_balance = cbalance(tree, N(tree, parent)->right);
+                subtree = compact_fix_right_heavy(tree, parent);
+                if (sibling_balance == 0)
+                    return;
+            } else {
+                cset_balance(tree, parent, balance - 1);
+                if (balance == 0)
+                    return;
+            }
+        } else {
+            if (balance == 1) {
+                int sibling_balance = cbalance(tree, N(tree, parent)->left);
+                subtree = compact_fix_left_heavy(tree, parent);
+                if (sibling_balance == 0)
+                    return;
+            } else {
+                cset_balance(tree, parent, balance + 1);
+                if (balance == 0)
+                    return;
+            }
+        }
+
+        parent = cparent(tree, subtree);
+        if (parent != AVL_NIL)
+            left_shrunk = N(tree, parent)->left == subtree;
+    }
+}
+
+/* Returns the new node's index, or AVL_NIL once 2^30 - 1 handles are in use */
+uint32_t avl_compact_insert(struct avl_compact_tree *tree, int data) {
+    uint32_t idx = avl_compact_alloc(tree);
+    if (idx == AVL_NIL)
+        return AVL_NIL;
+
+    struct avl_compact_node *new_node = N(tree, idx);
+    new_node->data = data;
+    new_node->left = new_node->right = AVL_NIL;
+    new_node->parent_balance = AVL_NIL << 2 | 1;
+    tree->size++;
+
+    if (tree->root == AVL_NIL) {
+        tree->root = idx;
+        return idx;
+    }
+
+    uint32_t current = tree->root;
+    uint32_t parent = AVL_NIL;
+    while (current != AVL_NIL) {
+        parent = current;
+        if (data < N(tree, current)->data)
+            current = N(tree, current)->left;
+        else
+            current = N(tree, current)->right;
+    }
+
+    cset_parent(tree, idx, parent);
+    if (data < N(tree, parent)->data)
+        N(tree, parent)->left = idx;
+    else
+        N(tree, parent)->right = idx;
+
+    compact_retrace_insert(tree, idx);
+    return idx;
+}
+
+uint32_t avl_compact_search(const struct avl_compact_tree *tree, int data) {
+    const struct avl_compact_node *nodes = tree->nodes;
+    uint32_t idx = tree->root;
+    while (idx != AVL_NIL && nodes[idx].data != data)
+        idx = data < nodes[idx].data ? nodes[idx].left : nodes[idx].right;
+    return idx;
+}
+
+static void compact_transplant(struct avl_compact_tree *tree, uint32_t u, uint32_t v) {
+    uint32_t parent = cparent(tree, u);
+    cchange_child(tree, parent, u, v);
+    if (v != AVL_NIL)
+        cset_parent(tree, v, parent);
+}
+
+void avl_compact_remove(struct avl_compact_tree *tree, int data) {
+    uint32_t node = avl_compact_search(tree, data);
+    if (node == AVL_NIL)
+        return;
+
+    uint32_t parent;
+    int left_shrunk;
+    uint32_t left = N(tree, node)->left;
+    uint32_t right = N(tree, node)->right;
+
+    if (left == AVL_NIL || right == AVL_NIL) {
+        parent = cparent(tree, node);
+        left_shrunk = parent != AVL_NIL && N(tree, parent)->left == node;
+        compact_transplant(tree, node, left != AVL_NIL ? left : right);
+    } else {
+        uint32_t succ = right;
+        while (N(tree, succ)->left != AVL_NIL)
+            succ = N(tree, succ)->left;
+
+        if (cparent(tree, succ) != node) {
+            parent = cparent(tree, succ);
+            left_shrunk = 1;
+            compact_transplant(tree, succ, N(tree, succ)->right);
+            N(tree, succ)->right = right;
+            cset_parent(tree, right, succ);
+        } else {
+            parent = succ;
+            left_shrunk = 0;
+        }
+
+        compact_transplant(tree, node, succ);
+        N(tree, succ)->left = left;
+        cset_parent(tree, left, succ);
+        cset_balance(tree, succ, cbalance(tree, node));
+    }
+
+    avl_compact_release(tree, node);
+    tree->size--;
+    compact_retrace_remove(tree, parent, left_shrunk);
+}
+
+/* A full copy is one memcpy of the node array: the links are indices */
+struct avl_compact_tree *avl_compact_clone(const struct avl_compact_tree *tree) {
+    struct avl_compact_tree *copy = malloc(sizeof(*copy));
+    *copy = *tree;
+    copy->nodes = malloc(tree->capacity * sizeof(struct avl_compact_node));
+    memcpy(copy->nodes, tree->nodes, tree->used * sizeof(struct avl_compact_node));
+    return copy;
+}
+
+/* Header followed by the used part of the node array, as-is */
+int avl_compact_save(const struct avl_compact_tree *tree, FILE *fp) {
+    if (fwrite(tree, sizeof(*tree), 1, fp) != 1)
+        return -1;
+    if (fwrite(tree->nodes, sizeof(struct avl_compact_node), tree->used, fp) != tree->used)
+        return -1;
+    return 0;
+}
+
+/*
+ * The links must form one tree of size nodes under root, each child pointing
+ * back at its parent, with every other slot on the free list. Slots are
+ * marked as they are reached, so a cycle or a slot that is both live and
+ * free is refused instead of followed.
+ */
+static int compact_check_links(struct avl_compact_tree *tree) {
+    uint8_t *seen = calloc(tree->used, 1);
+    if (!seen)
+        return 0;
+
+    int ok = tree->root == AVL_NIL || cparent(tree, tree->root) == AVL_NIL;
+    uint32_t live = 0, idx = tree->root, from = AVL_NIL;
+    while (ok && idx != AVL_NIL) {
+        struct avl_compact_node *node = N(tree, idx);
+        uint32_t up = cparent(tree, idx), next = up;
+        int down = 0;
+
+        if (from == up) {
+            if (seen[idx] || ++live > tree->size)
+                ok = 0;
+            seen[idx] = 1;
+            if (node->left != AVL_NIL)
+                next = node->left, down = 1;
+            else if (node->right != AVL_NIL)
+                next = node->right, down = 1;
+        } else if (from == node->left && node->right != AVL_NIL) {
+            next = node->right, down = 1;
+        }
+        if (down && cparent(tree, next) != idx)
+            ok = 0;
+        from = idx;
+        idx = next;
+    }
+
+    uint32_t free_slots = 0;
+    for (idx = tree->free_list; ok && idx != AVL_NIL; idx = N(tree, idx)->left) {
+        if (seen[idx])
+            ok = 0;
+        seen[idx] = 1;
+        free_slots++;
+    }
+
+    free(seen);
+    return ok && live == tree->size && live + free_slots == tree->used - 1;
+}
+
+/*
+ * Read a tree written by avl_compact_save. The header, every link and the
+ * shape of the tree and free list are checked before use, so a truncated or
+ * corrupt file gives NULL rather than out-of-bounds accesses or endless walks.
+ */
+struct avl_compact_tree *avl_compact_load(FILE *fp) {
+    struct avl_compact_tree *tree = malloc(sizeof(*tree));
+    if (!tree)
+        return NULL;
+    if (fread(tree, sizeof(*tree), 1, fp) != 1 || tree->capacity > AVL_COMPACT_MAX_NODES ||
+        tree->used < 1 || tree->used > tree->capacity || tree->root >= tree->used ||
+        tree->free_list >= tree->used || tree->size >= tree->used) {
+        free(tree);
+        return NULL;
+    }
+
+    tree->nodes = malloc((size_t) tree->capacity * sizeof(struct avl_compact_node));
+    if (!tree->nodes) {
+        free(tree);
+        return NULL;
+    }
+    if (fread(tree->nodes, sizeof(struct avl_compact_node), tree->used, fp) != tree->used) {
+        avl_compact_destroy(tree);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < tree->used; i++) {
+        struct avl_compact_node *node = N(tree, i);
+        if (node->left >= tree->used || node->right >= tree->used || cparent(tree, i) >= tree->used) {
+            avl_compact_destroy(tree);
+            return NULL;
+        }
+    }
+    if (!compact_check_links(tree)) {
+        avl_compact_destroy(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+int validate_avl_compact(struct avl_compact_tree *tree, uint32_t idx, int *height_out) {
+    if (idx == AVL_NIL) {
+        *height_out = 0;
+        return 1;
+    }
+
+    struct avl_compact_node *node = N(tree, idx);
+    int lh = 0, rh = 0;
+    if (!validate_avl_compact(tree, node->left, &lh))
+        return 0;
+    if (!validate_avl_compact(tree, node->right, &rh))
+        return 0;
+
+    int bf = lh - rh;
+    if (bf < -1 || bf > 1 || bf != cbalance(tree, idx)) {
+        fprintf(stderr, "AVL balance violation at %d (bf = %d, stored %d)\n",
+                node->data, bf, cbalance(tree, idx));
+        return 0;
+    }
+
+    if ((node->left != AVL_NIL && cparent(tree, node->left) != idx) ||
+        (node->right != AVL_NIL && cparent(tree, node->right) != idx)) {
+        fprintf(stderr, "AVL parent link violation below %d\n", node->data);
+        return 0;
+    }
+
+    *height_out = 1 + (lh > rh ? lh : rh);
+    return 1;
+}
+
+static void export_compact_dot(FILE *fp, struct avl_compact_tree *tree, uint32_t idx) {
+    struct avl_compact_node *node = N(tree, idx);
+
+    fprintf(fp,
+            "    \"%d\" [label=\"%d\\n#%u\", color=\"gray\", fontcolor=\"white\", style=filled, "
+            "fillcolor=\"#808080\"];\n",
+            node->data, node->data, idx);
+
+    if (node->left != AVL_NIL) {
+        fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, N(tree, node->left)->data);
+        export_compact_dot(fp, tree, node->left);
+    }
+
+    if (node->right != AVL_NIL) {
+        fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, N(tree, node->right)->data);
+        export_compact_dot(fp, tree, node->right);
+    }
+}
+
+void export_compact_tree_to_dot(struct avl_compact_tree *tree, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "digraph CompactAvlTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+
+    if (tree->root != AVL_NIL)
+        export_compact_dot(fp, tree, tree->root);
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 18)
+#endif
+
+#ifndef BENCH_LOOKUPS
+#define BENCH_LOOKUPS (1 << 20)
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Heap bytes really taken by the pointer tree, allocator overhead included */
+static size_t pointer_tree_bytes(struct avl_tree_node *node) {
+    if (!node)
+        return 0;
+#ifdef __GLIBC__
+    size_t bytes = malloc_usable_size(node) + sizeof(size_t);
+#else
+    size_t bytes = sizeof(*node);
+#endif
+    return bytes + pointer_tree_bytes(node->left) + pointer_tree_bytes(node->right);
+}
+
+static void benchmark(void) {
+    int *keys = malloc(BENCH_KEYS * sizeof(int));
+    int *probes = malloc(BENCH_LOOKUPS * sizeof(int));
+    uint64_t x = 88172645463325252ULL;
+
+    for (int i = 0; i < BENCH_KEYS; i++)
+        keys[i] = i * 2;
+    for (int i = BENCH_KEYS - 1; i > 0; i--) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        int j = x % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        probes[i] = x % (BENCH_KEYS * 2);
+    }
+
+    struct avl_tree pointer_tree = {NULL};
+    struct avl_compact_tree *compact = avl_compact_create(16);
+
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        avl_tree_insert(&pointer_tree, keys[i]);
+        avl_compact_insert(compact, keys[i]);
+    }
+
+    long hits_pointer = 0, hits_compact = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+        hits_pointer += avl_tree_search(&pointer_tree, probes[i]) != NULL;
+    double pointer_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+        hits_compact += avl_compact_search(compact, probes[i]) != AVL_NIL;
+    double compact_ns = now_ns() - start;
+
+    assert(hits_pointer == hits_compact);
+
+    printf("    %d keys: pointer %.1f bytes/key, %.1f ns/lookup; compact %.1f bytes/key, %.1f ns/lookup\n",
+           BENCH_KEYS,
+           (double) pointer_tree_bytes(pointer_tree.root) / BENCH_KEYS,
+           pointer_ns / BENCH_LOOKUPS,
+           (double) compact->capacity * sizeof(struct avl_compact_node) / BENCH_KEYS,
+           compact_ns / BENCH_LOOKUPS);
+
+    avl_tree_free(pointer_tree.root);
+    avl_compact_destroy(compact);
+    free(probes);
+    free(keys);
+}
+
+int main() {
+    printf("Compact AVL tree... ");
+    fflush(stdout);
+
+    /* Start tiny so the demo exercises growth */
+    struct avl_compact_tree *tree = avl_compact_create(1);
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    int h;
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+        if (avl_compact_search(tree, value) != AVL_NIL)
+            continue;
+
+        values[i++] = value;
+        avl_compact_insert(tree, value);
+        assert(validate_avl_compact(tree, tree->root, &h));
+    }
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        avl_compact_remove(tree, values[i]);
+        assert(validate_avl_compact(tree, tree->root, &h));
+        assert(avl_compact_search(tree, values[i]) == AVL_NIL);
+    }
+
+    /* Refill from the free list, then round-trip through a file */
+    for (int i = 0; i < NUM_REMOVES; i++)
+        avl_compact_insert(tree, values[i]);
+    assert(tree->size == NUM_INSERTS);
+    for (int i = 0; i < NUM_REMOVES; i++)
+        avl_compact_remove(tree, values[i]);
+
+    FILE *fp = tmpfile();
+    if (fp) {
+        assert(avl_compact_save(tree, fp) == 0);
+        rewind(fp);
+        struct avl_compact_tree *loaded = avl_compact_load(fp);
+        fclose(fp);
+        assert(loaded && validate_avl_compact(loaded, loaded->root, &h));
+        for (int i = NUM_REMOVES; i < NUM_INSERTS; i++)
+            assert(avl_compact_search(loaded, values[i]) != AVL_NIL);
+        avl_compact_destroy(loaded);
+    }
+
+    /* Out-of-range headers and links, and links that close a cycle, are refused */
+    uint32_t root = tree->root, child = N(tree, root)->left, freed = tree->free_list;
+    assert(child != AVL_NIL && freed != AVL_NIL);
+    for (int corrupt = 0; corrupt < 6; corrupt++) {
+        struct avl_compact_tree header = *tree;
+        struct avl_compact_node *nodes = malloc(tree->used * sizeof(struct avl_compact_node));
+        memcpy(nodes, tree->nodes, tree->used * sizeof(struct avl_compact_node));
+
+        if (corrupt == 0)
+            header.used = header.capacity + 1;
+        else if (corrupt == 1)
+            header.root = header.used;
+        else if (corrupt == 2)
+            nodes[tree->used - 1].left = tree->used;
+        else if (corrupt == 3)
+            nodes[root].left = root;
+        else if (corrupt == 4)
+            nodes[child].left = root;
+        else
+            nodes[freed].left = freed;
+
+        fp = tmpfile();
+        if (!fp) {
+            free(nodes);
+            break;
+        }
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(nodes, sizeof(struct avl_compact_node), tree->used, fp);
+        rewind(fp);
+        assert(!avl_compact_load(fp));
+        fclose(fp);
+        free(nodes);
+    }
+
+    struct avl_compact_tree *copy = avl_compact_clone(tree);
+    assert(validate_avl_compact(copy, copy->root, &h) && copy->size == tree->size);
+    avl_compact_destroy(copy);
+
+    export_compact_tree_to_dot(tree, "avltree_compact.dot");
+    printf("complete\n");
+
+    benchmark();
+
+    avl_compact_destroy(tree);
+    free(values);
+
+    return 0;
+}
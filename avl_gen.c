@@ -0,0 +1,176 @@
+/*
+ * Instantiations of the AVL tree generator in avl_gen.h: one for int keys,
+ * timed against the hand-written int tree in avl.c, and one for 128-bit
+ * identifiers.
+ */
+
+#define AVL_NO_MAIN
+#include "avl.c"
+
+#include "avl_gen.h"
+#include "id128.h"
+
+#define int_cmp(a, b) ((a) == (b) ? 0 : (a) < (b) ? -1 : 1)
+
+AVL_GENERATE(int_avl, int, int_cmp)
+AVL_GENERATE(id_avl, struct id128, id128_cmp)
+
+void export_int_avl_to_dot(struct int_avl *t, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+    fprintf(fp, "digraph GeneratedAVLTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+    for (struct int_avl_node *n = int_avl_min(t); n; n = int_avl_next(n)) {
+        fprintf(fp, "    \"%d\" [label=\"%d\\n%+d\"];\n", n->key, n->key, int_avl_balance(n));
+        if (n->left)
+            fprintf(fp, "    \"%d\" -> \"%d\";\n", n->key, n->left->key);
+        if (n->right)
+            fprintf(fp, "    \"%d\" -> \"%d\";\n", n->key, n->right->key);
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef BENCH_GEN_KEYS
+#define BENCH_GEN_KEYS (1 << 20)
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Insert, look up and delete the same shuffled keys in avl.c and in int_avl */
+static void benchmark_parity(void) {
+    int *keys = malloc(BENCH_GEN_KEYS * sizeof(int));
+    double t[3][3];
+    long found = 0;
+
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        keys[i] = i;
+    for (int i = BENCH_GEN_KEYS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    struct avl_tree hand = {NULL};
+    double start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        avl_tree_insert(&hand, keys[i]);
+    t[0][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found += avl_tree_search(&hand, keys[BENCH_GEN_KEYS - 1 - i]) != NULL;
+    t[0][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        avl_tree_remove(&hand, keys[i]);
+    t[0][2] = now_ns() - start;
+    assert(!hand.root);
+
+    struct int_avl gen;
+    int_avl_init(&gen);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        int_avl_insert(&gen, keys[i]);
+    t[1][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found -= int_avl_find(&gen, keys[BENCH_GEN_KEYS - 1 - i]) != NULL;
+    t[1][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        int_avl_delete(&gen, keys[i]);
+    t[1][2] = now_ns() - start;
+    assert(found == 0 && !gen.root);
+
+    struct id_avl ids;
+    id_avl_init(&ids);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_avl_insert(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++) {
+        int k = keys[BENCH_GEN_KEYS - 1 - i];
+        found += id_avl_find(&ids, (struct id128){k & 7, k}) != NULL;
+    }
+    t[2][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_avl_delete(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][2] = now_ns() - start;
+    assert(found == BENCH_GEN_KEYS && !ids.root);
+
+    const char *names[] = {"avl.c, int", "generated, int", "generated, 128-bit"};
+    printf("    %d keys, ns per insert / find / delete:\n", BENCH_GEN_KEYS);
+    for (int i = 0; i < 3; i++)
+        printf("    %-18s %6.1f %6.1f %6.1f\n", names[i], t[i][0] / BENCH_GEN_KEYS,
+               t[i][1] / BENCH_GEN_KEYS, t[i][2] / BENCH_GEN_KEYS);
+    free(keys);
+}
+
+int main() {
+    printf("Generated AVL trees... ");
+    fflush(stdout);
+
+    struct int_avl tree;
+    struct id_avl ids;
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    char *present = calloc(NUM_INSERTS * 4, 1);
+
+    srand((unsigned) time(NULL));
+    int_avl_init(&tree);
+    id_avl_init(&ids);
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+        if (present[value])
+            continue;
+
+        present[value] = 1;
+        values[i++] = value;
+        struct int_avl_node *n = int_avl_insert(&tree, value);
+        assert(n->key == value && int_avl_insert(&tree, value) == n);
+        assert(int_avl_validate(&tree) >= 0);
+
+        /* Same low word, so only the high word separates these */
+        id_avl_insert(&ids, (struct id128){value, 42});
+        id_avl_insert(&ids, (struct id128){value + 1ULL * NUM_INSERTS * 4, 42});
+        assert(id_avl_validate(&ids) >= 0);
+    }
+    assert(tree.size == NUM_INSERTS && ids.size == 2 * NUM_INSERTS);
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        assert(int_avl_delete(&tree, values[i]));
+        assert(!int_avl_delete(&tree, values[i]));
+        present[values[i]] = 0;
+        assert(int_avl_validate(&tree) >= 0);
+
+        assert(id_avl_delete(&ids, (struct id128){values[i], 42}));
+        assert(id_avl_validate(&ids) >= 0);
+    }
+
+    for (int k = 0; k < NUM_INSERTS * 4; k++) {
+        assert(!int_avl_find(&tree, k) == !present[k]);
+        assert(!id_avl_find(&ids, (struct id128){k, 42}) == !present[k]);
+    }
+
+    export_int_avl_to_dot(&tree, "avltree_gen.dot");
+    printf("complete\n");
+
+    int_avl_free(&tree);
+    id_avl_free(&ids);
+    free(present);
+    free(values);
+
+    benchmark_parity();
+    return 0;
+}
@@ -0,0 +1,339 @@
+/*
+ * AVL tree generator in the style of BSD <sys/tree.h>, the counterpart of
+ * rbt_gen.h for the tree in avl.c.
+ *
+ *     AVL_GENERATE(name, key_type, cmp)
+ *
+ * expands to struct name_node, struct name and a set of static functions
+ * prefixed with name_, all specialised for key_type. cmp is as in
+ * rbt_gen.h and is expanded at every comparison. Keys are unique. As in
+ * avl.c, the balance factor lives in the two low bits of the parent pointer.
+ *
+ *     name_init(t)            empty tree
+ *     name_insert(t, key)     node for key, added if absent
+ *     name_find(t, key)       node for key, or NULL
+ *     name_remove(t, node)    unlink and free node
+ *     name_delete(t, key)     remove key; 1 if it was present
+ *     name_min(t), name_next(node)
+ *     name_free(t)            free every node, in constant space
+ *     name_validate(t)        height, or -1 if a property is broken
+ */
+
+#ifndef AVL_GEN_H
+#define AVL_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define AVL_GENERATE(name, key_type, cmp)                                                  \
+    struct name##_node {                                                                   \
+        key_type key;                                                                      \
+        struct name##_node *left;                                                          \
+        struct name##_node *right;                                                         \
+        uintptr_t parent_balance; /* parent | (balance + 1) */                             \
+    };                                                                                     \
+                                                                                           \
+    struct name {                                                                          \
+        struct name##_node *root;                                                          \
+        size_t size;                                                                       \
+    };                                                                                     \
+                                                                                           \
+    static __attribute__((unused)) void name##_init(struct name *t) {                      \
+        t->root = NULL;                                                                    \
+        t->size = 0;                                                                       \
+    }                                                                                      \
+                                                                                           \
+    static inline struct name##_node *name##_parent(const struct name##_node *n) {         \
+        return (struct name##_node *) (n->parent_balance & ~(uintptr_t) 3);                \
+    }                                                                                      \
+                                                                                           \
+    static inline int name##_balance(const struct name##_node *n) {                        \
+        return (int) (n->parent_balance & 3) - 1;                                          \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_set_parent(struct name##_node *n, struct name##_node *parent) { \
+        n->parent_balance = (uintptr_t) parent | (n->parent_balance & 3);                  \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_set_balance(struct name##_node *n, int balance) {            \
+        n->parent_balance = (n->parent_balance & ~(uintptr_t) 3) | (uintptr_t) (balance + 1); \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_replace_child(struct name *t, struct name##_node *parent,    \
+                                            struct name##_node *old,                       \
+                                            struct name##_node *new_child) {               \
+        if (!parent)                                                                       \
+            t->root = new_child;                                                           \
+        else if (parent->left == old)                                                      \
+            parent->left = new_child;                                                      \
+        else                                                                               \
+            parent->right = new_child;                                                     \
+    }                                                                                      \
+                                                                                           \
+    static void name##_rotate_left(struct name *t, struct name##_node *x) {                \
+        struct name##_node *y = x->right;                                                  \
+        struct name##_node *parent = name##_parent(x);                                     \
+        x->right = y->left;                                                                \
+        if (y->left)                                                                       \
+            name##_set_parent(y->left, x);                                                 \
+        name##_set_parent(y, parent);                                                      \
+        name##_replace_child(t, parent, x, y);                                             \
+        y->left = x;                                                                       \
+        name##_set_parent(x, y);                                                           \
+    }                                                                                      \
+                                                                                           \
+    static void name##_rotate_right(struct name *t, struct name##_node *y) {               \
+        struct name##_node *x = y->left;                                                   \
+        struct name##_node *parent = name##_parent(y);                                     \
+        y->left = x->right;                                                                \
+        if (x->right)                                                                      \
+            name##_set_parent(x->right, y);                                                \
+        name##_set_parent(x, parent);                                                      \
+        name##_replace_child(t, parent, y, x);                                             \
+        x->right = y;                                                                      \
+        name##_set_parent(y, x);                                                           \
+    }                                                                                      \
+                                                                                           \
+    /* x is two levels taller on the left; returns the subtree's new root */               \
+    static struct name##_node *name##_fix_left_heavy(struct name *t, struct name##_node *x) { \
+        struct name##_node *z = x->left;                                                   \
+        int bz = name##_balance(z);                                                        \
+        if (bz >= 0) {                                                                     \
+            name##_rotate_right(t, x);                                                     \
+            name##_set_balance(x, bz == 0 ? 1 : 0);                                        \
+            name##_set_balance(z, bz == 0 ? -1 : 0);                                       \
+            return z;                                                                      \
+        }                                                                                  \
+        struct name##_node *y = z->right;                                                  \
+        int by = name##_balance(y);                                                        \
+        name##_rotate_left(t, z);                                                          \
+        name##_rotate_right(t, x);                                                         \
+        name##_set_balance(z, by == -1 ? 1 : 0);                                           \
+        name##_set_balance(x, by == 1 ? -1 : 0);                                           \
+        name##_set_balance(y, 0);                                                          \
+        return y;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static struct name##_node *name##_fix_right_heavy(struct name *t, struct name##_node *x) { \
+        struct name##_node *z = x->right;                                                  \
+        int bz = name##_balance(z);                                                        \
+        if (bz <= 0) {                                                                     \
+            name##_rotate_left(t, x);                                                      \
+            name##_set_balance(x, bz == 0 ? -1 : 0);                                       \
+            name##_set_balance(z, bz == 0 ? 1 : 0);                                        \
+            return z;                                                                      \
+        }                                                                                  \
+        struct name##_node *y = z->left;                                                   \
+        int by = name##_balance(y);                                                        \
+        name##_rotate_right(t, z);                                                         \
+        name##_rotate_left(t, x);                                                          \
+        name##_set_balance(z, by == 1 ? -1 : 0);                                           \
+        name##_set_balance(x, by == -1 ? 1 : 0);                                           \
+        name##_set_balance(y, 0);                                                          \
+        return y;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static void name##_retrace_insert(struct name *t, struct name##_node *n) {             \
+        struct name##_node *parent;                                                        \
+        for (; (parent = name##_parent(n)); n = parent) {                                  \
+            int balance = name##_balance(parent);                                          \
+            if (n == parent->left) {                                                       \
+                if (balance == 1) {                                                        \
+                    name##_fix_left_heavy(t, parent);                                      \
+                    return;                                                                \
+                }                                                                          \
+                name##_set_balance(parent, balance + 1);                                   \
+            } else {                                                                       \
+                if (balance == -1) {                                                       \
+                    name##_fix_right_heavy(t, parent);                                     \
+                    return;                                                                \
+                }                                                                          \
+                name##_set_balance(parent, balance - 1);                                   \
+            }                                                                              \
+            if (balance != 0)                                                              \
+                return;                                                                    \
+        }                                                                                  \
+    }                                                                                      \
+                                                                                           \
+    static void name##_retrace_remove(struct name *t, struct name##_node *parent,          \
+                                      int left_shrunk) {                                   \
+        while (parent) {                                                                   \
+            struct name##_node *subtree = parent;                                          \
+            int balance = name##_balance(parent);                                          \
+            if (left_shrunk) {                                                             \
+                if (balance == -1) {                                                       \
+                    int sibling_balance = name##_balance(parent->right);                   \
+                    subtree = name##_fix_right_heavy(t, parent);                           \
+                    if (sibling_balance == 0)                                              \
+                        return;                                                            \
+                } else {                                                                   \
+                    name##_set_balance(parent, balance - 1);                               \
+                    if (balance == 0)                                                      \
+                        return;                                                            \
+                }                                                                          \
+            } else {                                                                       \
+                if (balance == 1) {                                                        \
+                    int sibling_balance = name##_balance(parent->left);                    \
+                    subtree = name##_fix_left_heavy(t, parent);                            \
+                    if (sibling_balance == 0)                                              \
+                        return;                                                            \
+                } else {                                                                   \
+                    name##_set_balance(parent, balance + 1);                               \
+                    if (balance == 0)                                                      \
+                        return;                                                            \
+                }                                                                          \
+            }                                                                              \
+            parent = name##_parent(subtree);                                               \
+            if (parent)                                                                    \
+                left_shrunk = parent->left == subtree;                                     \
+        }                                                                                  \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_find(struct name *t,         \
+                                                                   key_type key) {         \
+        struct name##_node *n = t->root;                                                   \
+        /* The two-test form of rbt_gen.h, for the same reason */                          \
+        while (n && cmp(key, n->key) != 0)                                                 \
+            n = cmp(key, n->key) < 0 ? n->left : n->right;                                 \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_insert(struct name *t,       \
+                                                                     key_type key) {       \
+        struct name##_node **link = &t->root;                                              \
+        struct name##_node *parent = NULL;                                                 \
+        while (*link) {                                                                    \
+            if (cmp(key, (*link)->key) == 0)                                               \
+                return *link;                                                              \
+            parent = *link;                                                                \
+            link = cmp(key, parent->key) < 0 ? &parent->left : &parent->right;             \
+        }                                                                                  \
+        struct name##_node *n = malloc(sizeof(*n));                                        \
+        n->key = key;                                                                      \
+        n->left = n->right = NULL;                                                         \
+        n->parent_balance = (uintptr_t) parent;                                            \
+        name##_set_balance(n, 0);                                                          \
+        *link = n;                                                                         \
+        t->size++;                                                                         \
+        name##_retrace_insert(t, n);                                                       \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_min(struct name *t) {        \
+        struct name##_node *n = t->root;                                                   \
+        while (n && n->left)                                                               \
+            n = n->left;                                                                   \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_next(struct name##_node *n) { \
+        if (n->right) {                                                                    \
+            n = n->right;                                                                  \
+            while (n->left)                                                                \
+                n = n->left;                                                               \
+            return n;                                                                      \
+        }                                                                                  \
+        struct name##_node *parent;                                                        \
+        while ((parent = name##_parent(n)) && n == parent->right)                          \
+            n = parent;                                                                    \
+        return parent;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_transplant(struct name *t, struct name##_node *u,            \
+                                         struct name##_node *v) {                          \
+        struct name##_node *parent = name##_parent(u);                                     \
+        name##_replace_child(t, parent, u, v);                                             \
+        if (v)                                                                             \
+            name##_set_parent(v, parent);                                                  \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) void name##_remove(struct name *t,                      \
+                                                      struct name##_node *z) {             \
+        struct name##_node *parent;                                                        \
+        int left_shrunk;                                                                   \
+        if (!z->left || !z->right) {                                                       \
+            parent = name##_parent(z);                                                     \
+            left_shrunk = parent && parent->left == z;                                     \
+            name##_transplant(t, z, z->left ? z->left : z->right);                         \
+        } else {                                                                           \
+            struct name##_node *succ = z->right;                                           \
+            while (succ->left)                                                             \
+                succ = succ->left;                                                         \
+            if (name##_parent(succ) != z) {                                                \
+                parent = name##_parent(succ);                                              \
+                left_shrunk = 1;                                                           \
+                name##_transplant(t, succ, succ->right);                                   \
+                succ->right = z->right;                                                    \
+                name##_set_parent(succ->right, succ);                                      \
+            } else {                                                                       \
+                parent = succ;                                                             \
+                left_shrunk = 0;                                                           \
+            }                                                                              \
+            name##_transplant(t, z, succ);                                                 \
+            succ->left = z->left;                                                          \
+            name##_set_parent(succ->left, succ);                                           \
+            name##_set_balance(succ, name##_balance(z));                                   \
+        }                                                                                  \
+        t->size--;                                                                         \
+        free(z);                                                                           \
+        name##_retrace_remove(t, parent, left_shrunk);                                     \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) int name##_delete(struct name *t, key_type key) {       \
+        struct name##_node *n = name##_find(t, key);                                       \
+        if (!n)                                                                            \
+            return 0;                                                                      \
+        name##_remove(t, n);                                                               \
+        return 1;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Rotation-based teardown: linear, no recursion */                                    \
+    static __attribute__((unused)) void name##_free(struct name *t) {                      \
+        struct name##_node *n = t->root;                                                   \
+        while (n) {                                                                        \
+            struct name##_node *left = n->left;                                            \
+            if (left) {                                                                    \
+                n->left = left->right;                                                     \
+                left->right = n;                                                           \
+                n = left;                                                                  \
+            } else {                                                                       \
+                struct name##_node *right = n->right;                                      \
+                free(n);                                                                   \
+                n = right;                                                                 \
+            }                                                                              \
+        }                                                                                  \
+        name##_init(t);                                                                    \
+    }                                                                                      \
+                                                                                           \
+    static int name##_validate_node(const struct name##_node *n) {                         \
+        if (!n)                                                                            \
+            return 0;                                                                      \
+        if (n->left && (name##_parent(n->left) != n || cmp(n->left->key, n->key) >= 0))    \
+            return -1;                                                                     \
+        if (n->right && (name##_parent(n->right) != n || cmp(n->right->key, n->key) <= 0)) \
+            return -1;                                                                     \
+        int left = name##_validate_node(n->left);                                          \
+        int right = name##_validate_node(n->right);                                        \
+        int balance = name##_balance(n);                                                   \
+        if (left < 0 || right < 0 || balance > 1 || left - right != balance)               \
+            return -1;                                                                     \
+        return 1 + (left > right ? left : right);                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Also walks the tree in order, so keys must ascend and number t->size */             \
+    static __attribute__((unused)) int name##_validate(struct name *t) {                   \
+        if (t->root && name##_parent(t->root))                                             \
+            return -1;                                                                     \
+        size_t count = 0;                                                                  \
+        for (struct name##_node *n = name##_min(t); n; n = name##_next(n), count++) {      \
+            struct name##_node *next = name##_next(n);                                     \
+            if (next && cmp(n->key, next->key) >= 0)                                       \
+                return -1;                                                                 \
+        }                                                                                  \
+        if (count != t->size)                                                              \
+            return -1;                                                                     \
+        return name##_validate_node(t->root);                                              \
+    }
+
+#endif
@@ -0,0 +1,456 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Persistent AVL tree. Insert and remove never modify a node that another
+ * version can reach: they copy the nodes on the search path and return a new
+ * root that shares every other subtree with the old one. Nodes have no parent
+ * pointer, since a shared node has many parents, and are reclaimed by
+ * reference counting.
+ *
+ * A node's refcount is the number of nodes and version roots pointing at it.
+ * Every node an update reaches through a shared parent has a count of at
+ * least two, so a count of one marks a node the update itself created; those
+ * are the only nodes it modifies in place.
+ */
+struct avl_persistent_node {
+    int data;
+    int height;
+    unsigned refcount;
+    struct avl_persistent_node *left;
+    struct avl_persistent_node *right;
+};
+
+static size_t live_nodes;
+
+static struct avl_persistent_node *node_alloc(int data) {
+    struct avl_persistent_node *node = malloc(sizeof(struct avl_persistent_node));
+    node->data = data;
+    node->height = 1;
+    node->refcount = 1;
+    node->left = node->right = NULL;
+    live_nodes++;
+    return node;
+}
+
+/* A new reference to the same version: O(1) */
+struct avl_persistent_node *avl_persistent_retain(struct avl_persistent_node *root) {
+    if (root)
+        root->refcount++;
+    return root;
+}
+
+void avl_persistent_release(struct avl_persistent_node *root) {
+    if (!root || --root->refcount)
+        return;
+
+    avl_persistent_release(root->left);
+    avl_persistent_release(root->right);
+    free(root);
+    live_nodes--;
+}
+
+/*
+ * Consume one reference to node and return a node with the same contents
+ * that the caller may modify: node itself when that was the only reference,
+ * otherwise a fresh copy sharing node's children.
+ */
+static struct avl_persistent_node *unshare(struct avl_persistent_node *node) {
+    if (node->refcount == 1)
+        return node;
+
+    struct avl_persistent_node *copy = node_alloc(node->data);
+    copy->height = node->height;
+    copy->left = avl_persistent_retain(node->left);
+    copy->right = avl_persistent_retain(node->right);
+    node->refcount--;
+    return copy;
+}
+
+static inline int height(const struct avl_persistent_node *node) {
+    return node ? node->height : 0;
+}
+
+static inline void update_height(struct avl_persistent_node *node) {
+    int lh = height(node->left), rh = height(node->right);
+    node->height = 1 + (lh > rh ? lh : rh);
+}
+
+static inline int balance_factor(const struct avl_persistent_node *node) {
+    return height(node->left) - height(node->right);
+}
+
+/* Rotations take an unshared node and unshare the child they move up */
+static struct avl_persistent_node *right_rotate(struct avl_persistent_node *y) {
+    struct avl_persistent_node *x = unshare(y->left);
+    y->left = x->right;
+    x->right = y;
+    update_height(y);
+    update_height(x);
+    return x;
+}
+
+static struct avl_persistent_node *left_rotate(struct avl_persistent_node *x) {
+    struct avl_persistent_node *y = unshare(x->right);
+    x->right = y->left;
+    y->left = x;
+    update_height(x);
+    update_height(y);
+    return y;
+}
+
+static struct avl_persistent_node *rebalance(struct avl_persistent_node *node) {
+    update_height(node);
+    int balance = balance_factor(node);
+
+    if (balance > 1) {
+        if (balance_factor(node->left) < 0) {
+            node->left = unshare(node->left);
+            node->left = left_rotate(node->left);
+        }
+        return right_rotate(node);
+    }
+
+    if (balance < -1) {
+        if (balance_factor(node->right) > 0) {
+            node->right = unshare(node->right);
+            node->right = right_rotate(node->right);
+        }
+        return left_rotate(node);
+    }
+
+    return node;
+}
+
+/* The helpers below consume a reference to node and return one to the result */
+static struct avl_persistent_node *insert_at(struct avl_persistent_node *node, int data) {
+    if (!node)
+        return node_alloc(data);
+
+    node = unshare(node);
+    if (data < node->data)
+        node->left = insert_at(node->left, data);
+    else
+        node->right = insert_at(node->right, data);
+    return rebalance(node);
+}
+
+static struct avl_persistent_node *remove_min(struct avl_persistent_node *node, int *min_out) {
+    node = unshare(node);
+    if (!node->left) {
+        struct avl_persistent_node *right = avl_persistent_retain(node->right);
+        *min_out = node->data;
+        avl_persistent_release(node);
+        return right;
+    }
+
+    node->left = remove_min(node->left, min_out);
+    return rebalance(node);
+}
+
+static struct avl_persistent_node *remove_at(struct avl_persistent_node *node, int data) {
+    node = unshare(node);
+
+    if (data < node->data) {
+        node->left = remove_at(node->left, data);
+    } else if (data > node->data) {
+        node->right = remove_at(node->right, data);
+    } else if (!node->left || !node->right) {
+        struct avl_persistent_node *child = avl_persistent_retain(node->left ? node->left : node->right);
+        avl_persistent_release(node);
+        return child;
+    } else {
+        node->right = remove_min(node->right, &node->data);
+    }
+
+    return rebalance(node);
+}
+
+struct avl_persistent_node *avl_persistent_search(struct avl_persistent_node *root, int data) {
+    while (root && root->data != data)
+        root = data < root->data ? root->left : root->right;
+    return root;
+}
+
+/*
+ * Return a new version with data inserted. root stays valid and unchanged;
+ * both versions must be released independently.
+ */
+struct avl_persistent_node *avl_persistent_insert(struct avl_persistent_node *root, int data) {
+    return insert_at(avl_persistent_retain(root), data);
+}
+
+/* Return a new version without data; if data is absent that is just root again */
+struct avl_persistent_node *avl_persistent_remove(struct avl_persistent_node *root, int data) {
+    if (!avl_persistent_search(root, data))
+        return avl_persistent_retain(root);
+    return remove_at(avl_persistent_retain(root), data);
+}
+
+/*
+ * Numbered history of versions for audit reads and rollback. Each slot owns
+ * one reference to its root.
+ */
+struct avl_persistent_history {
+    struct avl_persistent_node **roots;
+    size_t count;
+    size_t capacity;
+};
+
+/* Takes over the caller's reference to root and returns its version number */
+size_t avl_persistent_commit(struct avl_persistent_history *history, struct avl_persistent_node *root) {
+    if (history->count == history->capacity) {
+        history->capacity = history->capacity ? history->capacity * 2 : 16;
+        history->roots = realloc(history->roots, history->capacity * sizeof(struct avl_persistent_node *));
+    }
+    history->roots[history->count] = root;
+    return history->count++;
+}
+
+struct avl_persistent_node *avl_persistent_version(struct avl_persistent_history *history, size_t version) {
+    return version < history->count ? history->roots[version] : NULL;
+}
+
+/* Drop every version after `version`, freeing whatever only they used */
+void avl_persistent_rollback(struct avl_persistent_history *history, size_t version) {
+    while (history->count > version + 1)
+        avl_persistent_release(history->roots[--history->count]);
+}
+
+void avl_persistent_history_free(struct avl_persistent_history *history) {
+    while (history->count)
+        avl_persistent_release(history->roots[--history->count]);
+    free(history->roots);
+    history->roots = NULL;
+    history->capacity = 0;
+}
+
+int validate_avl_persistent(struct avl_persistent_node *node, int64_t lo, int64_t hi) {
+    if (!node)
+        return 1;
+
+    if (node->data <= lo || node->data >= hi) {
+        fprintf(stderr, "AVL order violation at %d\n", node->data);
+        return 0;
+    }
+
+    if (!node->refcount) {
+        fprintf(stderr, "AVL node %d reachable with a zero refcount\n", node->data);
+        return 0;
+    }
+
+    if (!validate_avl_persistent(node->left, lo, node->data) ||
+        !validate_avl_persistent(node->right, node->data, hi))
+        return 0;
+
+    int bf = balance_factor(node);
+    if (bf < -1 || bf > 1) {
+        fprintf(stderr, "AVL balance violation at %d (bf = %d)\n", node->data, bf);
+        return 0;
+    }
+
+    int lh = height(node->left), rh = height(node->right);
+    if (node->height != 1 + (lh > rh ? lh : rh)) {
+        fprintf(stderr, "AVL height mismatch at %d\n", node->data);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Nodes are named by address, so subtrees shared by the two versions are drawn once */
+static void export_dot(FILE *fp, struct avl_persistent_node *node, int *seen_cap,
+                       const void ***seen, int *seen_count) {
+    for (int i = 0; i < *seen_count; i++)
+        if ((*seen)[i] == node)
+            return;
+    if (*seen_count == *seen_cap) {
+        *seen_cap = *seen_cap ? *seen_cap * 2 : 64;
+        *seen = realloc(*seen, *seen_cap * sizeof(void *));
+    }
+    (*seen)[(*seen_count)++] = node;
+
+    fprintf(fp,
+            "    \"%p\" [label=\"%d\\nrc %u\", color=\"gray\", fontcolor=\"white\", style=filled, "
+            "fillcolor=\"%s\"];\n",
+            (void *) node, node->data, node->refcount, node->refcount > 1 ? "#404080" : "#808080");
+
+    if (node->left) {
+        fprintf(fp, "    \"%p\" -> \"%p\";\n", (void *) node, (void *) node->left);
+        export_dot(fp, node->left, seen_cap, seen, seen_count);
+    }
+
+    if (node->right) {
+        fprintf(fp, "    \"%p\" -> \"%p\";\n", (void *) node, (void *) node->right);
+        export_dot(fp, node->right, seen_cap, seen, seen_count);
+    }
+}
+
+void export_versions_to_dot(struct avl_persistent_node *a, struct avl_persistent_node *b,
+                            const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    const void **seen = NULL;
+    int seen_cap = 0, seen_count = 0;
+
+    fprintf(fp, "digraph PersistentAvlTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+    fprintf(fp, "    \"old\" [shape=box, fixedsize=false];\n");
+    fprintf(fp, "    \"new\" [shape=box, fixedsize=false];\n");
+
+    if (a) {
+        fprintf(fp, "    \"old\" -> \"%p\";\n", (void *) a);
+        export_dot(fp, a, &seen_cap, &seen, &seen_count);
+    }
+    if (b) {
+        fprintf(fp, "    \"new\" -> \"%p\";\n", (void *) b);
+        export_dot(fp, b, &seen_cap, &seen, &seen_count);
+    }
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+    free(seen);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#define NUM_REMOVES NUM_INSERTS / 2
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 16)
+#endif
+
+#ifndef BENCH_VERSIONS
+#define BENCH_VERSIONS 1000
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Keep BENCH_VERSIONS versions of a BENCH_KEYS tree alive, one update apart */
+static void benchmark(void) {
+    struct avl_persistent_history history = {0};
+    struct avl_persistent_node *root = NULL;
+
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        struct avl_persistent_node *next = avl_persistent_insert(root, rand());
+        avl_persistent_release(root);
+        root = next;
+    }
+    avl_persistent_commit(&history, root);
+    size_t base_nodes = live_nodes;
+
+    double start = now_ns();
+    for (int v = 1; v < BENCH_VERSIONS; v++) {
+        struct avl_persistent_node *prev = avl_persistent_version(&history, v - 1);
+        struct avl_persistent_node *next;
+        if (v % 2)
+            next = avl_persistent_insert(prev, rand());
+        else
+            next = avl_persistent_remove(prev, prev->data);
+        avl_persistent_commit(&history, next);
+    }
+    double update_ns = (now_ns() - start) / (BENCH_VERSIONS - 1);
+
+    printf("    %d keys, %d versions: %.1f ns/update, %.2fx the nodes of one version "
+           "(%.1f new nodes per version)\n",
+           BENCH_KEYS, BENCH_VERSIONS, update_ns, (double) live_nodes / base_nodes,
+           (double) (live_nodes - base_nodes) / (BENCH_VERSIONS - 1));
+
+    avl_persistent_history_free(&history);
+    assert(live_nodes == 0);
+}
+
+static void check_version(struct avl_persistent_history *history, size_t version,
+                          const unsigned char *present, int range) {
+    struct avl_persistent_node *root = avl_persistent_version(history, version);
+    assert(validate_avl_persistent(root, INT64_MIN, INT64_MAX));
+    for (int k = 0; k < range; k++)
+        assert(!avl_persistent_search(root, k) == !present[k]);
+}
+
+int main() {
+    printf("Persistent AVL tree... ");
+    fflush(stdout);
+
+    struct avl_persistent_history history = {0};
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    /* present[v * range + k]: whether version v holds key k */
+    int range = NUM_INSERTS * 4;
+    int versions = NUM_INSERTS + NUM_REMOVES + 1;
+    unsigned char *present = calloc((size_t) versions * range, 1);
+    size_t v = avl_persistent_commit(&history, NULL);
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % range;
+        struct avl_persistent_node *root = avl_persistent_version(&history, v);
+        if (avl_persistent_search(root, value))
+            continue;
+
+        values[i++] = value;
+        v = avl_persistent_commit(&history, avl_persistent_insert(root, value));
+        memcpy(present + v * range, present + (v - 1) * range, range);
+        present[v * range + value] = 1;
+        assert(validate_avl_persistent(avl_persistent_version(&history, v), INT64_MIN, INT64_MAX));
+    }
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        struct avl_persistent_node *root = avl_persistent_version(&history, v);
+        v = avl_persistent_commit(&history, avl_persistent_remove(root, values[i]));
+        memcpy(present + v * range, present + (v - 1) * range, range);
+        present[v * range + values[i]] = 0;
+    }
+
+    /* Every version still reads exactly as it did when it was committed */
+    for (size_t w = 0; w <= v; w++)
+        check_version(&history, w, present + w * range, range);
+
+    export_versions_to_dot(avl_persistent_version(&history, v - 1), avl_persistent_version(&history, v),
+                           "avltree_persistent.dot");
+
+    /* Roll back to the last insert and branch off with different removes */
+    avl_persistent_rollback(&history, NUM_INSERTS);
+    assert(history.count == NUM_INSERTS + 1);
+    v = NUM_INSERTS;
+    for (int i = NUM_INSERTS - 1; i >= NUM_INSERTS - NUM_REMOVES; i--) {
+        struct avl_persistent_node *root = avl_persistent_version(&history, v);
+        v = avl_persistent_commit(&history, avl_persistent_remove(root, values[i]));
+        memcpy(present + v * range, present + (v - 1) * range, range);
+        present[v * range + values[i]] = 0;
+    }
+    for (size_t w = 0; w <= v; w++)
+        check_version(&history, w, present + w * range, range);
+
+    avl_persistent_history_free(&history);
+    assert(live_nodes == 0);
+    printf("complete\n");
+
+    benchmark();
+
+    free(present);
+    free(values);
+    return 0;
+}
@@ -0,0 +1,494 @@
+/*
+ * Workload benchmark for the six trees, driven through the runtime table of
+ * ordmap.h so that every backend runs exactly the same operation stream.
+ *
+ * For each key count, distribution and backend, the map is loaded with that
+ * many records and the workloads then run one after another on it, as YCSB
+ * runs them. Record i always has the same key, so the stream depends only on
+ * the seed, never on the backend:
+ *   uniform     keys scattered over the int range, requests uniform
+ *   zipfian     the same keys, requests Zipfian (YCSB's theta = 0.99) with
+ *               the hot records scattered through the key space
+ *   sequential  keys 0, 1, 2, ... loaded in order, requests walk them in order
+ *   clustered   runs of CLUSTER consecutive keys scattered over the key
+ *               space, requests in bursts of CLUSTER within one run
+ *
+ * The workloads are YCSB core workloads A to E, or a custom mix:
+ *   A  50% read, 50% update     B  95% read, 5% update     C  100% read
+ *   D  95% read, 5% insert      E  95% scan, 5% insert
+ * The maps hold keys only, so an update deletes its key and inserts it
+ * again. A scan visits 1 to MAX_SCAN keys from its start key. D reads the
+ * latest records, as YCSB's D does: whatever the distribution, the record
+ * i ranks from the newest is read with Zipfian probability, so fresh
+ * inserts are the hot ones.
+ *
+ * One CSV line or JSON object per run: load and run throughput, latency
+ * percentiles over every sample-th operation, and heap bytes per key after
+ * the load. Heap bytes come from glibc's mallinfo2; elsewhere the field is
+ * empty in CSV and null in JSON. Progress goes to stderr.
+ *
+ * Usage: bench [options]   (see usage() below; make bench passes BENCH_ARGS)
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bench_util.h"
+#include "../ordmap.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define CLUSTER 64
+#define MAX_SCAN 100
+
+enum dist {
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_SEQUENTIAL,
+    DIST_CLUSTERED,
+    NUM_DISTS,
+};
+
+static const char *const dist_names[NUM_DISTS] = {"uniform", "zipfian", "sequential", "clustered"};
+
+struct workload {
+    const char *name;
+    int read, update, insert, scan; /* percentages */
+    bool latest;                    /* reads favour the newest records */
+};
+
+static struct workload workloads[] = {
+    {.name = "A", .read = 50, .update = 50},
+    {.name = "B", .read = 95, .update = 5},
+    {.name = "C", .read = 100},
+    {.name = "D", .read = 95, .insert = 5, .latest = true},
+    {.name = "E", .insert = 5, .scan = 95},
+    {.name = "custom"},
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* Bijection on 32-bit values (lowbias32) */
+static inline uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Bijection on [0, n) for n below 2^32: 2654435761 is prime, so coprime to n */
+static inline uint64_t permute(uint64_t x, uint64_t n) {
+    return (x * 2654435761ULL + 0x5bd1e995) % n;
+}
+
+/*
+ * Zipfian ranks in [0, n) without a table, after Gray et al., "Quickly
+ * generating billion-record synthetic databases", as YCSB does it.
+ */
+struct zipf {
+    uint64_t n;
+    double alpha, zetan, eta;
+    double half_pow_theta;
+};
+
+static void zipf_init(struct zipf *z, uint64_t n, double theta) {
+    z->n = n;
+    z->half_pow_theta = pow(0.5, theta);
+    z->zetan = 0;
+    for (uint64_t i = 1; i <= n; i++)
+        z->zetan += 1 / pow((double) i, theta);
+    z->alpha = 1 / (1 - theta);
+    z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - (1 + z->half_pow_theta) / z->zetan);
+}
+
+static uint64_t zipf_next(struct zipf *z, uint64_t *rng) {
+    double u = (xorshift64(rng) >> 11) * 0x1p-53;
+    double uz = u * z->zetan;
+
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + z->half_pow_theta)
+        return 1;
+    uint64_t rank = z->n * pow(z->eta * u - z->eta + 1, z->alpha);
+    return rank < z->n ? rank : z->n - 1;
+}
+
+/* Which records exist, their keys, and which one the next request targets */
+struct keyspace {
+    enum dist dist;
+    uint64_t records;  /* records 0 .. records - 1 are in the map */
+    uint64_t clusters; /* key runs the clustered layout spreads over */
+    uint64_t rng;
+    uint64_t cursor;   /* sequential position */
+    uint64_t burst;    /* clustered: run being read and requests left in it */
+    uint64_t burst_left;
+    struct zipf *zipf; /* over the loaded records, shared by every backend */
+};
+
+static int key_of(struct keyspace *ks, uint64_t record) {
+    switch (ks->dist) {
+    case DIST_SEQUENTIAL:
+        return (int) record;
+    case DIST_CLUSTERED:
+        /* Runs start 2 * CLUSTER apart, so they never touch */
+        return ordmap_ikey(permute(record / CLUSTER, ks->clusters) * 2 * CLUSTER + record % CLUSTER);
+    default:
+        return (int) mix32((uint32_t) record);
+    }
+}
+
+static uint64_t next_record(struct keyspace *ks) {
+    switch (ks->dist) {
+    case DIST_ZIPFIAN:
+        return permute(zipf_next(ks->zipf, &ks->rng), ks->zipf->n);
+    case DIST_SEQUENTIAL:
+        return ks->cursor++ % ks->records;
+    case DIST_CLUSTERED:
+        if (ks->records >= CLUSTER) {
+            if (!ks->burst_left) {
+                ks->burst = xorshift64(&ks->rng) % (ks->records / CLUSTER);
+                ks->burst_left = CLUSTER;
+            }
+            return ks->burst * CLUSTER + CLUSTER - ks->burst_left--;
+        }
+        /* fall through */
+    default:
+        return xorshift64(&ks->rng) % ks->records;
+    }
+}
+
+/* YCSB's "latest": Zipfian ranks counted back from the newest record */
+static uint64_t latest_record(struct keyspace *ks) {
+    return ks->records - 1 - zipf_next(ks->zipf, &ks->rng);
+}
+
+struct options {
+    char *backends, *dists, *workloads, *keys;
+    uint64_t ops;
+    uint64_t seed;
+    unsigned sample;
+    double theta;
+    bool json;
+};
+
+struct result {
+    double load_mops, run_mops, bytes_per_key;
+    double p50, p90, p99, p999, max;
+};
+
+/* Heap bytes in use, or NaN where the C library cannot tell */
+static double heap_bytes(void) {
+#ifdef __GLIBC__
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return NAN;
+#endif
+}
+
+static bool scan_visit(int key, void *arg) {
+    (void) key;
+    return --*(int *) arg > 0;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const uint32_t *sorted, size_t n, double p) {
+    return n ? sorted[(size_t) (p * (n - 1))] : 0;
+}
+
+static void run_workload(struct ordmap *m, struct keyspace *ks, const struct workload *w,
+                         const struct options *opt, uint32_t *latency, struct result *r) {
+    size_t samples = 0;
+    uint64_t misses = 0;
+
+    double start = now_ns();
+    for (uint64_t i = 0; i < opt->ops; i++) {
+        int dice = xorshift64(&ks->rng) % 100;
+        bool timed = i % opt->sample == 0;
+        double t = timed ? now_ns() : 0;
+
+        if (dice < w->read) {
+            uint64_t record = w->latest ? latest_record(ks) : next_record(ks);
+            misses += !ordmap_lookup(m, key_of(ks, record));
+        } else if ((dice -= w->read) < w->update) {
+            int key = key_of(ks, next_record(ks));
+            ordmap_delete(m, key);
+            ordmap_insert(m, key);
+        } else if ((dice -= w->update) < w->insert) {
+            ordmap_insert(m, key_of(ks, ks->records++));
+        } else {
+            int left = 1 + xorshift64(&ks->rng) % MAX_SCAN;
+            ordmap_range(m, key_of(ks, next_record(ks)), INT_MAX, scan_visit, &left);
+        }
+
+        if (timed)
+            latency[samples++] = (uint32_t) fmin(now_ns() - t, UINT32_MAX);
+    }
+    r->run_mops = opt->ops / (now_ns() - start) * 1e3;
+
+    /* Requests only target records in the map, and updates put their key back */
+    assert(misses == 0 && ordmap_size(m) == ks->records);
+
+    qsort(latency, samples, sizeof(uint32_t), compare_u32);
+    r->p50 = percentile(latency, samples, 0.50);
+    r->p90 = percentile(latency, samples, 0.90);
+    r->p99 = percentile(latency, samples, 0.99);
+    r->p999 = percentile(latency, samples, 0.999);
+    r->max = samples ? latency[samples - 1] : 0;
+}
+
+static bool printed; /* anything yet, for the CSV header and JSON separators */
+
+static void print_result(const struct options *opt, const char *backend, enum dist dist,
+                         const char *workload, uint64_t keys, const struct result *r) {
+
+    if (opt->json) {
+        printf("%s  {\"backend\": \"%s\", \"distribution\": \"%s\", \"workload\": \"%s\", "
+               "\"keys\": %llu, \"ops\": %llu, \"load_mops\": %.3f, \"run_mops\": %.3f, "
+               "\"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, "
+               "\"max_ns\": %.0f, \"bytes_per_key\": ",
+               printed ? ",\n" : "[\n", backend, dist_names[dist], workload, (unsigned long long) keys,
+               (unsigned long long) opt->ops, r->load_mops, r->run_mops, r->p50, r->p90, r->p99,
+               r->p999, r->max);
+        if (isnan(r->bytes_per_key))
+            printf("null}");
+        else
+            printf("%.1f}", r->bytes_per_key);
+    } else {
+        if (!printed)
+            printf("backend,distribution,workload,keys,ops,load_mops,run_mops,"
+                   "p50_ns,p90_ns,p99_ns,p999_ns,max_ns,bytes_per_key\n");
+        printf("%s,%s,%s,%llu,%llu,%.3f,%.3f,%.0f,%.0f,%.0f,%.0f,%.0f,", backend,
+               dist_names[dist], workload, (unsigned long long) keys, (unsigned long long) opt->ops,
+               r->load_mops, r->run_mops, r->p50, r->p90, r->p99, r->p999, r->max);
+        if (!isnan(r->bytes_per_key))
+            printf("%.1f", r->bytes_per_key);
+        printf("\n");
+    }
+    fflush(stdout);
+    printed = true;
+}
+
+/* Load keys records into a fresh map, then run the selected workloads on it */
+static void run_backend(const struct options *opt, const struct ordmap_ops *ops, enum dist dist,
+                        uint64_t keys, struct zipf *zipf, const bool *selected, uint32_t *latency) {
+    struct keyspace ks = {.dist = dist, .rng = opt->seed, .zipf = zipf};
+    struct result r = {0};
+    struct ordmap m;
+    uint64_t inserts = 0;
+
+    for (size_t w = 0; w < NUM_WORKLOADS; w++)
+        if (selected[w])
+            inserts += opt->ops;
+    ks.clusters = (keys + inserts) / CLUSTER + 1;
+
+    double heap = heap_bytes();
+    ordmap_init_backend(&m, ops);
+    double start = now_ns();
+    for (; ks.records < keys; ks.records++)
+        ordmap_insert(&m, key_of(&ks, ks.records));
+    r.load_mops = keys / (now_ns() - start) * 1e3;
+    r.bytes_per_key = (heap_bytes() - heap) / keys;
+    assert(ordmap_size(&m) == keys);
+
+    for (size_t w = 0; w < NUM_WORKLOADS; w++) {
+        if (!selected[w])
+            continue;
+        fprintf(stderr, "  %s, %s, %llu keys, workload %s\n", ops->name, dist_names[dist],
+                (unsigned long long) keys, workloads[w].name);
+        run_workload(&m, &ks, &workloads[w], opt, latency, &r);
+        print_result(opt, ops->name, dist, workloads[w].name, keys, &r);
+    }
+    ordmap_destroy(&m);
+}
+
+/* 1000, 64K, 1M, 2G and the like */
+static uint64_t parse_count(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+
+    switch (*end) {
+    case 'k':
+    case 'K':
+        v *= 1e3;
+        break;
+    case 'm':
+    case 'M':
+        v *= 1e6;
+        break;
+    case 'g':
+    case 'G':
+        v *= 1e9;
+        break;
+    }
+    return (uint64_t) v;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b, --backends LIST   rbt,avl,treap,splay,bplus,radix (default: all)\n"
+            "  -d, --dists LIST      uniform,zipfian,sequential,clustered (default: all)\n"
+            "  -w, --workloads LIST  A,B,C,D,E,custom (default: A,B,C,D,E)\n"
+            "  -m, --mix R:U:I:S     read:update:insert:scan percentages for workload custom\n"
+            "  -n, --keys LIST       records loaded before the workloads, 1K to 100M (default: 1K,100K)\n"
+            "  -o, --ops N           operations per workload (default: 200K)\n"
+            "  -s, --seed N          seed of the request stream (default: fixed)\n"
+            "  -l, --sample N        time every Nth operation for the percentiles (default: 8)\n"
+            "  -t, --theta X         Zipfian skew (default: 0.99)\n"
+            "  -j, --json            JSON instead of CSV\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    struct options opt = {
+        .backends = NULL,
+        .dists = "uniform,zipfian,sequential,clustered",
+        .workloads = "A,B,C,D,E",
+        .keys = "1K,100K",
+        .ops = 200000,
+        .seed = 0x2545f4914f6cdd1dULL,
+        .sample = 8,
+        .theta = 0.99,
+    };
+    static const struct option long_options[] = {
+        {"backends", required_argument, NULL, 'b'}, {"dists", required_argument, NULL, 'd'},
+        {"workloads", required_argument, NULL, 'w'}, {"mix", required_argument, NULL, 'm'},
+        {"keys", required_argument, NULL, 'n'},      {"ops", required_argument, NULL, 'o'},
+        {"seed", required_argument, NULL, 's'},      {"sample", required_argument, NULL, 'l'},
+        {"theta", required_argument, NULL, 't'},     {"json", no_argument, NULL, 'j'},
+        {NULL, 0, NULL, 0},
+    };
+    struct workload *custom = &workloads[NUM_WORKLOADS - 1];
+    int c;
+
+    while ((c = getopt_long(argc, argv, "b:d:w:m:n:o:s:l:t:j", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'b':
+            opt.backends = optarg;
+            break;
+        case 'd':
+            opt.dists = optarg;
+            break;
+        case 'w':
+            opt.workloads = optarg;
+            break;
+        case 'n':
+            opt.keys = optarg;
+            break;
+        case 'o':
+            opt.ops = parse_count(optarg);
+            break;
+        case 's':
+            opt.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'l':
+            opt.sample = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            opt.theta = strtod(optarg, NULL);
+            break;
+        case 'j':
+            opt.json = true;
+            break;
+        case 'm':
+            if (sscanf(optarg, "%d:%d:%d:%d", &custom->read, &custom->update, &custom->insert,
+                       &custom->scan) != 4 ||
+                custom->read + custom->update + custom->insert + custom->scan != 100) {
+                fprintf(stderr, "--mix needs four percentages that add up to 100\n");
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!opt.seed || !opt.sample || opt.theta <= 0 || opt.theta >= 1)
+        usage(argv[0]);
+
+    bool backend_on[ORDMAP_NUM_BACKENDS] = {0}, dist_on[NUM_DISTS] = {0}, workload_on[NUM_WORKLOADS] = {0};
+    char *list, *item, *save;
+
+    list = strdup(opt.backends ? opt.backends : "rbt,avl,treap,splay,bplus,radix");
+    for (item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        size_t i = 0;
+        while (i < ORDMAP_NUM_BACKENDS && strcmp(ordmap_backends[i]->name, item))
+            i++;
+        if (i == ORDMAP_NUM_BACKENDS)
+            usage(argv[0]);
+        backend_on[i] = true;
+    }
+    free(list);
+
+    list = strdup(opt.dists);
+    for (item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        int i = 0;
+        while (i < NUM_DISTS && strcmp(dist_names[i], item))
+            i++;
+        if (i == NUM_DISTS)
+            usage(argv[0]);
+        dist_on[i] = true;
+    }
+    free(list);
+
+    list = strdup(opt.workloads);
+    for (item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        size_t i = 0;
+        while (i < NUM_WORKLOADS && strcasecmp(workloads[i].name, item))
+            i++;
+        if (i == NUM_WORKLOADS)
+            usage(argv[0]);
+        workload_on[i] = true;
+    }
+    free(list);
+    if (workload_on[NUM_WORKLOADS - 1] && custom->read + custom->update + custom->insert + custom->scan != 100) {
+        fprintf(stderr, "workload custom needs --mix\n");
+        return 2;
+    }
+
+    uint32_t *latency = malloc((opt.ops / opt.sample + 1) * sizeof(uint32_t));
+
+    list = strdup(opt.keys);
+    for (item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        uint64_t keys = parse_count(item);
+        if (keys < 2 || keys > INT_MAX / 4)
+            usage(argv[0]);
+
+        /* The zipfian distribution and workload D's latest records both draw from it */
+        bool latest = false;
+        for (size_t w = 0; w < NUM_WORKLOADS; w++)
+            latest |= workload_on[w] && workloads[w].latest;
+        struct zipf zipf;
+        if (dist_on[DIST_ZIPFIAN] || latest)
+            zipf_init(&zipf, keys, opt.theta);
+
+        for (int d = 0; d < NUM_DISTS; d++) {
+            if (!dist_on[d])
+                continue;
+            for (size_t b = 0; b < ORDMAP_NUM_BACKENDS; b++)
+                if (backend_on[b])
+                    run_backend(&opt, ordmap_backends[b], d, keys, &zipf, workload_on, latency);
+        }
+    }
+    free(list);
+
+    if (opt.json)
+        printf(printed ? "\n]\n" : "[]\n");
+    free(latency);
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * Timing and random-number helpers for the benchmarks: a monotonic clock in
+ * nanoseconds and a xorshift64 generator. Each file that times or draws keys
+ * includes this, rather than borrowing them from a tree file it happens to
+ * pull in.
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static inline uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+#endif
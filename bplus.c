@@ -6,6 +6,8 @@
 #include <string.h>
 #include <time.h>
 
+#include "arena.h"
+
 #define BPTREE_ORDER 16
 #define BPTREE_MAX_KEYS(order) ((order) - 1)
 #define BPTREE_MIN_KEYS(order) (((order) + 1) / 2 - 1)
@@ -22,19 +24,45 @@ struct bptree_node {
 struct bptree {
     struct bptree_node *root;
     int32_t order;
+    struct arena *arena; /* node storage, or NULL to use calloc */
 };
 
-struct bptree *bptree_create(int32_t order) {
+static struct bptree_node *bptree_new_node(struct bptree *tree) {
+    if (tree->arena)
+        return arena_calloc(tree->arena, sizeof(struct bptree_node));
+    return calloc(1, sizeof(struct bptree_node));
+}
+
+static void bptree_release_node(struct bptree *tree, struct bptree_node *node) {
+    if (tree->arena)
+        arena_free(tree->arena, node, sizeof(*node));
+    else
+        free(node);
+}
+
+static struct bptree *bptree_create_with(int32_t order, struct arena *arena) {
     struct bptree *tree = malloc(sizeof(*tree));
     tree->order = order;
+    tree->arena = arena;
 
-    struct bptree_node *root = calloc(1, sizeof(*root));
+    struct bptree_node *root = bptree_new_node(tree);
     root->leaf = true;
 
     tree->root = root;
     return tree;
 }
 
+struct bptree *bptree_create(int32_t order) {
+    return bptree_create_with(order, NULL);
+}
+
+/* A tree whose nodes come from a private arena; see arena.h for the flags */
+struct bptree *bptree_create_arena(int32_t order, unsigned arena_flags) {
+    struct arena *arena = malloc(sizeof(*arena));
+    arena_init(arena, arena_flags);
+    return bptree_create_with(order, arena);
+}
+
 void *bptree_search(struct bptree *tree, int32_t key) {
     struct bptree_node *node = tree->root;
 
@@ -53,12 +81,34 @@ void *bptree_search(struct bptree *tree, int32_t key) {
     return NULL;
 }
 
+/* Leaf and slot of the smallest key >= key; NULL once past the last key */
+struct bptree_node *bptree_lower_bound(struct bptree *tree, int32_t key, int *idx) {
+    struct bptree_node *node = tree->root;
+
+    while (!node->leaf) {
+        int32_t i = 0;
+        while (i < node->num_keys && key >= node->keys[i])
+            i++;
+        node = node->children[i];
+    }
+
+    int32_t i = 0;
+    while (i < node->num_keys && node->keys[i] < key)
+        i++;
+    if (i == node->num_keys) {
+        node = node->next;
+        i = 0;
+    }
+    *idx = i;
+    return node;
+}
+
 static struct bptree_node *
 bptree_split_leaf(struct bptree *tree, struct bptree_node *leaf, int32_t *promoted_key) {
     int mid = leaf->num_keys / 2; /* floor(n/2) keys in left */
     int right_count = leaf->num_keys - mid;
 
-    struct bptree_node *new_leaf = calloc(1, sizeof(*new_leaf));
+    struct bptree_node *new_leaf = bptree_new_node(tree);
     new_leaf->leaf = true;
 
     /* Copy second half keys/children */
@@ -123,7 +173,7 @@ bptree_insert_internal(struct bptree *tree, struct bptree_node *node,
             int32_t mid = node->num_keys / 2;
             int32_t right_count = node->num_keys - mid - 1;
 
-            struct bptree_node *new_node = calloc(1, sizeof(*new_node));
+            struct bptree_node *new_node = bptree_new_node(tree);
             new_node->leaf = false;
 
             /* Copy keys/children to new internal node */
@@ -147,7 +197,7 @@ void bptree_insert(struct bptree *tree, int32_t key, void *value) {
         bptree_insert_internal(tree, tree->root, key, value, &promoted);
 
     if (new_node) {
-        struct bptree_node *new_root = calloc(1, sizeof(*new_root));
+        struct bptree_node *new_root = bptree_new_node(tree);
         new_root->keys[0] = promoted;
         new_root->children[0] = tree->root;
         new_root->children[1] = new_node;
@@ -343,7 +393,7 @@ static void merge_nodes(struct bptree *tree, struct bptree_node *parent, int idx
     }
     parent->num_keys--;
 
-    free(right);
+    bptree_release_node(tree, right);
 }
 
 /* Helper: update parent keys if the first key in a child changed */
@@ -408,10 +458,8 @@ static bool delete_recursive(struct bptree *tree, struct bptree_node *node, int3
         while (idx < node->num_keys && node->keys[idx] != key)
             idx++;
 
-        if (idx == node->num_keys) {
-            printf("recursive deletion failed for %d\n", key);
+        if (idx == node->num_keys)
             return false;
-        }
 
         remove_from_leaf(tree, node, idx);
         return true;
@@ -437,31 +485,52 @@ bool bptree_delete(struct bptree *tree, int32_t key) {
     if (tree->root->num_keys == 0 && !tree->root->leaf) {
         struct bptree_node *old_root = tree->root;
         tree->root = tree->root->children[0];
-        free(old_root);
+        bptree_release_node(tree, old_root);
     }
 
     return deleted;
 }
 
+/*
+ * Level-order teardown without recursion or a queue. Leaves are already
+ * chained through next; internal nodes do not use next, so while one level
+ * is walked and freed, its children are chained the same way to form the
+ * next level. Chaining the last internal level rewrites the leaf chain with
+ * the links it already has.
+ */
 static void bptree_free_node(struct bptree_node *node) {
-    if (!node)
-        return;
-
-    if (!node->leaf) {
-        /* Free all children first */
-        for (int i = 0; i <= node->num_keys; i++)
-            bptree_free_node(node->children[i]);
+    while (node) {
+        struct bptree_node *below = node->leaf ? NULL : node->children[0];
+        struct bptree_node *tail = NULL;
+
+        while (node) {
+            struct bptree_node *next = node->next;
+
+            if (!node->leaf) {
+                for (int i = 0; i <= node->num_keys; i++) {
+                    if (tail)
+                        tail->next = node->children[i];
+                    tail = node->children[i];
+                }
+                tail->next = NULL;
+            }
+            free(node);
+            node = next;
+        }
+        node = below;
     }
-
-    /* Free this node itself */
-    free(node);
 }
 
 void bptree_free(struct bptree *tree) {
     if (!tree)
         return;
 
-    bptree_free_node(tree->root);
+    if (tree->arena) {
+        arena_destroy(tree->arena);
+        free(tree->arena);
+    } else {
+        bptree_free_node(tree->root);
+    }
     free(tree);
 }
 
@@ -530,6 +599,8 @@ void export_bptree_to_dot(struct bptree *tree, const char *filename) {
     fclose(f);
 }
 
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef BPLUS_NO_MAIN
 #define NUM_INSERTS 100
 #define NUM_REMOVES 50
 
@@ -585,8 +656,21 @@ int main(void) {
 
     export_bptree_to_dot(tree, "bptree.dot");
     printf("complete\n");
+    bptree_free(tree);
+
+    /* The same workload on arena-backed nodes */
+    tree = bptree_create_arena(BPTREE_ORDER, 0);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        bptree_insert(tree, values[i], (void *) (uintptr_t) (values[i] + 1));
+    for (int i = 0; i < NUM_REMOVES; i++)
+        assert(bptree_delete(tree, values[i]));
+    assert(bptree_verify(tree));
+    assert(bptree_verify_leaf_chain(tree));
+    for (int i = 0; i < NUM_INSERTS; i++)
+        assert(!bptree_search(tree, values[i]) == (i < NUM_REMOVES));
 
     free(values);
     bptree_free(tree);
     return 0;
 }
+#endif
@@ -0,0 +1,24 @@
+/*
+ * 128-bit identifier key shared by the generator demos (rbt_gen.c,
+ * avl_gen.c, treap_gen.c, splay_gen.c), ordered by the high word and then
+ * the low word. The comparison is written so that id128_cmp() == 0 and
+ * id128_cmp() < 0 each fold to plain compares, as rbt_gen.h asks of cmp.
+ */
+
+#ifndef ID128_H
+#define ID128_H
+
+#include <stdint.h>
+
+struct id128 {
+    uint64_t hi;
+    uint64_t lo;
+};
+
+static inline int id128_cmp(struct id128 a, struct id128 b) {
+    if (a.hi != b.hi)
+        return a.hi < b.hi ? -1 : 1;
+    return a.lo == b.lo ? 0 : a.lo < b.lo ? -1 : 1;
+}
+
+#endif
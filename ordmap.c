@@ -0,0 +1,190 @@
+/*
+ * Checks ordmap.h: the same random operations and range queries run against
+ * every backend, compared with a bitmap of the keys that should be present.
+ *
+ * Built as is, each backend in the runtime table is picked by name through
+ * the ORDMAP_BACKEND environment variable, an unknown name must end the
+ * program, and main() ends by timing lookups through the table against
+ * direct calls. Built with
+ * -DORDMAP_BACKEND=<name>, only that backend is compiled in and checked.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "ordmap.h"
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+/* Keys are drawn from [-KEY_RANGE, KEY_RANGE), so the sign bit is exercised */
+#define KEY_RANGE (NUM_INSERTS * 2)
+#define NUM_RANGES 64
+
+struct collect {
+    int *keys;
+    size_t count;
+    size_t limit;
+};
+
+static bool collect_key(int key, void *arg) {
+    struct collect *c = arg;
+    c->keys[c->count++] = key;
+    return c->count < c->limit;
+}
+
+/* The keys in [lo, hi] and at most limit of them, in order, as the bitmap has them */
+static void check_range(struct ordmap *m, const bool *present, int lo, int hi, size_t limit) {
+    struct collect c = {malloc(2 * KEY_RANGE * sizeof(int)), 0, limit};
+    size_t visited = ordmap_range(m, lo, hi, collect_key, &c);
+    size_t expected = 0;
+
+    assert(visited == c.count);
+    for (int k = lo; k <= hi && expected < limit; k++) {
+        if (present[k + KEY_RANGE])
+            assert(expected < c.count && c.keys[expected++] == k);
+    }
+    assert(expected == c.count);
+    free(c.keys);
+}
+
+static void check_map(struct ordmap *m) {
+    bool *present = calloc(2 * KEY_RANGE, sizeof(bool));
+    size_t size = 0;
+
+    for (int i = 0; i < NUM_INSERTS * 20; i++) {
+        int key = rand() % (2 * KEY_RANGE) - KEY_RANGE;
+        bool *p = &present[key + KEY_RANGE];
+
+        switch (rand() % 3) {
+        case 0:
+            assert(ordmap_insert(m, key) == !*p);
+            size += !*p;
+            *p = true;
+            break;
+        case 1:
+            assert(ordmap_delete(m, key) == *p);
+            size -= *p;
+            *p = false;
+            break;
+        default:
+            assert(ordmap_lookup(m, key) == *p);
+        }
+        assert(ordmap_size(m) == size);
+    }
+
+    check_range(m, present, -KEY_RANGE, KEY_RANGE - 1, SIZE_MAX);
+    for (int i = 0; i < NUM_RANGES; i++) {
+        int lo = rand() % (2 * KEY_RANGE) - KEY_RANGE;
+        int hi = lo + rand() % (KEY_RANGE / 2);
+        check_range(m, present, lo, hi < KEY_RANGE ? hi : KEY_RANGE - 1, 1 + rand() % 8);
+        check_range(m, present, lo, hi < KEY_RANGE ? hi : KEY_RANGE - 1, SIZE_MAX);
+    }
+    assert(ordmap_range(m, 1, 0, collect_key, NULL) == 0);
+
+    /* The extremes of int map to the ends of the unsigned key space */
+    assert(ordmap_insert(m, INT_MIN) && ordmap_insert(m, INT_MAX));
+    struct collect c = {malloc((size + 2) * sizeof(int)), 0, SIZE_MAX};
+    assert(ordmap_range(m, INT_MIN, INT_MAX, collect_key, &c) == size + 2);
+    assert(c.keys[0] == INT_MIN && c.keys[size + 1] == INT_MAX);
+    assert(ordmap_delete(m, INT_MIN) && ordmap_delete(m, INT_MAX));
+    free(c.keys);
+
+    for (int k = -KEY_RANGE; k < KEY_RANGE; k++)
+        assert(ordmap_delete(m, k) == present[k + KEY_RANGE]);
+    assert(ordmap_size(m) == 0 && ordmap_range(m, INT_MIN, INT_MAX, collect_key, NULL) == 0);
+    free(present);
+}
+
+#ifndef ORDMAP_BACKEND
+/* Unset, ORDMAP_BACKEND means rbt; a name that is no backend ends the program */
+static void check_unknown_backend(void) {
+    struct ordmap m;
+    unsetenv("ORDMAP_BACKEND");
+    ordmap_init(&m);
+    assert(m.ops == &ordmap_rbt_ops);
+    ordmap_destroy(&m);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        setenv("ORDMAP_BACKEND", "btree", 1);
+        ordmap_init(&m);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE);
+}
+
+#ifndef BENCH_DISPATCH_KEYS
+#define BENCH_DISPATCH_KEYS (1 << 20)
+#endif
+
+/* Lookups in the same red-black tree map, direct and through the table */
+static void benchmark_dispatch(void) {
+    struct ordmap m;
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    long found = 0;
+
+    ordmap_init_backend(&m, &ordmap_rbt_ops);
+    for (int i = 0; i < BENCH_DISPATCH_KEYS; i++)
+        ordmap_insert(&m, (int) xorshift64(&rng));
+
+    rng = 0x9e3779b97f4a7c15ULL;
+    double start = now_ns();
+    for (int i = 0; i < BENCH_DISPATCH_KEYS; i++)
+        found += ordmap_rbt_lookup(m.impl, (int) xorshift64(&rng));
+    double direct = now_ns() - start;
+
+    rng = 0x9e3779b97f4a7c15ULL;
+    start = now_ns();
+    for (int i = 0; i < BENCH_DISPATCH_KEYS; i++)
+        found -= ordmap_lookup(&m, (int) xorshift64(&rng));
+    double table = now_ns() - start;
+
+    assert(found == 0);
+    printf("    %d keys, ns per lookup: direct %.1f, through the table %.1f\n", BENCH_DISPATCH_KEYS,
+           direct / BENCH_DISPATCH_KEYS, table / BENCH_DISPATCH_KEYS);
+    ordmap_destroy(&m);
+}
+#endif
+
+int main() {
+    printf("Ordered map interface... ");
+    fflush(stdout);
+    srand((unsigned) time(NULL));
+
+#ifdef ORDMAP_BACKEND
+    struct ordmap m;
+    ordmap_init(&m);
+    check_map(&m);
+    ordmap_destroy(&m);
+    printf("complete\n");
+#else
+    /* Each backend is picked by name through the environment, as a user would pick it */
+    for (size_t i = 0; i < ORDMAP_NUM_BACKENDS; i++) {
+        struct ordmap m;
+        setenv("ORDMAP_BACKEND", ordmap_backends[i]->name, 1);
+        ordmap_init(&m);
+        assert(m.ops == ordmap_backends[i]);
+        check_map(&m);
+        ordmap_destroy(&m);
+    }
+    check_unknown_backend();
+    printf("complete\n");
+    benchmark_dispatch();
+#endif
+    return 0;
+}
@@ -0,0 +1,525 @@
+/*
+ * One ordered-map interface over the six trees, so that call sites do not
+ * change when the backend does.
+ *
+ *     ordmap_init(m)                   empty map
+ *     ordmap_insert(m, key)            true if key was added
+ *     ordmap_lookup(m, key)            true if key is present
+ *     ordmap_delete(m, key)            true if key was removed
+ *     ordmap_range(m, lo, hi, fn, arg) call fn(key, arg) for the keys in
+ *                                      [lo, hi] in ascending order, until fn
+ *                                      returns false; the number of calls
+ *     ordmap_size(m)                   number of keys
+ *     ordmap_destroy(m)                free every key
+ *
+ * Keys are ints. The trees hold bare keys, so a map records presence only;
+ * the B+ tree's value slot is unused. The treap, splay tree and radix tree
+ * take unsigned 64-bit keys and see key ^ INT_MIN, which keeps the order.
+ *
+ * Static dispatch: define ORDMAP_BACKEND as one of rbt, avl, treap, splay,
+ * bplus or radix before including this file. Only that tree is compiled in,
+ * struct ordmap is its map, and every ordmap_ call is a direct call to a
+ * static inline function.
+ *
+ * Runtime dispatch: leave ORDMAP_BACKEND undefined. All six trees are
+ * compiled in, struct ordmap holds a table of function pointers, and
+ * ordmap_init() picks the backend named by the ORDMAP_BACKEND environment
+ * variable, or the red-black tree when it is unset, and exits listing the
+ * valid names when it names none of them. ordmap_init_backend() picks one
+ * from ordmap_backends[] directly.
+ */
+
+#ifndef ORDMAP_H
+#define ORDMAP_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ORDMAP_ID_rbt 1
+#define ORDMAP_ID_avl 2
+#define ORDMAP_ID_treap 3
+#define ORDMAP_ID_splay 4
+#define ORDMAP_ID_bplus 5
+#define ORDMAP_ID_radix 6
+
+#define ORDMAP_CAT_(a, b) a##b
+#define ORDMAP_CAT(a, b) ORDMAP_CAT_(a, b)
+
+#ifdef ORDMAP_BACKEND
+#define ORDMAP_WANT(name) (ORDMAP_CAT(ORDMAP_ID_, ORDMAP_BACKEND) == ORDMAP_ID_##name)
+#if !ORDMAP_CAT(ORDMAP_ID_, ORDMAP_BACKEND)
+#error "ORDMAP_BACKEND must be one of rbt, avl, treap, splay, bplus, radix"
+#endif
+#else
+#define ORDMAP_WANT(name) 1
+#endif
+
+typedef bool (*ordmap_visit_fn)(int key, void *arg);
+
+/* Order-preserving map from int keys to the unsigned keys of some trees */
+static inline uint64_t ordmap_ukey(int key) {
+    return (uint32_t) key ^ 0x80000000u;
+}
+
+static inline int ordmap_ikey(uint64_t ukey) {
+    return (int) ((uint32_t) ukey ^ 0x80000000u);
+}
+
+/*
+ * Red-black and AVL trees keep duplicates, so insert looks the key up first;
+ * the second descent runs over the path the first one just brought into
+ * cache.
+ */
+#if ORDMAP_WANT(rbt)
+#define RBT_NO_MAIN
+#include "rbt.c"
+
+struct ordmap_rbt {
+    struct red_black_tree *tree;
+    size_t size;
+};
+
+static inline void ordmap_rbt_init(struct ordmap_rbt *m) {
+    m->tree = red_black_tree_create();
+    m->size = 0;
+}
+
+static inline void ordmap_rbt_destroy(struct ordmap_rbt *m) {
+    red_black_tree_destroy(m->tree);
+}
+
+static inline bool ordmap_rbt_insert(struct ordmap_rbt *m, int key) {
+    if (tree_search(m->tree->root, key))
+        return false;
+    red_black_tree_insert(m->tree, key);
+    m->size++;
+    return true;
+}
+
+static inline bool ordmap_rbt_lookup(struct ordmap_rbt *m, int key) {
+    return tree_search(m->tree->root, key) != NULL;
+}
+
+static inline bool ordmap_rbt_delete(struct ordmap_rbt *m, int key) {
+    struct red_black_tree_node *node = tree_search(m->tree->root, key);
+    if (!node)
+        return false;
+    rb_delete(m->tree, node);
+    m->size--;
+    return true;
+}
+
+static inline size_t ordmap_rbt_range(struct ordmap_rbt *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    size_t count = 0;
+    for (struct red_black_tree_node *n = red_black_tree_lower_bound(m->tree, lo); n && n->data <= hi;
+         n = red_black_tree_next(n)) {
+        count++;
+        if (!fn(n->data, arg))
+            break;
+    }
+    return count;
+}
+
+static inline size_t ordmap_rbt_size(struct ordmap_rbt *m) {
+    return m->size;
+}
+#endif
+
+#if ORDMAP_WANT(avl)
+#define AVL_NO_MAIN
+#include "avl.c"
+
+struct ordmap_avl {
+    struct avl_tree tree;
+    size_t size;
+};
+
+static inline void ordmap_avl_init(struct ordmap_avl *m) {
+    *m = (struct ordmap_avl){0};
+}
+
+static inline void ordmap_avl_destroy(struct ordmap_avl *m) {
+    avl_tree_clear(&m->tree);
+}
+
+static inline bool ordmap_avl_insert(struct ordmap_avl *m, int key) {
+    if (avl_tree_search(&m->tree, key))
+        return false;
+    avl_tree_insert(&m->tree, key);
+    m->size++;
+    return true;
+}
+
+static inline bool ordmap_avl_lookup(struct ordmap_avl *m, int key) {
+    return avl_tree_search(&m->tree, key) != NULL;
+}
+
+static inline bool ordmap_avl_delete(struct ordmap_avl *m, int key) {
+    struct avl_tree_node *node = avl_tree_search(&m->tree, key);
+    if (!node)
+        return false;
+    remove_node(&m->tree, node);
+    m->size--;
+    return true;
+}
+
+static inline size_t ordmap_avl_range(struct ordmap_avl *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    size_t count = 0;
+    for (struct avl_tree_node *n = avl_tree_lower_bound(&m->tree, lo); n && n->data <= hi; n = avl_tree_next(n)) {
+        count++;
+        if (!fn(n->data, arg))
+            break;
+    }
+    return count;
+}
+
+static inline size_t ordmap_avl_size(struct ordmap_avl *m) {
+    return m->size;
+}
+#endif
+
+#if ORDMAP_WANT(treap)
+#define TREAP_NO_MAIN
+#include "treap.c"
+
+struct ordmap_treap {
+    struct treap tree;
+    size_t size;
+};
+
+static inline void ordmap_treap_init(struct ordmap_treap *m) {
+    treap_init(&m->tree, 0x9e3779b97f4a7c15ULL, false);
+    m->size = 0;
+}
+
+static inline void ordmap_treap_destroy(struct ordmap_treap *m) {
+    treap_free(&m->tree);
+}
+
+static inline bool ordmap_treap_insert(struct ordmap_treap *m, int key) {
+    if (!treap_insert(&m->tree, ordmap_ukey(key)))
+        return false;
+    m->size++;
+    return true;
+}
+
+static inline bool ordmap_treap_lookup(struct ordmap_treap *m, int key) {
+    return treap_lookup(&m->tree, ordmap_ukey(key)) != NULL;
+}
+
+static inline bool ordmap_treap_delete(struct ordmap_treap *m, int key) {
+    if (!treap_delete(&m->tree, ordmap_ukey(key)))
+        return false;
+    m->size--;
+    return true;
+}
+
+struct ordmap_treap_visit {
+    ordmap_visit_fn fn;
+    void *arg;
+};
+
+static inline bool ordmap_treap_visit_node(struct treap_node *n, void *ctx) {
+    struct ordmap_treap_visit *v = ctx;
+    return v->fn(ordmap_ikey(n->key), v->arg);
+}
+
+static inline size_t ordmap_treap_range(struct ordmap_treap *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    struct ordmap_treap_visit v = {fn, arg};
+    return treap_range(&m->tree, ordmap_ukey(lo), ordmap_ukey(hi), ordmap_treap_visit_node, &v);
+}
+
+static inline size_t ordmap_treap_size(struct ordmap_treap *m) {
+    return m->size;
+}
+#endif
+
+/* Lookups splay, as in splay_search; range walks do not */
+#if ORDMAP_WANT(splay)
+#define SPLAY_NO_MAIN
+#include "splay.c"
+
+struct ordmap_splay {
+    struct splay_tree tree;
+};
+
+static inline void ordmap_splay_init(struct ordmap_splay *m) {
+    *m = (struct ordmap_splay){0};
+}
+
+static inline void ordmap_splay_destroy(struct ordmap_splay *m) {
+    splay_tree_clear(&m->tree);
+}
+
+static inline bool ordmap_splay_insert(struct ordmap_splay *m, int key) {
+    size_t size = m->tree.size;
+    splay_insert(&m->tree, ordmap_ukey(key));
+    return m->tree.size != size;
+}
+
+static inline bool ordmap_splay_lookup(struct ordmap_splay *m, int key) {
+    return splay_search(&m->tree, ordmap_ukey(key)) != NULL;
+}
+
+static inline bool ordmap_splay_delete(struct ordmap_splay *m, int key) {
+    size_t size = m->tree.size;
+    splay_delete(&m->tree, ordmap_ukey(key));
+    return m->tree.size != size;
+}
+
+static inline size_t ordmap_splay_range(struct ordmap_splay *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    size_t count = 0;
+    for (struct splay_node *n = splay_lower_bound(&m->tree, ordmap_ukey(lo)); n && n->key <= ordmap_ukey(hi);
+         n = splay_next(&m->tree, n)) {
+        count++;
+        if (!fn(ordmap_ikey(n->key), arg))
+            break;
+    }
+    return count;
+}
+
+static inline size_t ordmap_splay_size(struct ordmap_splay *m) {
+    return m->tree.size;
+}
+#endif
+
+#if ORDMAP_WANT(bplus)
+#define BPLUS_NO_MAIN
+#include "bplus.c"
+
+struct ordmap_bplus {
+    struct bptree *tree;
+    size_t size;
+};
+
+static inline void ordmap_bplus_init(struct ordmap_bplus *m) {
+    m->tree = bptree_create(BPTREE_ORDER);
+    m->size = 0;
+}
+
+static inline void ordmap_bplus_destroy(struct ordmap_bplus *m) {
+    bptree_free(m->tree);
+}
+
+/* bptree_search() returns the value, so present keys store a non-NULL one */
+static inline bool ordmap_bplus_insert(struct ordmap_bplus *m, int key) {
+    if (bptree_search(m->tree, key))
+        return false;
+    bptree_insert(m->tree, key, m);
+    m->size++;
+    return true;
+}
+
+static inline bool ordmap_bplus_lookup(struct ordmap_bplus *m, int key) {
+    return bptree_search(m->tree, key) != NULL;
+}
+
+static inline bool ordmap_bplus_delete(struct ordmap_bplus *m, int key) {
+    if (!bptree_delete(m->tree, key))
+        return false;
+    m->size--;
+    return true;
+}
+
+static inline size_t ordmap_bplus_range(struct ordmap_bplus *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    size_t count = 0;
+    int i;
+
+    for (struct bptree_node *leaf = bptree_lower_bound(m->tree, lo, &i); leaf; leaf = leaf->next, i = 0) {
+        for (; i < leaf->num_keys; i++) {
+            if (leaf->keys[i] > hi)
+                return count;
+            count++;
+            if (!fn(leaf->keys[i], arg))
+                return count;
+        }
+    }
+    return count;
+}
+
+static inline size_t ordmap_bplus_size(struct ordmap_bplus *m) {
+    return m->size;
+}
+#endif
+
+/* Six levels of RADIX_BITS cover the 32-bit keys */
+#if ORDMAP_WANT(radix)
+#define RADIX_NO_MAIN
+#include "radix.c"
+
+#define ORDMAP_RADIX_HEIGHT ((32 + RADIX_BITS - 1) / RADIX_BITS)
+
+struct ordmap_radix {
+    struct radix_tree tree;
+    size_t size;
+};
+
+static inline void ordmap_radix_init(struct ordmap_radix *m) {
+    m->tree = (struct radix_tree){.height = ORDMAP_RADIX_HEIGHT};
+    m->size = 0;
+}
+
+static inline void ordmap_radix_destroy(struct ordmap_radix *m) {
+    radix_free_tree(&m->tree);
+}
+
+static inline bool ordmap_radix_insert(struct ordmap_radix *m, int key) {
+    if (radix_lookup(&m->tree, ordmap_ukey(key)))
+        return false;
+    radix_insert(&m->tree, ordmap_ukey(key), radix_create_node(ordmap_ukey(key)));
+    m->size++;
+    return true;
+}
+
+static inline bool ordmap_radix_lookup(struct ordmap_radix *m, int key) {
+    return radix_lookup(&m->tree, ordmap_ukey(key)) != NULL;
+}
+
+static inline bool ordmap_radix_delete(struct ordmap_radix *m, int key) {
+    if (radix_delete(&m->tree, ordmap_ukey(key)) != 0)
+        return false;
+    m->size--;
+    return true;
+}
+
+/* Leaves keep their whole key in key_part */
+static inline size_t ordmap_radix_range(struct ordmap_radix *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    size_t count = 0;
+    for (struct radix_node *n = radix_lower_bound(&m->tree, ordmap_ukey(lo)); n && n->key_part <= ordmap_ukey(hi);
+         n = radix_next(n)) {
+        count++;
+        if (!fn(ordmap_ikey(n->key_part), arg))
+            break;
+    }
+    return count;
+}
+
+static inline size_t ordmap_radix_size(struct ordmap_radix *m) {
+    return m->size;
+}
+#endif
+
+#ifdef ORDMAP_BACKEND
+
+#define ORDMAP_FN(op) ORDMAP_CAT(ORDMAP_CAT(ordmap_, ORDMAP_BACKEND), _##op)
+
+#define ordmap ORDMAP_CAT(ordmap_, ORDMAP_BACKEND)
+#define ordmap_init ORDMAP_FN(init)
+#define ordmap_destroy ORDMAP_FN(destroy)
+#define ordmap_insert ORDMAP_FN(insert)
+#define ordmap_lookup ORDMAP_FN(lookup)
+#define ordmap_delete ORDMAP_FN(delete)
+#define ordmap_range ORDMAP_FN(range)
+#define ordmap_size ORDMAP_FN(size)
+
+#else
+
+struct ordmap_ops {
+    const char *name;
+    size_t map_size; /* bytes for the backend's struct ordmap_<name> */
+    void (*init)(void *m);
+    void (*destroy)(void *m);
+    bool (*insert)(void *m, int key);
+    bool (*lookup)(void *m, int key);
+    bool (*delete)(void *m, int key);
+    size_t (*range)(void *m, int lo, int hi, ordmap_visit_fn fn, void *arg);
+    size_t (*size)(void *m);
+};
+
+/* void * wrappers around one backend's functions, and its table */
+#define ORDMAP_OPS(name)                                                                              \
+    static void ordmap_##name##_init_op(void *m) { ordmap_##name##_init(m); }                        \
+    static void ordmap_##name##_destroy_op(void *m) { ordmap_##name##_destroy(m); }                  \
+    static bool ordmap_##name##_insert_op(void *m, int key) { return ordmap_##name##_insert(m, key); } \
+    static bool ordmap_##name##_lookup_op(void *m, int key) { return ordmap_##name##_lookup(m, key); } \
+    static bool ordmap_##name##_delete_op(void *m, int key) { return ordmap_##name##_delete(m, key); } \
+    static size_t ordmap_##name##_range_op(void *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {  \
+        return ordmap_##name##_range(m, lo, hi, fn, arg);                                             \
+    }                                                                                                 \
+    static size_t ordmap_##name##_size_op(void *m) { return ordmap_##name##_size(m); }               \
+    static const struct ordmap_ops ordmap_##name##_ops = {                                            \
+        #name, sizeof(struct ordmap_##name), ordmap_##name##_init_op, ordmap_##name##_destroy_op,     \
+        ordmap_##name##_insert_op, ordmap_##name##_lookup_op, ordmap_##name##_delete_op,              \
+        ordmap_##name##_range_op, ordmap_##name##_size_op,                                            \
+    };
+
+ORDMAP_OPS(rbt)
+ORDMAP_OPS(avl)
+ORDMAP_OPS(treap)
+ORDMAP_OPS(splay)
+ORDMAP_OPS(bplus)
+ORDMAP_OPS(radix)
+
+static const struct ordmap_ops *const ordmap_backends[] = {
+    &ordmap_rbt_ops, &ordmap_avl_ops, &ordmap_treap_ops, &ordmap_splay_ops, &ordmap_bplus_ops, &ordmap_radix_ops,
+};
+
+#define ORDMAP_NUM_BACKENDS (sizeof(ordmap_backends) / sizeof(ordmap_backends[0]))
+
+struct ordmap {
+    const struct ordmap_ops *ops;
+    void *impl;
+};
+
+/* The backend called name, or NULL */
+static inline const struct ordmap_ops *ordmap_find_backend(const char *name) {
+    for (size_t i = 0; i < ORDMAP_NUM_BACKENDS; i++)
+        if (!strcmp(ordmap_backends[i]->name, name))
+            return ordmap_backends[i];
+    return NULL;
+}
+
+static inline void ordmap_init_backend(struct ordmap *m, const struct ordmap_ops *ops) {
+    m->ops = ops;
+    m->impl = malloc(ops->map_size);
+    ops->init(m->impl);
+}
+
+/* A misspelt backend would otherwise quietly benchmark the wrong tree, so it is fatal */
+static inline void ordmap_init(struct ordmap *m) {
+    const char *name = getenv("ORDMAP_BACKEND");
+    const struct ordmap_ops *ops = name ? ordmap_find_backend(name) : &ordmap_rbt_ops;
+
+    if (!ops) {
+        fprintf(stderr, "ordmap: unknown ORDMAP_BACKEND \"%s\", expected one of", name);
+        for (size_t i = 0; i < ORDMAP_NUM_BACKENDS; i++)
+            fprintf(stderr, "%s %s", i ? "," : "", ordmap_backends[i]->name);
+        fprintf(stderr, "\n");
+        exit(EXIT_FAILURE);
+    }
+    ordmap_init_backend(m, ops);
+}
+
+static inline void ordmap_destroy(struct ordmap *m) {
+    m->ops->destroy(m->impl);
+    free(m->impl);
+}
+
+static inline bool ordmap_insert(struct ordmap *m, int key) {
+    return m->ops->insert(m->impl, key);
+}
+
+static inline bool ordmap_lookup(struct ordmap *m, int key) {
+    return m->ops->lookup(m->impl, key);
+}
+
+static inline bool ordmap_delete(struct ordmap *m, int key) {
+    return m->ops->delete(m->impl, key);
+}
+
+static inline size_t ordmap_range(struct ordmap *m, int lo, int hi, ordmap_visit_fn fn, void *arg) {
+    return m->ops->range(m->impl, lo, hi, fn, arg);
+}
+
+static inline size_t ordmap_size(struct ordmap *m) {
+    return m->ops->size(m->impl);
+}
+
+#endif
+
+#endif
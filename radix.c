@@ -10,9 +10,6 @@
 #define RADIX_SIZE (1 << RADIX_BITS)
 #define RADIX_MASK (RADIX_SIZE - 1)
 
-#define NUM_INSERTS 128
-#define NUM_LOOKUPS 32
-
 struct radix_node {
     struct radix_node *parent;
     struct radix_node *slots[RADIX_SIZE];
@@ -185,20 +182,88 @@ int32_t radix_delete(struct radix_tree *tree, uint64_t key) {
     return 0;
 }
 
-static void export_radix_dot(FILE *fp, struct radix_node *node, int level) {
+/* A node's slot in its parent: key_part is the slot index, or the whole key for leaves */
+static inline uint64_t radix_slot(const struct radix_node *node) {
+    return node->key_part & RADIX_MASK;
+}
+
+/* First occupied slot of node at or after from, or RADIX_SIZE */
+static inline int radix_next_slot(const struct radix_node *node, int from) {
+    uint64_t mask = from < RADIX_SIZE ? node->present_mask >> from << from : 0;
+    return mask ? __builtin_ctzll(mask) : RADIX_SIZE;
+}
+
+/* Leftmost leaf below node, which sits levels above the leaves */
+static struct radix_node *radix_first_leaf(struct radix_node *node, uint32_t levels) {
+    while (levels--)
+        node = node->slots[__builtin_ctzll(node->present_mask)];
+    return node;
+}
+
+/* Leftmost leaf of the first subtree to the right of node, which sits levels above the leaves */
+static struct radix_node *radix_next_subtree(struct radix_node *node, uint32_t levels) {
+    for (; node->parent; node = node->parent, levels++) {
+        int slot = radix_next_slot(node->parent, radix_slot(node) + 1);
+        if (slot < RADIX_SIZE)
+            return radix_first_leaf(node->parent->slots[slot], levels);
+    }
+    return NULL;
+}
+
+/* Leaf after leaf in key order, or NULL */
+struct radix_node *radix_next(struct radix_node *leaf) {
+    return radix_next_subtree(leaf, 0);
+}
+
+/* Leaf with the smallest key >= key, or NULL */
+struct radix_node *radix_lower_bound(struct radix_tree *tree, uint64_t key) {
+    struct radix_node *node = tree->root;
+
     if (!node)
-        return;
+        return NULL;
+    for (uint32_t level = tree->height; level > 0; level--) {
+        int idx = radix_index(key, level - 1);
+        if (node->slots[idx]) {
+            node = node->slots[idx];
+            continue;
+        }
+        int slot = radix_next_slot(node, idx + 1);
+        if (slot < RADIX_SIZE)
+            return radix_first_leaf(node->slots[slot], level - 1);
+        return radix_next_subtree(node, level);
+    }
+    return node;
+}
 
+static void export_radix_dot_node(FILE *fp, struct radix_node *node, int level) {
     fprintf(fp,
             "    \"%p\" [label=\"%llu (L%d)\", shape=box, style=filled, fillcolor=\"#808080\", fontcolor=\"white\"];\n",
             (void *) node, node->key_part, level);
+}
 
-    for (int i = 0; i < RADIX_SIZE; i++) {
-        struct radix_node *child = node->slots[i];
-        if (child) {
+/* Depth-first walk that climbs by parent pointers and resumes at the next slot */
+static void export_radix_dot(FILE *fp, struct radix_node *root) {
+    struct radix_node *node = root;
+    int level = 0;
+    int from = 0;
+
+    export_radix_dot_node(fp, root, 0);
+    for (;;) {
+        int i = radix_next_slot(node, from);
+
+        if (i < RADIX_SIZE) {
+            struct radix_node *child = node->slots[i];
             fprintf(fp, "    \"%p\" -> \"%p\" [label=\"%d\"];\n",
                     (void *) node, (void *) child, i);
-            export_radix_dot(fp, child, level + 1);
+            node = child;
+            export_radix_dot_node(fp, node, ++level);
+            from = 0;
+        } else if (node == root) {
+            break;
+        } else {
+            from = radix_slot(node) + 1;
+            node = node->parent;
+            level--;
         }
     }
 }
@@ -214,7 +279,7 @@ void export_radix_tree_to_dot(struct radix_tree *tree, const char *filename) {
     fprintf(fp, "    node [fontname=Arial];\n");
 
     if (tree->root)
-        export_radix_dot(fp, tree->root, 0);
+        export_radix_dot(fp, tree->root);
 
     fprintf(fp, "}\n");
     fclose(fp);
@@ -226,16 +291,26 @@ struct radix_node *radix_create_node(uint64_t key_part) {
     return node;
 }
 
+/*
+ * Free the subtree at node without recursion: descend into the first
+ * occupied slot, and free a node once it has none left, clearing its bit in
+ * the parent on the way back up.
+ */
 static void radix_free_node(struct radix_node *node) {
-    if (!node)
-        return;
+    struct radix_node *top = node;
 
-    /* Recursively free all children */
-    for (int i = 0; i < RADIX_SIZE; i++)
-        if (node->slots[i])
-            radix_free_node(node->slots[i]);
+    while (node) {
+        if (node->present_mask) {
+            node = node->slots[__builtin_ctzll(node->present_mask)];
+            continue;
+        }
 
-    free(node);
+        struct radix_node *parent = node == top ? NULL : node->parent;
+        if (parent)
+            parent->present_mask &= ~(1ULL << radix_slot(node));
+        free(node);
+        node = parent;
+    }
 }
 
 void radix_free_tree(struct radix_tree *tree) {
@@ -249,6 +324,11 @@ void radix_free_tree(struct radix_tree *tree) {
     tree->height = 0;
 }
 
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef RADIX_NO_MAIN
+#define NUM_INSERTS 128
+#define NUM_LOOKUPS 32
+
 int main(void) {
     printf("Radix tree ... ");
     fflush(stdout);
@@ -304,3 +384,4 @@ int main(void) {
     free(keys);
     return 0;
 }
+#endif
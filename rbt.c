@@ -4,6 +4,12 @@
 #include <stdlib.h>
 #include <time.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "arena.h"
+
 enum red_black_tree_node_color { TREE_NODE_RED,
                                  TREE_NODE_BLACK };
 
@@ -17,14 +23,50 @@ struct red_black_tree_node {
 
 struct red_black_tree {
     struct red_black_tree_node *root;
+    struct red_black_tree_node *leftmost;  /* cached minimum */
+    struct red_black_tree_node *rightmost; /* cached maximum */
+    struct red_black_tree_node *block;     /* bulk-built nodes, freed as one */
+    size_t block_size;
+    struct arena *arena; /* node storage, or NULL to use malloc */
 };
 
 struct red_black_tree *red_black_tree_create(void) {
     struct red_black_tree *tree = (struct red_black_tree *) malloc(sizeof(struct red_black_tree));
     tree->root = NULL;
+    tree->leftmost = NULL;
+    tree->rightmost = NULL;
+    tree->block = NULL;
+    tree->block_size = 0;
+    tree->arena = NULL;
+    return tree;
+}
+
+/* A tree whose nodes come from a private arena; see arena.h for the flags */
+struct red_black_tree *red_black_tree_create_arena(unsigned arena_flags) {
+    struct red_black_tree *tree = red_black_tree_create();
+    tree->arena = malloc(sizeof(struct arena));
+    arena_init(tree->arena, arena_flags);
     return tree;
 }
 
+static inline struct red_black_tree_node *red_black_tree_alloc_node(struct red_black_tree *tree) {
+    if (tree->arena)
+        return arena_alloc(tree->arena, sizeof(struct red_black_tree_node));
+    return malloc(sizeof(struct red_black_tree_node));
+}
+
+/* Nodes from red_black_tree_build_sorted share one allocation */
+static inline void red_black_tree_free_node(struct red_black_tree *tree, struct red_black_tree_node *node) {
+    uintptr_t addr = (uintptr_t) node;
+    uintptr_t start = (uintptr_t) tree->block;
+    if (addr >= start && addr < start + tree->block_size * sizeof(struct red_black_tree_node))
+        return;
+    if (tree->arena)
+        arena_free(tree->arena, node, sizeof(struct red_black_tree_node));
+    else
+        free(node);
+}
+
 struct red_black_tree_node *tree_find_min(struct red_black_tree_node *node) {
     while (node->left != NULL) {
         node = node->left;
@@ -32,6 +74,13 @@ struct red_black_tree_node *tree_find_min(struct red_black_tree_node *node) {
     return node;
 }
 
+struct red_black_tree_node *tree_find_max(struct red_black_tree_node *node) {
+    while (node->right != NULL) {
+        node = node->right;
+    }
+    return node;
+}
+
 void rb_transplant(struct red_black_tree *tree, struct red_black_tree_node *u, struct red_black_tree_node *v) {
     if (u->parent == NULL)
         tree->root = v;
@@ -81,83 +130,75 @@ void right_rotate(struct red_black_tree *tree, struct red_black_tree_node *y) {
     y->parent = x;
 }
 
-void fix_deletion(struct red_black_tree *tree, struct red_black_tree_node *x) {
-    while (x != tree->root && (!x || x->color == TREE_NODE_BLACK)) {
-        if (!x || !x->parent)
-            break;
+static inline int is_red(struct red_black_tree_node *node) {
+    return node && node->color == TREE_NODE_RED;
+}
 
+/*
+ * x may be NULL (a black leaf), so its parent is passed in explicitly
+ * instead of being read back through x.
+ */
+void fix_deletion(struct red_black_tree *tree, struct red_black_tree_node *x,
+                  struct red_black_tree_node *parent) {
+    while (x != tree->root && !is_red(x)) {
         struct red_black_tree_node *sibling;
 
-        if (x == x->parent->left) {
-            sibling = x->parent->right;
+        if (x == parent->left) {
+            sibling = parent->right;
 
-            if (sibling && sibling->color == TREE_NODE_RED) {
+            if (is_red(sibling)) {
                 sibling->color = TREE_NODE_BLACK;
-                x->parent->color = TREE_NODE_RED;
-                left_rotate(tree, x->parent);
-                sibling = x->parent->right;
+                parent->color = TREE_NODE_RED;
+                left_rotate(tree, parent);
+                sibling = parent->right;
             }
 
-            if (!sibling ||
-                ((!sibling->left || sibling->left->color == TREE_NODE_BLACK) &&
-                 (!sibling->right || sibling->right->color == TREE_NODE_BLACK))) {
-                if (sibling)
-                    sibling->color = TREE_NODE_RED;
-                x = x->parent;
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
             } else {
-                if (!sibling->right || sibling->right->color == TREE_NODE_BLACK) {
-                    if (sibling->left)
-                        sibling->left->color = TREE_NODE_BLACK;
-                    if (sibling) {
-                        sibling->color = TREE_NODE_RED;
-                        right_rotate(tree, sibling);
-                        sibling = x->parent->right;
-                    }
+                if (!is_red(sibling->right)) {
+                    sibling->left->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    right_rotate(tree, sibling);
+                    sibling = parent->right;
                 }
 
-                if (sibling) {
-                    sibling->color = x->parent->color;
-                    x->parent->color = TREE_NODE_BLACK;
-                    if (sibling->right)
-                        sibling->right->color = TREE_NODE_BLACK;
-                    left_rotate(tree, x->parent);
-                }
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->right)
+                    sibling->right->color = TREE_NODE_BLACK;
+                left_rotate(tree, parent);
                 x = tree->root;
             }
         } else {
-            sibling = x->parent->left;
+            sibling = parent->left;
 
-            if (sibling && sibling->color == TREE_NODE_RED) {
+            if (is_red(sibling)) {
                 sibling->color = TREE_NODE_BLACK;
-                x->parent->color = TREE_NODE_RED;
-                right_rotate(tree, x->parent);
-                sibling = x->parent->left;
+                parent->color = TREE_NODE_RED;
+                right_rotate(tree, parent);
+                sibling = parent->left;
             }
 
-            if (!sibling ||
-                ((!sibling->left || sibling->left->color == TREE_NODE_BLACK) &&
-                 (!sibling->right || sibling->right->color == TREE_NODE_BLACK))) {
-                if (sibling)
-                    sibling->color = TREE_NODE_RED;
-                x = x->parent;
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
             } else {
-                if (!sibling->left || sibling->left->color == TREE_NODE_BLACK) {
-                    if (sibling->right)
-                        sibling->right->color = TREE_NODE_BLACK;
-                    if (sibling) {
-                        sibling->color = TREE_NODE_RED;
-                        left_rotate(tree, sibling);
-                        sibling = x->parent->left;
-                    }
+                if (!is_red(sibling->left)) {
+                    sibling->right->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    left_rotate(tree, sibling);
+                    sibling = parent->left;
                 }
 
-                if (sibling) {
-                    sibling->color = x->parent->color;
-                    x->parent->color = TREE_NODE_BLACK;
-                    if (sibling->left)
-                        sibling->left->color = TREE_NODE_BLACK;
-                    right_rotate(tree, x->parent);
-                }
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->left)
+                    sibling->left->color = TREE_NODE_BLACK;
+                right_rotate(tree, parent);
                 x = tree->root;
             }
         }
@@ -202,13 +243,25 @@ int validate_rbtree(struct red_black_tree_node *node, int *black_height) {
 void rb_delete(struct red_black_tree *tree, struct red_black_tree_node *z) {
     struct red_black_tree_node *y = z;
     struct red_black_tree_node *x = NULL;
+    struct red_black_tree_node *x_parent = NULL;
     enum red_black_tree_node_color y_original_color = y->color;
 
+    /*
+     * The leftmost node has no left child, so its successor is either the
+     * minimum of its right subtree or its parent; rightmost mirrors that.
+     */
+    if (z == tree->leftmost)
+        tree->leftmost = z->right ? tree_find_min(z->right) : z->parent;
+    if (z == tree->rightmost)
+        tree->rightmost = z->left ? tree_find_max(z->left) : z->parent;
+
     if (z->left == NULL) {
         x = z->right;
+        x_parent = z->parent;
         rb_transplant(tree, z, z->right);
     } else if (z->right == NULL) {
         x = z->left;
+        x_parent = z->parent;
         rb_transplant(tree, z, z->left);
     } else {
         y = tree_find_min(z->right);
@@ -216,10 +269,13 @@ void rb_delete(struct red_black_tree *tree, struct red_black_tree_node *z) {
         x = y->right;
 
         if (y->parent != z) {
+            x_parent = y->parent;
             rb_transplant(tree, y, y->right);
             y->right = z->right;
             if (y->right)
                 y->right->parent = y;
+        } else {
+            x_parent = y;
         }
 
         rb_transplant(tree, z, y);
@@ -230,10 +286,10 @@ void rb_delete(struct red_black_tree *tree, struct red_black_tree_node *z) {
     }
 
     if (y_original_color == TREE_NODE_BLACK) {
-        fix_deletion(tree, x);
+        fix_deletion(tree, x, x_parent);
     }
 
-    free(z);
+    red_black_tree_free_node(tree, z);
 }
 
 struct red_black_tree_node *tree_search(struct red_black_tree_node *root, int data) {
@@ -246,19 +302,147 @@ struct red_black_tree_node *tree_search(struct red_black_tree_node *root, int da
     return root;
 }
 
+#ifndef SEARCH_BATCH_LANES
+#define SEARCH_BATCH_LANES 16
+#endif
+
+/*
+ * Look up n keys at once, storing each match (or NULL) in results. Up to
+ * SEARCH_BATCH_LANES descents are in flight together: each pass moves every
+ * lane down one level and prefetches the child it will read next pass, so
+ * the cache misses of different lanes overlap instead of queueing up. A lane
+ * that finishes is immediately refilled with the next key.
+ */
+void tree_search_batch(struct red_black_tree_node *root, const int *keys, size_t n,
+                       struct red_black_tree_node **results) {
+    struct {
+        struct red_black_tree_node *node;
+        size_t idx;
+    } lanes[SEARCH_BATCH_LANES];
+    size_t next = 0;
+    int active = 0;
+
+    while (active < SEARCH_BATCH_LANES && next < n) {
+        lanes[active].node = root;
+        lanes[active++].idx = next++;
+    }
+
+    while (active) {
+        for (int j = 0; j < active;) {
+            struct red_black_tree_node *node = lanes[j].node;
+            int data = keys[lanes[j].idx];
+
+            if (!node || node->data == data) {
+                results[lanes[j].idx] = node;
+                if (next < n) {
+                    lanes[j].node = root;
+                    lanes[j++].idx = next++;
+                } else {
+                    lanes[j] = lanes[--active];
+                }
+                continue;
+            }
+
+            node = data < node->data ? node->left : node->right;
+            __builtin_prefetch(node);
+            lanes[j++].node = node;
+        }
+    }
+}
+
 void red_black_tree_remove(struct red_black_tree *tree, int data) {
     struct red_black_tree_node *node = tree_search(tree->root, data);
     if (node)
         rb_delete(tree, node);
 }
 
-void red_black_tree_free(struct red_black_tree_node *root) {
-    if (root == NULL)
-        return;
-    red_black_tree_free(root->left);
-    red_black_tree_free(root->right);
-    root->left = root->right = NULL;
-    free(root);
+/* Node with the smallest data >= data, or NULL */
+struct red_black_tree_node *red_black_tree_lower_bound(struct red_black_tree *tree, int data) {
+    struct red_black_tree_node *node = tree->root, *bound = NULL;
+    while (node) {
+        if (node->data < data) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return bound;
+}
+
+/* In-order successor, by parent pointers */
+struct red_black_tree_node *red_black_tree_next(struct red_black_tree_node *node) {
+    if (node->right)
+        return tree_find_min(node->right);
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+/* O(1): the extremes are cached rather than found by walking a spine */
+struct red_black_tree_node *red_black_tree_min(struct red_black_tree *tree) {
+    return tree->leftmost;
+}
+
+struct red_black_tree_node *red_black_tree_max(struct red_black_tree *tree) {
+    return tree->rightmost;
+}
+
+/*
+ * Remove the smallest key and store it in *data. The cached node is deleted
+ * directly, so there is no search, and since it has no left child rb_delete
+ * only has to splice it out before running the fixup. Returns 0 when empty.
+ */
+int red_black_tree_pop_min(struct red_black_tree *tree, int *data) {
+    struct red_black_tree_node *node = tree->leftmost;
+    if (!node)
+        return 0;
+    *data = node->data;
+    rb_delete(tree, node);
+    return 1;
+}
+
+int red_black_tree_pop_max(struct red_black_tree *tree, int *data) {
+    struct red_black_tree_node *node = tree->rightmost;
+    if (!node)
+        return 0;
+    *data = node->data;
+    rb_delete(tree, node);
+    return 1;
+}
+
+/*
+ * Teardown without recursion: while the current node has a left child, rotate
+ * that child up; otherwise free the node and move to its right child. Each
+ * rotation puts one node on the right spine for good, so this is a single
+ * linear pass in constant space even when the tree is a path.
+ */
+void red_black_tree_free(struct red_black_tree *tree, struct red_black_tree_node *root) {
+    while (root) {
+        struct red_black_tree_node *left = root->left;
+
+        if (left) {
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        } else {
+            struct red_black_tree_node *right = root->right;
+            root->right = NULL;
+            red_black_tree_free_node(tree, root);
+            root = right;
+        }
+    }
+}
+
+void red_black_tree_destroy(struct red_black_tree *tree) {
+    if (tree->arena) {
+        arena_destroy(tree->arena);
+        free(tree->arena);
+    } else {
+        red_black_tree_free(tree, tree->root);
+    }
+    free(tree->block);
+    free(tree);
 }
 
 void fix_insertion(struct red_black_tree *tree, struct red_black_tree_node *node) {
@@ -306,7 +490,7 @@ void fix_insertion(struct red_black_tree *tree, struct red_black_tree_node *node
 }
 
 void red_black_tree_insert(struct red_black_tree *tree, int data) {
-    struct red_black_tree_node *new_node = malloc(sizeof(struct red_black_tree_node));
+    struct red_black_tree_node *new_node = red_black_tree_alloc_node(tree);
     new_node->data = data;
     new_node->left = NULL;
     new_node->right = NULL;
@@ -316,17 +500,25 @@ void red_black_tree_insert(struct red_black_tree *tree, int data) {
         new_node->color = TREE_NODE_BLACK;
         new_node->parent = NULL;
         tree->root = new_node;
+        tree->leftmost = tree->rightmost = new_node;
         return;
     }
 
+    /* Only a descent that never turns right can produce a new minimum */
+    int is_leftmost = 1;
+    int is_rightmost = 1;
+
     struct red_black_tree_node *current = tree->root;
     struct red_black_tree_node *parent = NULL;
     while (current != NULL) {
         parent = current;
-        if (data < current->data)
+        if (data < current->data) {
             current = current->left;
-        else
+            is_rightmost = 0;
+        } else {
             current = current->right;
+            is_leftmost = 0;
+        }
     }
 
     new_node->parent = parent;
@@ -335,13 +527,56 @@ void red_black_tree_insert(struct red_black_tree *tree, int data) {
     else
         parent->right = new_node;
 
+    if (is_leftmost)
+        tree->leftmost = new_node;
+    if (is_rightmost)
+        tree->rightmost = new_node;
+
     fix_insertion(tree, new_node);
 
     if (parent)
         assert(!(parent->color == TREE_NODE_RED && new_node->color == TREE_NODE_RED));
+}
 
-    int dummy_bh = 0;
-    assert(validate_rbtree(tree->root, &dummy_bh));
+static struct red_black_tree_node *build_balanced(struct red_black_tree_node *block, const int *keys,
+                                                  size_t lo, size_t hi, int depth, int red_depth,
+                                                  struct red_black_tree_node *parent) {
+    if (lo >= hi)
+        return NULL;
+
+    size_t mid = lo + (hi - lo) / 2;
+    struct red_black_tree_node *node = &block[mid];
+    node->data = keys[mid];
+    node->color = depth == red_depth ? TREE_NODE_RED : TREE_NODE_BLACK;
+    node->parent = parent;
+    node->left = build_balanced(block, keys, lo, mid, depth + 1, red_depth, node);
+    node->right = build_balanced(block, keys, mid + 1, hi, depth + 1, red_depth, node);
+    return node;
+}
+
+/*
+ * Build a tree from n keys in ascending order in O(n), with no descents and
+ * no rotations. Splitting at the median keeps every level but the deepest
+ * full, so that level alone is colored red when it is incomplete and all
+ * paths carry the same number of black nodes. The nodes are allocated as a
+ * single block, node i holding keys[i].
+ */
+struct red_black_tree *red_black_tree_build_sorted(const int *keys, size_t n) {
+    struct red_black_tree *tree = red_black_tree_create();
+    if (n == 0)
+        return tree;
+
+    int deepest = 0;
+    while (((size_t) 2 << deepest) - 1 < n)
+        deepest++;
+    int complete = ((size_t) 2 << deepest) - 1 == n;
+
+    tree->block = malloc(n * sizeof(struct red_black_tree_node));
+    tree->block_size = n;
+    tree->root = build_balanced(tree->block, keys, 0, n, 0, complete || deepest == 0 ? -1 : deepest, NULL);
+    tree->leftmost = &tree->block[0];
+    tree->rightmost = &tree->block[n - 1];
+    return tree;
 }
 
 #define ANSI_RED "\033[31m"
@@ -351,17 +586,24 @@ void red_black_tree_insert(struct red_black_tree *tree, int data) {
 #define RBT_RED ANSI_RED "R" ANSI_RESET
 #define RBT_BLACK ANSI_BOLD "B" ANSI_RESET
 
+/* In-order successor within the subtree at root, by parent pointers */
+static struct red_black_tree_node *subtree_next(struct red_black_tree_node *root,
+                                                struct red_black_tree_node *node) {
+    if (node->right)
+        return tree_find_min(node->right);
+    while (node != root && node == node->parent->right)
+        node = node->parent;
+    return node == root ? NULL : node->parent;
+}
+
 void print_inorder(struct red_black_tree_node *node) {
     if (node == NULL)
         return;
-    print_inorder(node->left);
-    printf("(%d,%s) ", node->data, node->color == TREE_NODE_RED ? RBT_RED : RBT_BLACK);
-    print_inorder(node->right);
+    for (struct red_black_tree_node *n = tree_find_min(node); n; n = subtree_next(node, n))
+        printf("(%d,%s) ", n->data, n->color == TREE_NODE_RED ? RBT_RED : RBT_BLACK);
 }
-void export_dot(FILE *fp, struct red_black_tree_node *node) {
-    if (!node)
-        return;
 
+static void export_dot_node(FILE *fp, struct red_black_tree_node *node) {
     fprintf(fp, "    \"%d\" [label=\"%d\", color=%s, fontcolor=%s, style=filled, fillcolor=%s];\n",
             node->data,
             node->data,
@@ -371,7 +613,6 @@ void export_dot(FILE *fp, struct red_black_tree_node *node) {
 
     if (node->left) {
         fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->left->data);
-        export_dot(fp, node->left);
     } else {
         fprintf(fp, "    \"nullL%d\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", node->data);
         fprintf(fp, "    \"%d\" -> \"nullL%d\";\n", node->data, node->data);
@@ -379,13 +620,20 @@ void export_dot(FILE *fp, struct red_black_tree_node *node) {
 
     if (node->right) {
         fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->right->data);
-        export_dot(fp, node->right);
     } else {
         fprintf(fp, "    \"nullR%d\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", node->data);
         fprintf(fp, "    \"%d\" -> \"nullR%d\";\n", node->data, node->data);
     }
 }
 
+/* Emits the subtree in in-order, so a degenerate tree needs no stack */
+void export_dot(FILE *fp, struct red_black_tree_node *node) {
+    if (!node)
+        return;
+    for (struct red_black_tree_node *n = tree_find_min(node); n; n = subtree_next(node, n))
+        export_dot_node(fp, n);
+}
+
 void export_tree_to_dot(struct red_black_tree *tree, const char *filename) {
     FILE *fp = fopen(filename, "w");
     if (!fp) {
@@ -408,13 +656,61 @@ void export_tree_to_dot(struct red_black_tree *tree, const char *filename) {
 #define NUM_INSERTS 100
 #endif
 
-#define NUM_REMOVES NUM_INSERTS / 2
+#define NUM_REMOVES (NUM_INSERTS / 2)
+
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef RBT_NO_MAIN
+#ifndef BENCH_ARENA_KEYS
+#define BENCH_ARENA_KEYS (1 << 20)
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Insert BENCH_ARENA_KEYS random keys and destroy the tree. Bytes per key are
+ * heap bytes in use (chunk headers and rounding included) for malloc, and
+ * bytes carved from slabs for the arena. Without glibc's mallinfo2 only the
+ * arena's figure is reported.
+ */
+static void benchmark_arena(const char *name, const int *keys, int use_arena, unsigned flags) {
+#ifdef __GLIBC__
+    size_t heap_before = mallinfo2().uordblks;
+#endif
+    struct red_black_tree *tree = use_arena ? red_black_tree_create_arena(flags) : red_black_tree_create();
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ARENA_KEYS; i++)
+        red_black_tree_insert(tree, keys[i]);
+    double insert_ns = (now_ns() - start) / BENCH_ARENA_KEYS;
+
+#ifdef __GLIBC__
+    size_t bytes = use_arena ? tree->arena->bytes_used : mallinfo2().uordblks - heap_before;
+#else
+    size_t bytes = use_arena ? tree->arena->bytes_used : 0;
+#endif
+
+    start = now_ns();
+    red_black_tree_destroy(tree);
+    double destroy_ms = (now_ns() - start) / 1e6;
+
+    printf("    %-16s %.1f ns/insert, ", name, insert_ns);
+    if (bytes)
+        printf("%.1f bytes/key, ", (double) bytes / BENCH_ARENA_KEYS);
+    else
+        printf("bytes/key unknown, ");
+    printf("destroy %.2f ms\n", destroy_ms);
+}
 
 int main() {
     printf("Red-black tree... ");
     fflush(stdout);
     struct red_black_tree *tree = red_black_tree_create();
     int *values = malloc(NUM_INSERTS * sizeof(int));
+    int bh = 0;
 
     srand((unsigned) time(NULL));
 
@@ -433,6 +729,7 @@ int main() {
 
         values[i++] = value;
         red_black_tree_insert(tree, value);
+        assert(validate_rbtree(tree->root, &bh));
     }
 
     for (int i = NUM_INSERTS - 1; i > 0; i--) {
@@ -444,14 +741,80 @@ int main() {
 
     for (int i = 0; i < NUM_REMOVES; i++) {
         red_black_tree_remove(tree, values[i]);
+        assert(validate_rbtree(tree->root, &bh));
+        assert(red_black_tree_min(tree) == tree_find_min(tree->root));
+        assert(red_black_tree_max(tree) == tree_find_max(tree->root));
     }
 
+    struct red_black_tree_node **found = malloc(NUM_INSERTS * sizeof(struct red_black_tree_node *));
+    tree_search_batch(tree->root, values, NUM_INSERTS, found);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        assert(found[i] == tree_search(tree->root, values[i]));
+    free(found);
+
     export_tree_to_dot(tree, "rbtree.dot");
     printf("complete\n");
 
-    red_black_tree_free(tree->root);
-    free(tree);
+    /* Drain from both ends, which must come out in order */
+    int lo = -1, hi = NUM_INSERTS, data;
+    for (int i = 0; i < NUM_INSERTS - NUM_REMOVES; i++) {
+        if (i % 2 == 0) {
+            int popped = red_black_tree_pop_min(tree, &data);
+            assert(popped && data > lo);
+            lo = data;
+        } else {
+            int popped = red_black_tree_pop_max(tree, &data);
+            assert(popped && data < hi);
+            hi = data;
+        }
+        assert(validate_rbtree(tree->root, &bh));
+    }
+    assert(!tree->root && !red_black_tree_min(tree) && !red_black_tree_max(tree));
+    red_black_tree_destroy(tree);
+
+    /* Bulk load every size up to NUM_INSERTS, then churn the largest */
+    for (int i = 0; i < NUM_INSERTS; i++)
+        values[i] = i * 2;
+
+    for (size_t n = 0; n <= NUM_INSERTS; n++) {
+        tree = red_black_tree_build_sorted(values, n);
+        assert(validate_rbtree(tree->root, &bh));
+        if (n != NUM_INSERTS)
+            red_black_tree_destroy(tree);
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        red_black_tree_remove(tree, values[i * 2]);
+        red_black_tree_insert(tree, values[i * 2] + 1);
+        assert(validate_rbtree(tree->root, &bh));
+        assert(tree_search(tree->root, values[i * 2 + 1]));
+    }
+
+    red_black_tree_destroy(tree);
+
+    /* The same churn with arena-backed nodes, which deletes recycle */
+    tree = red_black_tree_create_arena(0);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        red_black_tree_insert(tree, values[i]);
+    size_t carved = tree->arena->bytes_used;
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        red_black_tree_remove(tree, values[i]);
+        red_black_tree_insert(tree, values[i] + 1);
+        assert(validate_rbtree(tree->root, &bh));
+    }
+    assert(tree->arena->bytes_used == carved);
+    red_black_tree_destroy(tree);
     free(values);
 
+    int *keys = malloc(BENCH_ARENA_KEYS * sizeof(int));
+    for (int i = 0; i < BENCH_ARENA_KEYS; i++)
+        keys[i] = rand();
+    printf("    %d random inserts:\n", BENCH_ARENA_KEYS);
+    benchmark_arena("malloc", keys, 0, 0);
+    benchmark_arena("arena", keys, 1, 0);
+    benchmark_arena("arena, hugepages", keys, 1, ARENA_HUGEPAGES);
+    free(keys);
+
     return 0;
 }
+#endif
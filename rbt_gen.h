@@ -0,0 +1,347 @@
+/*
+ * Red-black tree generator in the style of BSD <sys/tree.h>.
+ *
+ *     RBT_GENERATE(name, key_type, cmp)
+ *
+ * expands to struct name_node, struct name and a set of static functions
+ * prefixed with name_, all specialised for key_type. cmp(a, b) is a function
+ * or function-like macro returning <0, 0 or >0 as a orders before, with or
+ * after b. It is expanded at every comparison, so the compiler inlines it and
+ * nothing on the hot path goes through a function pointer. Write it so that
+ * cmp() == 0 and cmp() < 0 fold to one comparison each, as
+ * ((a) == (b) ? 0 : (a) < (b) ? -1 : 1) does for scalars; the subtraction
+ * of two flags does not, and costs find about a tenth. Keys are unique.
+ * The algorithms are the ones in rbt.c. avl_gen.h, treap_gen.h and
+ * splay_gen.h do the same for the other trees.
+ *
+ *     name_init(t)            empty tree
+ *     name_insert(t, key)     node for key, added if absent
+ *     name_find(t, key)       node for key, or NULL
+ *     name_remove(t, node)    unlink and free node
+ *     name_delete(t, key)     remove key; 1 if it was present
+ *     name_min(t), name_next(node)
+ *     name_free(t)            free every node, in constant space
+ *     name_validate(t)        black height, or -1 if a property is broken
+ */
+
+#ifndef RBT_GEN_H
+#define RBT_GEN_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define RBT_GEN_RED 0
+#define RBT_GEN_BLACK 1
+
+#define RBT_GENERATE(name, key_type, cmp)                                                  \
+    struct name##_node {                                                                   \
+        key_type key;                                                                      \
+        int color; /* next to the key, where an int key leaves a hole */                   \
+        struct name##_node *left;                                                          \
+        struct name##_node *right;                                                         \
+        struct name##_node *parent;                                                        \
+    };                                                                                     \
+                                                                                           \
+    struct name {                                                                          \
+        struct name##_node *root;                                                          \
+        size_t size;                                                                       \
+    };                                                                                     \
+                                                                                           \
+    static __attribute__((unused)) void name##_init(struct name *t) {                      \
+        t->root = NULL;                                                                    \
+        t->size = 0;                                                                       \
+    }                                                                                      \
+                                                                                           \
+    static inline int name##_is_red(const struct name##_node *n) {                         \
+        return n && n->color == RBT_GEN_RED;                                               \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_replace_child(struct name *t, struct name##_node *parent,    \
+                                            struct name##_node *old,                       \
+                                            struct name##_node *new_child) {               \
+        if (!parent)                                                                       \
+            t->root = new_child;                                                           \
+        else if (parent->left == old)                                                      \
+            parent->left = new_child;                                                      \
+        else                                                                               \
+            parent->right = new_child;                                                     \
+    }                                                                                      \
+                                                                                           \
+    static void name##_rotate_left(struct name *t, struct name##_node *x) {                \
+        struct name##_node *y = x->right;                                                  \
+        x->right = y->left;                                                                \
+        if (y->left)                                                                       \
+            y->left->parent = x;                                                           \
+        y->parent = x->parent;                                                             \
+        name##_replace_child(t, x->parent, x, y);                                          \
+        y->left = x;                                                                       \
+        x->parent = y;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static void name##_rotate_right(struct name *t, struct name##_node *y) {               \
+        struct name##_node *x = y->left;                                                   \
+        y->left = x->right;                                                                \
+        if (x->right)                                                                      \
+            x->right->parent = y;                                                          \
+        x->parent = y->parent;                                                             \
+        name##_replace_child(t, y->parent, y, x);                                          \
+        x->right = y;                                                                      \
+        y->parent = x;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_find(struct name *t,         \
+                                                                   key_type key) {         \
+        struct name##_node *n = t->root;                                                   \
+        /* Two tests rather than one saved result: for simple keys they fold to the   */ \
+        /* == and < of rbt.c, and the descent compiles to a conditional move           */ \
+        while (n && cmp(key, n->key) != 0)                                                 \
+            n = cmp(key, n->key) < 0 ? n->left : n->right;                                 \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static void name##_fix_insertion(struct name *t, struct name##_node *node) {           \
+        while (node != t->root && node->parent->color == RBT_GEN_RED) {                    \
+            struct name##_node *parent = node->parent;                                     \
+            struct name##_node *grandparent = parent->parent;                              \
+            if (parent == grandparent->left) {                                             \
+                struct name##_node *uncle = grandparent->right;                            \
+                if (name##_is_red(uncle)) {                                                \
+                    parent->color = uncle->color = RBT_GEN_BLACK;                          \
+                    grandparent->color = RBT_GEN_RED;                                      \
+                    node = grandparent;                                                    \
+                } else {                                                                   \
+                    if (node == parent->right) {                                           \
+                        node = parent;                                                     \
+                        name##_rotate_left(t, node);                                       \
+                        parent = node->parent;                                             \
+                    }                                                                      \
+                    parent->color = RBT_GEN_BLACK;                                         \
+                    grandparent->color = RBT_GEN_RED;                                      \
+                    name##_rotate_right(t, grandparent);                                   \
+                }                                                                          \
+            } else {                                                                       \
+                struct name##_node *uncle = grandparent->left;                             \
+                if (name##_is_red(uncle)) {                                                \
+                    parent->color = uncle->color = RBT_GEN_BLACK;                          \
+                    grandparent->color = RBT_GEN_RED;                                      \
+                    node = grandparent;                                                    \
+                } else {                                                                   \
+                    if (node == parent->left) {                                            \
+                        node = parent;                                                     \
+                        name##_rotate_right(t, node);                                      \
+                        parent = node->parent;                                             \
+                    }                                                                      \
+                    parent->color = RBT_GEN_BLACK;                                         \
+                    grandparent->color = RBT_GEN_RED;                                      \
+                    name##_rotate_left(t, grandparent);                                    \
+                }                                                                          \
+            }                                                                              \
+        }                                                                                  \
+        t->root->color = RBT_GEN_BLACK;                                                    \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_insert(struct name *t,       \
+                                                                     key_type key) {       \
+        struct name##_node **link = &t->root;                                              \
+        struct name##_node *parent = NULL;                                                 \
+        while (*link) {                                                                    \
+            if (cmp(key, (*link)->key) == 0)                                               \
+                return *link;                                                              \
+            parent = *link;                                                                \
+            link = cmp(key, parent->key) < 0 ? &parent->left : &parent->right;             \
+        }                                                                                  \
+        struct name##_node *n = malloc(sizeof(*n));                                        \
+        n->key = key;                                                                      \
+        n->left = n->right = NULL;                                                         \
+        n->parent = parent;                                                                \
+        n->color = RBT_GEN_RED;                                                            \
+        *link = n;                                                                         \
+        t->size++;                                                                         \
+        name##_fix_insertion(t, n);                                                        \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_min(struct name *t) {        \
+        struct name##_node *n = t->root;                                                   \
+        while (n && n->left)                                                               \
+            n = n->left;                                                                   \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_next(struct name##_node *n) { \
+        if (n->right) {                                                                    \
+            n = n->right;                                                                  \
+            while (n->left)                                                                \
+                n = n->left;                                                               \
+            return n;                                                                      \
+        }                                                                                  \
+        while (n->parent && n == n->parent->right)                                         \
+            n = n->parent;                                                                 \
+        return n->parent;                                                                  \
+    }                                                                                      \
+                                                                                           \
+    /* x may be NULL, so its parent is passed in explicitly */                             \
+    static void name##_fix_deletion(struct name *t, struct name##_node *x,                 \
+                                    struct name##_node *parent) {                          \
+        while (x != t->root && !name##_is_red(x)) {                                        \
+            struct name##_node *sibling;                                                   \
+            if (x == parent->left) {                                                       \
+                sibling = parent->right;                                                   \
+                if (name##_is_red(sibling)) {                                              \
+                    sibling->color = RBT_GEN_BLACK;                                        \
+                    parent->color = RBT_GEN_RED;                                           \
+                    name##_rotate_left(t, parent);                                         \
+                    sibling = parent->right;                                               \
+                }                                                                          \
+                if (!name##_is_red(sibling->left) && !name##_is_red(sibling->right)) {     \
+                    sibling->color = RBT_GEN_RED;                                          \
+                    x = parent;                                                            \
+                    parent = x->parent;                                                    \
+                } else {                                                                   \
+                    if (!name##_is_red(sibling->right)) {                                  \
+                        sibling->left->color = RBT_GEN_BLACK;                              \
+                        sibling->color = RBT_GEN_RED;                                      \
+                        name##_rotate_right(t, sibling);                                   \
+                        sibling = parent->right;                                           \
+                    }                                                                      \
+                    sibling->color = parent->color;                                        \
+                    parent->color = RBT_GEN_BLACK;                                         \
+                    if (sibling->right)                                                    \
+                        sibling->right->color = RBT_GEN_BLACK;                             \
+                    name##_rotate_left(t, parent);                                         \
+                    x = t->root;                                                           \
+                }                                                                          \
+            } else {                                                                       \
+                sibling = parent->left;                                                    \
+                if (name##_is_red(sibling)) {                                              \
+                    sibling->color = RBT_GEN_BLACK;                                        \
+                    parent->color = RBT_GEN_RED;                                           \
+                    name##_rotate_right(t, parent);                                        \
+                    sibling = parent->left;                                                \
+                }                                                                          \
+                if (!name##_is_red(sibling->left) && !name##_is_red(sibling->right)) {     \
+                    sibling->color = RBT_GEN_RED;                                          \
+                    x = parent;                                                            \
+                    parent = x->parent;                                                    \
+                } else {                                                                   \
+                    if (!name##_is_red(sibling->left)) {                                   \
+                        sibling->right->color = RBT_GEN_BLACK;                             \
+                        sibling->color = RBT_GEN_RED;                                      \
+                        name##_rotate_left(t, sibling);                                    \
+                        sibling = parent->left;                                            \
+                    }                                                                      \
+                    sibling->color = parent->color;                                        \
+                    parent->color = RBT_GEN_BLACK;                                         \
+                    if (sibling->left)                                                     \
+                        sibling->left->color = RBT_GEN_BLACK;                              \
+                    name##_rotate_right(t, parent);                                        \
+                    x = t->root;                                                           \
+                }                                                                          \
+            }                                                                              \
+        }                                                                                  \
+        if (x)                                                                             \
+            x->color = RBT_GEN_BLACK;                                                      \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_transplant(struct name *t, struct name##_node *u,            \
+                                         struct name##_node *v) {                          \
+        name##_replace_child(t, u->parent, u, v);                                          \
+        if (v)                                                                             \
+            v->parent = u->parent;                                                         \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) void name##_remove(struct name *t,                      \
+                                                      struct name##_node *z) {             \
+        struct name##_node *x, *x_parent, *y = z;                                          \
+        int y_original_color = y->color;                                                   \
+        if (!z->left) {                                                                    \
+            x = z->right;                                                                  \
+            x_parent = z->parent;                                                          \
+            name##_transplant(t, z, z->right);                                             \
+        } else if (!z->right) {                                                            \
+            x = z->left;                                                                   \
+            x_parent = z->parent;                                                          \
+            name##_transplant(t, z, z->left);                                              \
+        } else {                                                                           \
+            y = z->right;                                                                  \
+            while (y->left)                                                                \
+                y = y->left;                                                               \
+            y_original_color = y->color;                                                   \
+            x = y->right;                                                                  \
+            if (y->parent != z) {                                                          \
+                x_parent = y->parent;                                                      \
+                name##_transplant(t, y, y->right);                                         \
+                y->right = z->right;                                                       \
+                y->right->parent = y;                                                      \
+            } else {                                                                       \
+                x_parent = y;                                                              \
+            }                                                                              \
+            name##_transplant(t, z, y);                                                    \
+            y->left = z->left;                                                             \
+            y->left->parent = y;                                                           \
+            y->color = z->color;                                                           \
+        }                                                                                  \
+        if (y_original_color == RBT_GEN_BLACK)                                             \
+            name##_fix_deletion(t, x, x_parent);                                           \
+        t->size--;                                                                         \
+        free(z);                                                                           \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) int name##_delete(struct name *t, key_type key) {       \
+        struct name##_node *n = name##_find(t, key);                                       \
+        if (!n)                                                                            \
+            return 0;                                                                      \
+        name##_remove(t, n);                                                               \
+        return 1;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Rotation-based teardown: linear, no recursion */                                    \
+    static __attribute__((unused)) void name##_free(struct name *t) {                      \
+        struct name##_node *n = t->root;                                                   \
+        while (n) {                                                                        \
+            struct name##_node *left = n->left;                                            \
+            if (left) {                                                                    \
+                n->left = left->right;                                                     \
+                left->right = n;                                                           \
+                n = left;                                                                  \
+            } else {                                                                       \
+                struct name##_node *right = n->right;                                      \
+                free(n);                                                                   \
+                n = right;                                                                 \
+            }                                                                              \
+        }                                                                                  \
+        name##_init(t);                                                                    \
+    }                                                                                      \
+                                                                                           \
+    static int name##_validate_node(const struct name##_node *n) {                         \
+        if (!n)                                                                            \
+            return 1;                                                                      \
+        if (n->left && (n->left->parent != n || cmp(n->left->key, n->key) >= 0))           \
+            return -1;                                                                     \
+        if (n->right && (n->right->parent != n || cmp(n->right->key, n->key) <= 0))        \
+            return -1;                                                                     \
+        if (name##_is_red(n) && (name##_is_red(n->left) || name##_is_red(n->right)))       \
+            return -1;                                                                     \
+        int left = name##_validate_node(n->left);                                          \
+        int right = name##_validate_node(n->right);                                        \
+        if (left < 0 || left != right)                                                     \
+            return -1;                                                                     \
+        return left + (n->color == RBT_GEN_BLACK);                                         \
+    }                                                                                      \
+                                                                                           \
+    /* Also walks the tree in order, so keys must ascend and number t->size */             \
+    static __attribute__((unused)) int name##_validate(struct name *t) {                   \
+        if (name##_is_red(t->root) || (t->root && t->root->parent))                        \
+            return -1;                                                                     \
+        size_t count = 0;                                                                  \
+        for (struct name##_node *n = name##_min(t); n; n = name##_next(n), count++) {      \
+            struct name##_node *next = name##_next(n);                                     \
+            if (next && cmp(n->key, next->key) >= 0)                                       \
+                return -1;                                                                 \
+        }                                                                                  \
+        if (count != t->size)                                                              \
+            return -1;                                                                     \
+        return name##_validate_node(t->root);                                              \
+    }
+
+#endif
@@ -0,0 +1,611 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Interval tree on top of the red-black tree from rbt.c.
+ *
+ * Nodes are ordered by (low, high) and every node also records the largest
+ * high endpoint found anywhere in its subtree. Rotations, the insert descent
+ * and the delete path keep that maximum current, so overlap searches can skip
+ * any subtree whose maximum ends before the query starts.
+ */
+
+enum red_black_tree_node_color { TREE_NODE_RED,
+                                 TREE_NODE_BLACK };
+
+struct interval_tree_node {
+    int low;
+    int high;
+    int max;
+    enum red_black_tree_node_color color;
+    struct interval_tree_node *left;
+    struct interval_tree_node *right;
+    struct interval_tree_node *parent;
+};
+
+struct interval_tree {
+    struct interval_tree_node *root;
+};
+
+typedef void (*interval_visit_fn)(struct interval_tree_node *node, void *ctx);
+
+static inline int is_red(struct interval_tree_node *node) {
+    return node && node->color == TREE_NODE_RED;
+}
+
+static inline int interval_cmp(int low_a, int high_a, int low_b, int high_b) {
+    if (low_a != low_b)
+        return low_a < low_b ? -1 : 1;
+    if (high_a != high_b)
+        return high_a < high_b ? -1 : 1;
+    return 0;
+}
+
+static inline int overlaps(struct interval_tree_node *node, int low, int high) {
+    return node->low <= high && low <= node->high;
+}
+
+static void update_max(struct interval_tree_node *node) {
+    int max = node->high;
+    if (node->left && node->left->max > max)
+        max = node->left->max;
+    if (node->right && node->right->max > max)
+        max = node->right->max;
+    node->max = max;
+}
+
+struct interval_tree *interval_tree_create(void) {
+    struct interval_tree *tree = malloc(sizeof(struct interval_tree));
+    tree->root = NULL;
+    return tree;
+}
+
+struct interval_tree_node *tree_find_min(struct interval_tree_node *node) {
+    while (node->left != NULL) {
+        node = node->left;
+    }
+    return node;
+}
+
+void rb_transplant(struct interval_tree *tree, struct interval_tree_node *u, struct interval_tree_node *v) {
+    if (u->parent == NULL)
+        tree->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+
+    if (v)
+        v->parent = u->parent;
+}
+
+void left_rotate(struct interval_tree *tree, struct interval_tree_node *x) {
+    struct interval_tree_node *y = x->right;
+    x->right = y->left;
+
+    if (y->left)
+        y->left->parent = x;
+
+    y->parent = x->parent;
+    if (!x->parent)
+        tree->root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+
+    y->left = x;
+    x->parent = y;
+
+    /* y now spans exactly what x used to */
+    y->max = x->max;
+    update_max(x);
+}
+
+void right_rotate(struct interval_tree *tree, struct interval_tree_node *y) {
+    struct interval_tree_node *x = y->left;
+    y->left = x->right;
+    if (x->right)
+        x->right->parent = y;
+
+    x->parent = y->parent;
+    if (!y->parent)
+        tree->root = x;
+    else if (y == y->parent->right)
+        y->parent->right = x;
+    else
+        y->parent->left = x;
+
+    x->right = y;
+    y->parent = x;
+
+    x->max = y->max;
+    update_max(y);
+}
+
+void fix_insertion(struct interval_tree *tree, struct interval_tree_node *node) {
+    while (node != tree->root && node->parent->color == TREE_NODE_RED) {
+        struct interval_tree_node *parent = node->parent;
+        struct interval_tree_node *grandparent = parent->parent;
+
+        if (parent == grandparent->left) {
+            struct interval_tree_node *uncle = grandparent->right;
+            if (is_red(uncle)) {
+                parent->color = TREE_NODE_BLACK;
+                uncle->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                node = grandparent;
+            } else {
+                if (node == parent->right) {
+                    node = parent;
+                    left_rotate(tree, node);
+                    parent = node->parent;
+                }
+                parent->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                right_rotate(tree, grandparent);
+            }
+        } else {
+            struct interval_tree_node *uncle = grandparent->left;
+            if (is_red(uncle)) {
+                parent->color = TREE_NODE_BLACK;
+                uncle->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                node = grandparent;
+            } else {
+                if (node == parent->left) {
+                    node = parent;
+                    right_rotate(tree, node);
+                    parent = node->parent;
+                }
+                parent->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                left_rotate(tree, grandparent);
+            }
+        }
+    }
+    tree->root->color = TREE_NODE_BLACK;
+}
+
+/*
+ * x may be NULL (a black leaf), so its parent is passed in explicitly
+ * instead of being read back through x.
+ */
+void fix_deletion(struct interval_tree *tree, struct interval_tree_node *x,
+                  struct interval_tree_node *parent) {
+    while (x != tree->root && !is_red(x)) {
+        struct interval_tree_node *sibling;
+
+        if (x == parent->left) {
+            sibling = parent->right;
+
+            if (is_red(sibling)) {
+                sibling->color = TREE_NODE_BLACK;
+                parent->color = TREE_NODE_RED;
+                left_rotate(tree, parent);
+                sibling = parent->right;
+            }
+
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!is_red(sibling->right)) {
+                    sibling->left->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    right_rotate(tree, sibling);
+                    sibling = parent->right;
+                }
+
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->right)
+                    sibling->right->color = TREE_NODE_BLACK;
+                left_rotate(tree, parent);
+                x = tree->root;
+            }
+        } else {
+            sibling = parent->left;
+
+            if (is_red(sibling)) {
+                sibling->color = TREE_NODE_BLACK;
+                parent->color = TREE_NODE_RED;
+                right_rotate(tree, parent);
+                sibling = parent->left;
+            }
+
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!is_red(sibling->left)) {
+                    sibling->right->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    left_rotate(tree, sibling);
+                    sibling = parent->left;
+                }
+
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->left)
+                    sibling->left->color = TREE_NODE_BLACK;
+                right_rotate(tree, parent);
+                x = tree->root;
+            }
+        }
+    }
+
+    if (x)
+        x->color = TREE_NODE_BLACK;
+}
+
+void interval_tree_insert(struct interval_tree *tree, int low, int high) {
+    struct interval_tree_node *new_node = malloc(sizeof(struct interval_tree_node));
+    new_node->low = low;
+    new_node->high = high;
+    new_node->max = high;
+    new_node->left = NULL;
+    new_node->right = NULL;
+    new_node->color = TREE_NODE_RED;
+
+    if (tree->root == NULL) {
+        new_node->color = TREE_NODE_BLACK;
+        new_node->parent = NULL;
+        tree->root = new_node;
+        return;
+    }
+
+    /* Every ancestor of the new node may have to cover its endpoint */
+    struct interval_tree_node *current = tree->root;
+    struct interval_tree_node *parent = NULL;
+    while (current != NULL) {
+        parent = current;
+        if (high > current->max)
+            current->max = high;
+        if (interval_cmp(low, high, current->low, current->high) < 0)
+            current = current->left;
+        else
+            current = current->right;
+    }
+
+    new_node->parent = parent;
+    if (interval_cmp(low, high, parent->low, parent->high) < 0)
+        parent->left = new_node;
+    else
+        parent->right = new_node;
+
+    fix_insertion(tree, new_node);
+}
+
+void rb_delete(struct interval_tree *tree, struct interval_tree_node *z) {
+    struct interval_tree_node *y = z;
+    struct interval_tree_node *x = NULL;
+    struct interval_tree_node *x_parent = NULL;
+    enum red_black_tree_node_color y_original_color = y->color;
+
+    if (z->left == NULL) {
+        x = z->right;
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->right);
+    } else if (z->right == NULL) {
+        x = z->left;
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->left);
+    } else {
+        y = tree_find_min(z->right);
+        y_original_color = y->color;
+        x = y->right;
+
+        if (y->parent != z) {
+            x_parent = y->parent;
+            rb_transplant(tree, y, y->right);
+            y->right = z->right;
+            if (y->right)
+                y->right->parent = y;
+        } else {
+            x_parent = y;
+        }
+
+        rb_transplant(tree, z, y);
+        y->left = z->left;
+        if (y->left)
+            y->left->parent = y;
+        y->color = z->color;
+    }
+
+    /* Everything from the lowest spliced spot up may have lost its max */
+    for (struct interval_tree_node *p = x_parent; p; p = p->parent)
+        update_max(p);
+
+    if (y_original_color == TREE_NODE_BLACK) {
+        fix_deletion(tree, x, x_parent);
+    }
+
+    free(z);
+}
+
+struct interval_tree_node *interval_tree_find(struct interval_tree *tree, int low, int high) {
+    struct interval_tree_node *node = tree->root;
+    while (node) {
+        int cmp = interval_cmp(low, high, node->low, node->high);
+        if (cmp == 0)
+            return node;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+void interval_tree_remove(struct interval_tree *tree, int low, int high) {
+    struct interval_tree_node *node = interval_tree_find(tree, low, high);
+    if (node)
+        rb_delete(tree, node);
+}
+
+/* Any one interval overlapping [low, high], in O(log n) */
+struct interval_tree_node *interval_tree_search(struct interval_tree *tree, int low, int high) {
+    struct interval_tree_node *node = tree->root;
+    while (node && !overlaps(node, low, high)) {
+        if (node->left && node->left->max >= low)
+            node = node->left;
+        else
+            node = node->right;
+    }
+    return node;
+}
+
+static int overlap_walk(struct interval_tree_node *node, int low, int high,
+                        interval_visit_fn visit, void *ctx) {
+    int count = 0;
+
+    /* Nothing below ends late enough to reach the query */
+    if (!node || node->max < low)
+        return 0;
+
+    count += overlap_walk(node->left, low, high, visit, ctx);
+
+    if (overlaps(node, low, high)) {
+        if (visit)
+            visit(node, ctx);
+        count++;
+    }
+
+    /* Everything to the right starts at or after node->low */
+    if (node->low <= high)
+        count += overlap_walk(node->right, low, high, visit, ctx);
+
+    return count;
+}
+
+/* Visit every interval overlapping [low, high] in order; returns the count */
+int interval_tree_overlaps(struct interval_tree *tree, int low, int high,
+                           interval_visit_fn visit, void *ctx) {
+    return overlap_walk(tree->root, low, high, visit, ctx);
+}
+
+/* Visit every interval containing point */
+int interval_tree_stab(struct interval_tree *tree, int point,
+                       interval_visit_fn visit, void *ctx) {
+    return overlap_walk(tree->root, point, point, visit, ctx);
+}
+
+int validate_interval_tree(struct interval_tree_node *node, int *black_height) {
+    if (node == NULL) {
+        *black_height = 1;
+        return 1;
+    }
+
+    if (is_red(node) && (is_red(node->left) || is_red(node->right))) {
+        fprintf(stderr, "Red-Red violation at node [%d, %d]\n", node->low, node->high);
+        return 0;
+    }
+
+    int expected_max = node->high;
+    if (node->left && node->left->max > expected_max)
+        expected_max = node->left->max;
+    if (node->right && node->right->max > expected_max)
+        expected_max = node->right->max;
+
+    if (node->max != expected_max) {
+        fprintf(stderr, "Max violation at node [%d, %d] (max=%d, expected %d)\n",
+                node->low, node->high, node->max, expected_max);
+        return 0;
+    }
+
+    int left_black_height = 0;
+    int right_black_height = 0;
+
+    if (!validate_interval_tree(node->left, &left_black_height))
+        return 0;
+    if (!validate_interval_tree(node->right, &right_black_height))
+        return 0;
+
+    if (left_black_height != right_black_height) {
+        fprintf(stderr, "Black-height violation at node [%d, %d] (left height=%d, right height=%d)\n",
+                node->low, node->high, left_black_height, right_black_height);
+        return 0;
+    }
+
+    *black_height = left_black_height + (node->color == TREE_NODE_BLACK ? 1 : 0);
+    return 1;
+}
+
+void interval_tree_free(struct interval_tree_node *root) {
+    if (root == NULL)
+        return;
+    interval_tree_free(root->left);
+    interval_tree_free(root->right);
+    root->left = root->right = NULL;
+    free(root);
+}
+
+void export_dot(FILE *fp, struct interval_tree_node *node) {
+    if (!node)
+        return;
+
+    fprintf(fp, "    \"%p\" [label=\"[%d, %d]\\nmax %d\", color=%s, fontcolor=%s, style=filled, fillcolor=%s];\n",
+            (void *) node,
+            node->low,
+            node->high,
+            node->max,
+            node->color == TREE_NODE_RED ? "\"red\"" : "\"gray\"",
+            "white",
+            node->color == TREE_NODE_RED ? "\"#ffcccc\"" : "\"#808080\"");
+
+    if (node->left) {
+        fprintf(fp, "    \"%p\" -> \"%p\";\n", (void *) node, (void *) node->left);
+        export_dot(fp, node->left);
+    }
+
+    if (node->right) {
+        fprintf(fp, "    \"%p\" -> \"%p\";\n", (void *) node, (void *) node->right);
+        export_dot(fp, node->right);
+    }
+}
+
+void export_tree_to_dot(struct interval_tree *tree, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "digraph IntervalTree {\n");
+    fprintf(fp, "    node [shape=ellipse, fontname=Arial];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+
+    if (tree->root)
+        export_dot(fp, tree->root);
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int linear_overlaps(const int *lows, const int *highs, int n, int low, int high) {
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        count += lows[i] <= high && low <= highs[i];
+    return count;
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#define NUM_REMOVES NUM_INSERTS / 2
+
+#ifndef BENCH_INTERVALS
+#define BENCH_INTERVALS 100000
+#endif
+
+#ifndef BENCH_QUERIES
+#define BENCH_QUERIES 1000
+#endif
+
+/* Short intervals over a wide range, like reservations on a timeline */
+static void benchmark(void) {
+    int span = BENCH_INTERVALS * 10;
+    int *lows = malloc(BENCH_INTERVALS * sizeof(int));
+    int *highs = malloc(BENCH_INTERVALS * sizeof(int));
+    struct interval_tree *tree = interval_tree_create();
+
+    for (int i = 0; i < BENCH_INTERVALS; i++) {
+        lows[i] = rand() % span;
+        highs[i] = lows[i] + rand() % 100;
+        interval_tree_insert(tree, lows[i], highs[i]);
+    }
+
+    long long tree_hits = 0;
+    long long scan_hits = 0;
+
+    double start = now_ns();
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        int low = (q * 7919LL) % span;
+        tree_hits += interval_tree_overlaps(tree, low, low + 50, NULL, NULL);
+    }
+    double tree_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        int low = (q * 7919LL) % span;
+        scan_hits += linear_overlaps(lows, highs, BENCH_INTERVALS, low, low + 50);
+    }
+    double scan_ns = now_ns() - start;
+
+    assert(tree_hits == scan_hits);
+
+    printf("    %d intervals, %d overlap queries: tree %.0f ns/query, linear scan %.0f ns/query\n",
+           BENCH_INTERVALS, BENCH_QUERIES, tree_ns / BENCH_QUERIES, scan_ns / BENCH_QUERIES);
+
+    interval_tree_free(tree->root);
+    free(tree);
+    free(highs);
+    free(lows);
+}
+
+int main() {
+    printf("Interval tree... ");
+    fflush(stdout);
+    struct interval_tree *tree = interval_tree_create();
+    int *lows = malloc(NUM_INSERTS * sizeof(int));
+    int *highs = malloc(NUM_INSERTS * sizeof(int));
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        lows[i] = rand() % (NUM_INSERTS * 10);
+        highs[i] = lows[i] + rand() % 50;
+        interval_tree_insert(tree, lows[i], highs[i]);
+    }
+
+    int bh = 0;
+    assert(validate_interval_tree(tree->root, &bh));
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = lows[i];
+        lows[i] = lows[j];
+        lows[j] = tmp;
+        tmp = highs[i];
+        highs[i] = highs[j];
+        highs[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        interval_tree_remove(tree, lows[i], highs[i]);
+        assert(validate_interval_tree(tree->root, &bh));
+    }
+
+    int remaining = NUM_INSERTS - NUM_REMOVES;
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        int low = rand() % (NUM_INSERTS * 10);
+        int high = low + rand() % 20;
+        int expected = linear_overlaps(lows + NUM_REMOVES, highs + NUM_REMOVES, remaining, low, high);
+        assert(interval_tree_overlaps(tree, low, high, NULL, NULL) == expected);
+        assert((interval_tree_search(tree, low, high) != NULL) == (expected > 0));
+        assert(interval_tree_stab(tree, low, NULL, NULL) ==
+               linear_overlaps(lows + NUM_REMOVES, highs + NUM_REMOVES, remaining, low, low));
+    }
+
+    export_tree_to_dot(tree, "intervaltree.dot");
+    printf("complete\n");
+
+    benchmark();
+
+    interval_tree_free(tree->root);
+    free(tree);
+    free(highs);
+    free(lows);
+
+    return 0;
+}
@@ -0,0 +1,509 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Intrusive red-black tree, in the spirit of the Linux kernel's rb_node.
+ *
+ * The node is embedded in the caller's own struct and holds nothing but the
+ * linkage: the color lives in the low bit of the parent pointer, so a node is
+ * exactly three words. The tree never allocates; callers walk down with their
+ * own inline comparisons, hook the node in with rb_link_node() and then let
+ * rb_insert_color() restore the red-black invariants.
+ */
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+struct rb_node {
+    uintptr_t parent_color;
+    struct rb_node *left;
+    struct rb_node *right;
+};
+
+struct rb_root {
+    struct rb_node *node;
+};
+
+_Static_assert(sizeof(struct rb_node) == 3 * sizeof(void *), "rb_node must be three words");
+_Static_assert(_Alignof(struct rb_node) >= 2, "rb_node alignment must leave the low bit free");
+
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+static inline struct rb_node *rb_parent(const struct rb_node *node) {
+    return (struct rb_node *) (node->parent_color & ~(uintptr_t) 1);
+}
+
+static inline int rb_color(const struct rb_node *node) {
+    return node->parent_color & 1;
+}
+
+/* NULL children count as black leaves */
+static inline int rb_is_red(const struct rb_node *node) {
+    return node && rb_color(node) == RB_RED;
+}
+
+static inline int rb_is_black(const struct rb_node *node) {
+    return !rb_is_red(node);
+}
+
+static inline void rb_set_parent(struct rb_node *node, struct rb_node *parent) {
+    node->parent_color = (uintptr_t) parent | rb_color(node);
+}
+
+static inline void rb_set_color(struct rb_node *node, int color) {
+    node->parent_color = (node->parent_color & ~(uintptr_t) 1) | color;
+}
+
+/* Hook a fresh red node into the slot found by the caller's descent */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **link) {
+    node->parent_color = (uintptr_t) parent | RB_RED;
+    node->left = node->right = NULL;
+    *link = node;
+}
+
+static inline void rb_change_child(struct rb_root *root, struct rb_node *parent,
+                                   struct rb_node *old, struct rb_node *new) {
+    if (!parent)
+        root->node = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+static void rb_left_rotate(struct rb_root *root, struct rb_node *x) {
+    struct rb_node *y = x->right;
+    struct rb_node *parent = rb_parent(x);
+
+    x->right = y->left;
+    if (y->left)
+        rb_set_parent(y->left, x);
+
+    rb_set_parent(y, parent);
+    rb_change_child(root, parent, x, y);
+
+    y->left = x;
+    rb_set_parent(x, y);
+}
+
+static void rb_right_rotate(struct rb_root *root, struct rb_node *y) {
+    struct rb_node *x = y->left;
+    struct rb_node *parent = rb_parent(y);
+
+    y->left = x->right;
+    if (x->right)
+        rb_set_parent(x->right, y);
+
+    rb_set_parent(x, parent);
+    rb_change_child(root, parent, y, x);
+
+    x->right = y;
+    rb_set_parent(y, x);
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *parent;
+
+    while ((parent = rb_parent(node)) && rb_is_red(parent)) {
+        /* A red parent is never the root, so the grandparent exists */
+        struct rb_node *grandparent = rb_parent(parent);
+
+        if (parent == grandparent->left) {
+            struct rb_node *uncle = grandparent->right;
+            if (rb_is_red(uncle)) {
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(uncle, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                node = grandparent;
+            } else {
+                if (node == parent->right) {
+                    node = parent;
+                    rb_left_rotate(root, node);
+                    parent = rb_parent(node);
+                }
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                rb_right_rotate(root, grandparent);
+            }
+        } else {
+            struct rb_node *uncle = grandparent->left;
+            if (rb_is_red(uncle)) {
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(uncle, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                node = grandparent;
+            } else {
+                if (node == parent->left) {
+                    node = parent;
+                    rb_right_rotate(root, node);
+                    parent = rb_parent(node);
+                }
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                rb_left_rotate(root, grandparent);
+            }
+        }
+    }
+    rb_set_color(root->node, RB_BLACK);
+}
+
+/*
+ * x may be NULL (a black leaf), so its parent is tracked separately rather
+ * than read back through x.
+ */
+static void rb_erase_color(struct rb_root *root, struct rb_node *x, struct rb_node *parent) {
+    while (x != root->node && rb_is_black(x)) {
+        if (x == parent->left) {
+            struct rb_node *sibling = parent->right;
+
+            if (rb_is_red(sibling)) {
+                rb_set_color(sibling, RB_BLACK);
+                rb_set_color(parent, RB_RED);
+                rb_left_rotate(root, parent);
+                sibling = parent->right;
+            }
+
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                rb_set_color(sibling, RB_RED);
+                x = parent;
+                parent = rb_parent(x);
+            } else {
+                if (rb_is_black(sibling->right)) {
+                    rb_set_color(sibling->left, RB_BLACK);
+                    rb_set_color(sibling, RB_RED);
+                    rb_right_rotate(root, sibling);
+                    sibling = parent->right;
+                }
+                rb_set_color(sibling, rb_color(parent));
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(sibling->right, RB_BLACK);
+                rb_left_rotate(root, parent);
+                x = root->node;
+                break;
+            }
+        } else {
+            struct rb_node *sibling = parent->left;
+
+            if (rb_is_red(sibling)) {
+                rb_set_color(sibling, RB_BLACK);
+                rb_set_color(parent, RB_RED);
+                rb_right_rotate(root, parent);
+                sibling = parent->left;
+            }
+
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                rb_set_color(sibling, RB_RED);
+                x = parent;
+                parent = rb_parent(x);
+            } else {
+                if (rb_is_black(sibling->left)) {
+                    rb_set_color(sibling->right, RB_BLACK);
+                    rb_set_color(sibling, RB_RED);
+                    rb_left_rotate(root, sibling);
+                    sibling = parent->left;
+                }
+                rb_set_color(sibling, rb_color(parent));
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(sibling->left, RB_BLACK);
+                rb_right_rotate(root, parent);
+                x = root->node;
+                break;
+            }
+        }
+    }
+
+    if (x)
+        rb_set_color(x, RB_BLACK);
+}
+
+static void rb_transplant(struct rb_root *root, struct rb_node *u, struct rb_node *v) {
+    struct rb_node *parent = rb_parent(u);
+    rb_change_child(root, parent, u, v);
+    if (v)
+        rb_set_parent(v, parent);
+}
+
+/* Unlink node from the tree; the memory still belongs to the caller */
+void rb_erase(struct rb_node *z, struct rb_root *root) {
+    struct rb_node *x;
+    struct rb_node *x_parent;
+    int original_color = rb_color(z);
+
+    if (!z->left) {
+        x = z->right;
+        x_parent = rb_parent(z);
+        rb_transplant(root, z, z->right);
+    } else if (!z->right) {
+        x = z->left;
+        x_parent = rb_parent(z);
+        rb_transplant(root, z, z->left);
+    } else {
+        struct rb_node *y = z->right;
+        while (y->left)
+            y = y->left;
+
+        original_color = rb_color(y);
+        x = y->right;
+
+        if (rb_parent(y) == z) {
+            x_parent = y;
+        } else {
+            x_parent = rb_parent(y);
+            rb_transplant(root, y, y->right);
+            y->right = z->right;
+            rb_set_parent(y->right, y);
+        }
+
+        rb_transplant(root, z, y);
+        y->left = z->left;
+        rb_set_parent(y->left, y);
+        rb_set_color(y, rb_color(z));
+    }
+
+    if (original_color == RB_BLACK)
+        rb_erase_color(root, x, x_parent);
+}
+
+struct rb_node *rb_first(const struct rb_root *root) {
+    struct rb_node *node = root->node;
+    if (!node)
+        return NULL;
+    while (node->left)
+        node = node->left;
+    return node;
+}
+
+struct rb_node *rb_last(const struct rb_root *root) {
+    struct rb_node *node = root->node;
+    if (!node)
+        return NULL;
+    while (node->right)
+        node = node->right;
+    return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return (struct rb_node *) node;
+    }
+
+    struct rb_node *parent;
+    while ((parent = rb_parent(node)) && node == parent->right)
+        node = parent;
+    return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return (struct rb_node *) node;
+    }
+
+    struct rb_node *parent;
+    while ((parent = rb_parent(node)) && node == parent->left)
+        node = parent;
+    return parent;
+}
+
+int validate_rb_intrusive(struct rb_node *node, struct rb_node *parent, int *black_height) {
+    if (node == NULL) {
+        *black_height = 1;
+        return 1;
+    }
+
+    if (rb_parent(node) != parent) {
+        fprintf(stderr, "Parent link violation at node %p\n", (void *) node);
+        return 0;
+    }
+
+    if (rb_is_red(node) && (rb_is_red(node->left) || rb_is_red(node->right))) {
+        fprintf(stderr, "Red-Red violation at node %p\n", (void *) node);
+        return 0;
+    }
+
+    int left_black_height = 0;
+    int right_black_height = 0;
+
+    if (!validate_rb_intrusive(node->left, node, &left_black_height))
+        return 0;
+    if (!validate_rb_intrusive(node->right, node, &right_black_height))
+        return 0;
+
+    if (left_black_height != right_black_height) {
+        fprintf(stderr, "Black-height violation at node %p (left height=%d, right height=%d)\n",
+                (void *) node, left_black_height, right_black_height);
+        return 0;
+    }
+
+    *black_height = left_black_height + (rb_color(node) == RB_BLACK ? 1 : 0);
+    return 1;
+}
+
+/* Example user: a timer keyed by expiry, with the tree linkage embedded */
+struct timer {
+    uint64_t expires;
+    int id;
+    struct rb_node node;
+};
+
+int timer_insert(struct rb_root *root, struct timer *timer) {
+    struct rb_node **link = &root->node;
+    struct rb_node *parent = NULL;
+
+    while (*link) {
+        struct timer *current = rb_entry(*link, struct timer, node);
+        parent = *link;
+        if (timer->expires < current->expires)
+            link = &(*link)->left;
+        else if (timer->expires > current->expires)
+            link = &(*link)->right;
+        else
+            return 0;
+    }
+
+    rb_link_node(&timer->node, parent, link);
+    rb_insert_color(&timer->node, root);
+    return 1;
+}
+
+struct timer *timer_search(struct rb_root *root, uint64_t expires) {
+    struct rb_node *node = root->node;
+    while (node) {
+        struct timer *current = rb_entry(node, struct timer, node);
+        if (expires < current->expires)
+            node = node->left;
+        else if (expires > current->expires)
+            node = node->right;
+        else
+            return current;
+    }
+    return NULL;
+}
+
+static void export_dot(FILE *fp, struct rb_node *node) {
+    if (!node)
+        return;
+
+    uint64_t key = rb_entry(node, struct timer, node)->expires;
+
+    fprintf(fp, "    \"%llu\" [label=\"%llu\", color=%s, fontcolor=%s, style=filled, fillcolor=%s];\n",
+            key,
+            key,
+            rb_is_red(node) ? "\"red\"" : "\"gray\"",
+            "white",
+            rb_is_red(node) ? "\"#ffcccc\"" : "\"#808080\"");
+
+    if (node->left) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", key, rb_entry(node->left, struct timer, node)->expires);
+        export_dot(fp, node->left);
+    } else {
+        fprintf(fp, "    \"nullL%llu\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", key);
+        fprintf(fp, "    \"%llu\" -> \"nullL%llu\";\n", key, key);
+    }
+
+    if (node->right) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", key, rb_entry(node->right, struct timer, node)->expires);
+        export_dot(fp, node->right);
+    } else {
+        fprintf(fp, "    \"nullR%llu\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", key);
+        fprintf(fp, "    \"%llu\" -> \"nullR%llu\";\n", key, key);
+    }
+}
+
+void export_tree_to_dot(struct rb_root *root, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "digraph IntrusiveRedBlackTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+
+    if (root->node)
+        export_dot(fp, root->node);
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#define NUM_REMOVES NUM_INSERTS / 2
+
+int main() {
+    printf("Intrusive red-black tree... ");
+    fflush(stdout);
+
+    struct rb_root root = {NULL};
+
+    /* All timers come from one block: the tree itself never allocates */
+    struct timer *timers = malloc(NUM_INSERTS * sizeof(struct timer));
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        timers[i].expires = rand() % (NUM_INSERTS * 10);
+        timers[i].id = i;
+        if (!timer_insert(&root, &timers[i]))
+            continue;
+        i++;
+    }
+
+    int bh = 0;
+    assert(validate_rb_intrusive(root.node, NULL, &bh));
+
+    /* Shuffle handles rather than the timers, which are linked in place */
+    struct timer **order = malloc(NUM_INSERTS * sizeof(struct timer *));
+    for (int i = 0; i < NUM_INSERTS; i++)
+        order[i] = &timers[i];
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        struct timer *tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        rb_erase(&order[i]->node, &root);
+        assert(validate_rb_intrusive(root.node, NULL, &bh));
+    }
+
+    for (int i = NUM_REMOVES; i < NUM_INSERTS; i++)
+        assert(timer_search(&root, order[i]->expires) == order[i]);
+
+    uint64_t prev = 0;
+    int count = 0;
+    for (struct rb_node *n = rb_first(&root); n; n = rb_next(n)) {
+        uint64_t expires = rb_entry(n, struct timer, node)->expires;
+        assert(count == 0 || prev < expires);
+        prev = expires;
+        count++;
+    }
+    assert(count == NUM_INSERTS - NUM_REMOVES);
+
+    export_tree_to_dot(&root, "rbtree_intrusive.dot");
+    printf("complete\n");
+
+    free(order);
+    free(timers);
+
+    return 0;
+}
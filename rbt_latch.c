@@ -0,0 +1,695 @@
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Latched red-black tree, modeled on the kernel's rb_tree_latch.
+ *
+ * Every element carries two copies of the tree linkage, one per tree. A
+ * single writer applies each insert or erase to tree 0 and then tree 1, and
+ * bumps a sequence counter before each half so that readers are always
+ * steered to the copy that is not being modified. Readers never take a lock:
+ * they pick a copy from the counter, descend it, and only go again if a write
+ * started meanwhile, in which case the other copy is already stable.
+ *
+ * Readers may walk a copy while the writer is rewriting it, so child pointers
+ * are always stored and loaded as single atomic words and every rotation
+ * rewrites its links in an order that cannot form a loop. Erased elements
+ * must not be reused or freed until no reader can still be looking at them.
+ */
+
+/*
+ * Every child link is written with release semantics, not just the one that
+ * first publishes a node: a reader may reach a node through a link set up
+ * later by a rotation and must still see the node fully initialised.
+ */
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+struct rb_node {
+    uintptr_t parent_color;
+    struct rb_node *left;
+    struct rb_node *right;
+};
+
+struct rb_root {
+    struct rb_node *node;
+};
+
+struct latch_tree_node {
+    struct rb_node node[2];
+};
+
+struct latch_tree_root {
+    unsigned seq;
+    struct rb_root tree[2];
+};
+
+/*
+ * less() orders two elements for insertion, comp() compares a lookup key
+ * against an element the way memcmp() would.
+ */
+struct latch_tree_ops {
+    int (*less)(struct latch_tree_node *a, struct latch_tree_node *b);
+    int (*comp)(const void *key, struct latch_tree_node *b);
+};
+
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+static inline struct rb_node *rb_parent(const struct rb_node *node) {
+    return (struct rb_node *) (node->parent_color & ~(uintptr_t) 1);
+}
+
+static inline int rb_color(const struct rb_node *node) {
+    return node->parent_color & 1;
+}
+
+static inline int rb_is_red(const struct rb_node *node) {
+    return node && rb_color(node) == RB_RED;
+}
+
+static inline int rb_is_black(const struct rb_node *node) {
+    return !rb_is_red(node);
+}
+
+static inline void rb_set_parent(struct rb_node *node, struct rb_node *parent) {
+    node->parent_color = (uintptr_t) parent | rb_color(node);
+}
+
+static inline void rb_set_color(struct rb_node *node, int color) {
+    node->parent_color = (node->parent_color & ~(uintptr_t) 1) | color;
+}
+
+static inline void rb_change_child(struct rb_root *root, struct rb_node *parent,
+                                   struct rb_node *old, struct rb_node *new) {
+    if (!parent)
+        rcu_assign_pointer(root->node, new);
+    else if (parent->left == old)
+        rcu_assign_pointer(parent->left, new);
+    else
+        rcu_assign_pointer(parent->right, new);
+}
+
+/*
+ * x->right is repointed before y->left takes x, so a reader sitting on y can
+ * never be sent back up to x and around again.
+ */
+static void rb_left_rotate(struct rb_root *root, struct rb_node *x) {
+    struct rb_node *y = x->right;
+    struct rb_node *parent = rb_parent(x);
+
+    rcu_assign_pointer(x->right, y->left);
+    if (y->left)
+        rb_set_parent(y->left, x);
+
+    rcu_assign_pointer(y->left, x);
+    rb_set_parent(y, parent);
+    rb_change_child(root, parent, x, y);
+    rb_set_parent(x, y);
+}
+
+static void rb_right_rotate(struct rb_root *root, struct rb_node *y) {
+    struct rb_node *x = y->left;
+    struct rb_node *parent = rb_parent(y);
+
+    rcu_assign_pointer(y->left, x->right);
+    if (x->right)
+        rb_set_parent(x->right, y);
+
+    rcu_assign_pointer(x->right, y);
+    rb_set_parent(x, parent);
+    rb_change_child(root, parent, y, x);
+    rb_set_parent(y, x);
+}
+
+static void rb_insert_color(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *parent;
+
+    while ((parent = rb_parent(node)) && rb_is_red(parent)) {
+        struct rb_node *grandparent = rb_parent(parent);
+
+        if (parent == grandparent->left) {
+            struct rb_node *uncle = grandparent->right;
+            if (rb_is_red(uncle)) {
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(uncle, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                node = grandparent;
+            } else {
+                if (node == parent->right) {
+                    node = parent;
+                    rb_left_rotate(root, node);
+                    parent = rb_parent(node);
+                }
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                rb_right_rotate(root, grandparent);
+            }
+        } else {
+            struct rb_node *uncle = grandparent->left;
+            if (rb_is_red(uncle)) {
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(uncle, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                node = grandparent;
+            } else {
+                if (node == parent->left) {
+                    node = parent;
+                    rb_right_rotate(root, node);
+                    parent = rb_parent(node);
+                }
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(grandparent, RB_RED);
+                rb_left_rotate(root, grandparent);
+            }
+        }
+    }
+    rb_set_color(root->node, RB_BLACK);
+}
+
+static void rb_erase_color(struct rb_root *root, struct rb_node *x, struct rb_node *parent) {
+    while (x != root->node && rb_is_black(x)) {
+        if (x == parent->left) {
+            struct rb_node *sibling = parent->right;
+
+            if (rb_is_red(sibling)) {
+                rb_set_color(sibling, RB_BLACK);
+                rb_set_color(parent, RB_RED);
+                rb_left_rotate(root, parent);
+                sibling = parent->right;
+            }
+
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                rb_set_color(sibling, RB_RED);
+                x = parent;
+                parent = rb_parent(x);
+            } else {
+                if (rb_is_black(sibling->right)) {
+                    rb_set_color(sibling->left, RB_BLACK);
+                    rb_set_color(sibling, RB_RED);
+                    rb_right_rotate(root, sibling);
+                    sibling = parent->right;
+                }
+                rb_set_color(sibling, rb_color(parent));
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(sibling->right, RB_BLACK);
+                rb_left_rotate(root, parent);
+                x = root->node;
+                break;
+            }
+        } else {
+            struct rb_node *sibling = parent->left;
+
+            if (rb_is_red(sibling)) {
+                rb_set_color(sibling, RB_BLACK);
+                rb_set_color(parent, RB_RED);
+                rb_right_rotate(root, parent);
+                sibling = parent->left;
+            }
+
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                rb_set_color(sibling, RB_RED);
+                x = parent;
+                parent = rb_parent(x);
+            } else {
+                if (rb_is_black(sibling->left)) {
+                    rb_set_color(sibling->right, RB_BLACK);
+                    rb_set_color(sibling, RB_RED);
+                    rb_left_rotate(root, sibling);
+                    sibling = parent->left;
+                }
+                rb_set_color(sibling, rb_color(parent));
+                rb_set_color(parent, RB_BLACK);
+                rb_set_color(sibling->left, RB_BLACK);
+                rb_right_rotate(root, parent);
+                x = root->node;
+                break;
+            }
+        }
+    }
+
+    if (x)
+        rb_set_color(x, RB_BLACK);
+}
+
+static void rb_transplant(struct rb_root *root, struct rb_node *u, struct rb_node *v) {
+    struct rb_node *parent = rb_parent(u);
+    rb_change_child(root, parent, u, v);
+    if (v)
+        rb_set_parent(v, parent);
+}
+
+static void rb_erase(struct rb_node *z, struct rb_root *root) {
+    struct rb_node *x;
+    struct rb_node *x_parent;
+    int original_color = rb_color(z);
+
+    if (!z->left) {
+        x = z->right;
+        x_parent = rb_parent(z);
+        rb_transplant(root, z, z->right);
+    } else if (!z->right) {
+        x = z->left;
+        x_parent = rb_parent(z);
+        rb_transplant(root, z, z->left);
+    } else {
+        struct rb_node *y = z->right;
+        while (y->left)
+            y = y->left;
+
+        original_color = rb_color(y);
+        x = y->right;
+
+        /*
+         * Give y its new children before it replaces z, so a reader that
+         * reaches y through z's old parent sees a complete subtree.
+         */
+        if (rb_parent(y) == z) {
+            x_parent = y;
+        } else {
+            x_parent = rb_parent(y);
+            rb_transplant(root, y, y->right);
+            rcu_assign_pointer(y->right, z->right);
+            rb_set_parent(y->right, y);
+        }
+
+        rcu_assign_pointer(y->left, z->left);
+        rb_set_parent(y->left, y);
+        rb_transplant(root, z, y);
+        rb_set_color(y, rb_color(z));
+    }
+
+    if (original_color == RB_BLACK)
+        rb_erase_color(root, x, x_parent);
+}
+
+static void latch_tree_insert_one(struct latch_tree_node *ltn, struct latch_tree_root *ltr,
+                                  int idx, const struct latch_tree_ops *ops) {
+    struct rb_root *root = &ltr->tree[idx];
+    struct rb_node **link = &root->node;
+    struct rb_node *node = &ltn->node[idx];
+    struct rb_node *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        struct latch_tree_node *current = container_of(parent, struct latch_tree_node, node[idx]);
+        if (ops->less(ltn, current))
+            link = &parent->left;
+        else
+            link = &parent->right;
+    }
+
+    /* Fully initialise the node before a reader can reach it */
+    node->parent_color = (uintptr_t) parent | RB_RED;
+    node->left = node->right = NULL;
+    rcu_assign_pointer(*link, node);
+    rb_insert_color(node, root);
+}
+
+/* Steer readers to the other copy; orders against the surrounding writes */
+static inline void latch_write_begin(struct latch_tree_root *ltr) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&ltr->seq, ltr->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Writer side: callers must serialise inserts and erases among themselves */
+void latch_tree_insert(struct latch_tree_node *ltn, struct latch_tree_root *ltr,
+                       const struct latch_tree_ops *ops) {
+    latch_write_begin(ltr);
+    latch_tree_insert_one(ltn, ltr, 0, ops);
+    latch_write_begin(ltr);
+    latch_tree_insert_one(ltn, ltr, 1, ops);
+}
+
+void latch_tree_erase(struct latch_tree_node *ltn, struct latch_tree_root *ltr) {
+    latch_write_begin(ltr);
+    rb_erase(&ltn->node[0], &ltr->tree[0]);
+    latch_write_begin(ltr);
+    rb_erase(&ltn->node[1], &ltr->tree[1]);
+}
+
+static struct latch_tree_node *latch_tree_find_one(const void *key, struct latch_tree_root *ltr,
+                                                   int idx, const struct latch_tree_ops *ops) {
+    struct rb_node *node = rcu_dereference(ltr->tree[idx].node);
+
+    while (node) {
+        struct latch_tree_node *ltn = container_of(node, struct latch_tree_node, node[idx]);
+        int c = ops->comp(key, ltn);
+        if (c < 0)
+            node = rcu_dereference(node->left);
+        else if (c > 0)
+            node = rcu_dereference(node->right);
+        else
+            return ltn;
+    }
+    return NULL;
+}
+
+/*
+ * Reader side, safe against one concurrent writer. The copy picked by the
+ * counter is stable unless a write begins during the descent, and then the
+ * retry lands on the copy that write has already finished.
+ */
+struct latch_tree_node *latch_tree_find(const void *key, struct latch_tree_root *ltr,
+                                        const struct latch_tree_ops *ops) {
+    struct latch_tree_node *ltn;
+    unsigned seq;
+
+    do {
+        seq = __atomic_load_n(&ltr->seq, __ATOMIC_ACQUIRE);
+        ltn = latch_tree_find_one(key, ltr, seq & 1, ops);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&ltr->seq, __ATOMIC_RELAXED));
+
+    return ltn;
+}
+
+int validate_latch_copy(struct rb_node *node, struct rb_node *parent, int *black_height) {
+    if (node == NULL) {
+        *black_height = 1;
+        return 1;
+    }
+
+    if (rb_parent(node) != parent) {
+        fprintf(stderr, "Parent link violation at node %p\n", (void *) node);
+        return 0;
+    }
+
+    if (rb_is_red(node) && (rb_is_red(node->left) || rb_is_red(node->right))) {
+        fprintf(stderr, "Red-Red violation at node %p\n", (void *) node);
+        return 0;
+    }
+
+    int left_black_height = 0;
+    int right_black_height = 0;
+
+    if (!validate_latch_copy(node->left, node, &left_black_height))
+        return 0;
+    if (!validate_latch_copy(node->right, node, &right_black_height))
+        return 0;
+
+    if (left_black_height != right_black_height) {
+        fprintf(stderr, "Black-height violation at node %p (left height=%d, right height=%d)\n",
+                (void *) node, left_black_height, right_black_height);
+        return 0;
+    }
+
+    *black_height = left_black_height + (rb_color(node) == RB_BLACK ? 1 : 0);
+    return 1;
+}
+
+/* Example user: a table of key/value entries indexed by the latch tree */
+struct entry {
+    uint64_t key;
+    uint64_t value;
+    struct latch_tree_node latch;
+};
+
+static int entry_less(struct latch_tree_node *a, struct latch_tree_node *b) {
+    return container_of(a, struct entry, latch)->key < container_of(b, struct entry, latch)->key;
+}
+
+static int entry_comp(const void *key, struct latch_tree_node *b) {
+    uint64_t k = *(const uint64_t *) key;
+    uint64_t other = container_of(b, struct entry, latch)->key;
+    return k < other ? -1 : k > other;
+}
+
+static const struct latch_tree_ops entry_ops = {
+    .less = entry_less,
+    .comp = entry_comp,
+};
+
+struct entry *entry_find(struct latch_tree_root *root, uint64_t key) {
+    struct latch_tree_node *ltn = latch_tree_find(&key, root, &entry_ops);
+    return ltn ? container_of(ltn, struct entry, latch) : NULL;
+}
+
+static void export_dot(FILE *fp, struct rb_node *node) {
+    if (!node)
+        return;
+
+    uint64_t key = container_of(node, struct entry, latch.node[0])->key;
+
+    fprintf(fp, "    \"%llu\" [label=\"%llu\", color=%s, fontcolor=%s, style=filled, fillcolor=%s];\n",
+            key,
+            key,
+            rb_is_red(node) ? "\"red\"" : "\"gray\"",
+            "white",
+            rb_is_red(node) ? "\"#ffcccc\"" : "\"#808080\"");
+
+    if (node->left) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", key, container_of(node->left, struct entry, latch.node[0])->key);
+        export_dot(fp, node->left);
+    }
+
+    if (node->right) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", key, container_of(node->right, struct entry, latch.node[0])->key);
+        export_dot(fp, node->right);
+    }
+}
+
+void export_tree_to_dot(struct latch_tree_root *root, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "digraph LatchedRedBlackTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+
+    if (root->tree[0].node)
+        export_dot(fp, root->tree[0].node);
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+/*
+ * Benchmark: readers look up keys while one writer keeps erasing and
+ * reinserting. Erased entries are recycled only after every reader has
+ * passed a quiescent point (finished a lookup) since the erase.
+ */
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS 100000
+#endif
+
+#ifndef BENCH_MAX_READERS
+#define BENCH_MAX_READERS 4
+#endif
+
+#ifndef BENCH_MS
+#define BENCH_MS 100
+#endif
+
+#define BENCH_BATCH 64
+
+struct bench_reader {
+    struct latch_tree_root *root;
+    unsigned long quiescent;
+    unsigned long lookups;
+    unsigned long misses;
+    int online;
+    char pad[64];
+};
+
+static int bench_stop;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *bench_reader_thread(void *arg) {
+    struct bench_reader *reader = arg;
+    uint64_t x = (uintptr_t) arg | 1;
+
+    while (!__atomic_load_n(&bench_stop, __ATOMIC_RELAXED)) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uint64_t key = x % BENCH_KEYS;
+
+        struct entry *e = entry_find(reader->root, key);
+        if (!e || e->key != key)
+            reader->misses++;
+        reader->lookups++;
+        __atomic_store_n(&reader->quiescent, reader->lookups, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&reader->online, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Wait until every reader has finished at least one lookup since now */
+static void bench_grace_period(struct bench_reader *readers, int n) {
+    unsigned long snapshot[BENCH_MAX_READERS];
+    for (int i = 0; i < n; i++)
+        snapshot[i] = __atomic_load_n(&readers[i].quiescent, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < n; i++) {
+        while (__atomic_load_n(&readers[i].online, __ATOMIC_ACQUIRE) &&
+               __atomic_load_n(&readers[i].quiescent, __ATOMIC_ACQUIRE) == snapshot[i])
+            sched_yield();
+    }
+}
+
+static void benchmark(void) {
+    /* One spare entry per key so each erase can be paired with a fresh insert */
+    struct entry *entries = malloc(2 * BENCH_KEYS * sizeof(struct entry));
+    struct entry **live = malloc(BENCH_KEYS * sizeof(struct entry *));
+    struct entry **spare = malloc(BENCH_KEYS * sizeof(struct entry *));
+    struct entry *retired[BENCH_BATCH];
+    struct latch_tree_root root = {0};
+
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        entries[i].key = i;
+        entries[i].value = i;
+        latch_tree_insert(&entries[i].latch, &root, &entry_ops);
+        live[i] = &entries[i];
+        spare[i] = &entries[BENCH_KEYS + i];
+    }
+
+    int spare_count = BENCH_KEYS;
+
+    for (int n = 1; n <= BENCH_MAX_READERS; n *= 2) {
+        struct bench_reader readers[BENCH_MAX_READERS] = {0};
+        pthread_t threads[BENCH_MAX_READERS];
+
+        bench_stop = 0;
+        for (int i = 0; i < n; i++) {
+            readers[i].root = &root;
+            readers[i].online = 1;
+            pthread_create(&threads[i], NULL, bench_reader_thread, &readers[i]);
+        }
+
+        uint64_t x = 88172645463325252ULL;
+        unsigned long writes = 0;
+        int retired_count = 0;
+        double start = now_ns();
+
+        while (now_ns() - start < BENCH_MS * 1e6) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            uint64_t key = x % BENCH_KEYS;
+
+            /*
+             * Replace the entry for key with a recycled one. The new entry
+             * goes in before the old one comes out, so the key never
+             * disappears from the readers' point of view.
+             */
+            struct entry *fresh = spare[--spare_count];
+            fresh->key = key;
+            fresh->value = writes;
+            latch_tree_insert(&fresh->latch, &root, &entry_ops);
+            latch_tree_erase(&live[key]->latch, &root);
+            retired[retired_count++] = live[key];
+            live[key] = fresh;
+            writes++;
+
+            if (retired_count == BENCH_BATCH) {
+                bench_grace_period(readers, n);
+                for (int i = 0; i < retired_count; i++)
+                    spare[spare_count++] = retired[i];
+                retired_count = 0;
+            }
+        }
+
+        double elapsed = now_ns() - start;
+        __atomic_store_n(&bench_stop, 1, __ATOMIC_RELAXED);
+
+        unsigned long lookups = 0;
+        unsigned long misses = 0;
+        for (int i = 0; i < n; i++) {
+            pthread_join(threads[i], NULL);
+            lookups += readers[i].lookups;
+            misses += readers[i].misses;
+        }
+
+        for (int i = 0; i < retired_count; i++)
+            spare[spare_count++] = retired[i];
+
+        /* Keys are only ever replaced, never absent, so nothing may miss */
+        assert(misses == 0);
+
+        printf("    %d reader(s): %.2f M lookups/s, writer %.2f M updates/s\n",
+               n, lookups / elapsed * 1e3, writes / elapsed * 1e3);
+    }
+
+    free(spare);
+    free(live);
+    free(entries);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#define NUM_REMOVES NUM_INSERTS / 2
+
+int main() {
+    printf("Latched red-black tree... ");
+    fflush(stdout);
+
+    struct latch_tree_root root = {0};
+    struct entry *entries = malloc(NUM_INSERTS * sizeof(struct entry));
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        uint64_t key = rand() % (NUM_INSERTS * 10);
+        if (entry_find(&root, key))
+            continue;
+        entries[i].key = key;
+        entries[i].value = i;
+        latch_tree_insert(&entries[i].latch, &root, &entry_ops);
+        i++;
+    }
+
+    struct entry **order = malloc(NUM_INSERTS * sizeof(struct entry *));
+    for (int i = 0; i < NUM_INSERTS; i++)
+        order[i] = &entries[i];
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        struct entry *tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    int bh = 0;
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        latch_tree_erase(&order[i]->latch, &root);
+        assert(validate_latch_copy(root.tree[0].node, NULL, &bh));
+        assert(validate_latch_copy(root.tree[1].node, NULL, &bh));
+        assert(entry_find(&root, order[i]->key) == NULL);
+    }
+
+    for (int i = NUM_REMOVES; i < NUM_INSERTS; i++)
+        assert(entry_find(&root, order[i]->key) == order[i]);
+
+    export_tree_to_dot(&root, "latchtree.dot");
+    printf("complete\n");
+
+    benchmark();
+
+    free(order);
+    free(entries);
+
+    return 0;
+}
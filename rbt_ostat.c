@@ -0,0 +1,573 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Order-statistics red-black tree.
+ *
+ * Same layout and algorithms as rbt.c, except every node also carries the
+ * number of nodes in its subtree. The rotations and the delete path keep that
+ * count current, which makes select (k-th smallest), rank and range counts
+ * single root-to-leaf walks instead of in-order scans.
+ */
+
+enum red_black_tree_node_color { TREE_NODE_RED,
+                                 TREE_NODE_BLACK };
+
+struct red_black_tree_node {
+    int data;
+    enum red_black_tree_node_color color;
+    int size;
+    struct red_black_tree_node *left;
+    struct red_black_tree_node *right;
+    struct red_black_tree_node *parent;
+};
+
+struct red_black_tree {
+    struct red_black_tree_node *root;
+};
+
+static inline int subtree_size(struct red_black_tree_node *node) {
+    return node ? node->size : 0;
+}
+
+static inline void update_size(struct red_black_tree_node *node) {
+    node->size = 1 + subtree_size(node->left) + subtree_size(node->right);
+}
+
+static inline int is_red(struct red_black_tree_node *node) {
+    return node && node->color == TREE_NODE_RED;
+}
+
+struct red_black_tree *red_black_tree_create(void) {
+    struct red_black_tree *tree = (struct red_black_tree *) malloc(sizeof(struct red_black_tree));
+    tree->root = NULL;
+    return tree;
+}
+
+struct red_black_tree_node *tree_find_min(struct red_black_tree_node *node) {
+    while (node->left != NULL) {
+        node = node->left;
+    }
+    return node;
+}
+
+void rb_transplant(struct red_black_tree *tree, struct red_black_tree_node *u, struct red_black_tree_node *v) {
+    if (u->parent == NULL)
+        tree->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+
+    if (v)
+        v->parent = u->parent;
+}
+
+void left_rotate(struct red_black_tree *tree, struct red_black_tree_node *x) {
+    struct red_black_tree_node *y = x->right;
+    x->right = y->left;
+
+    if (y->left)
+        y->left->parent = x;
+
+    y->parent = x->parent;
+    if (!x->parent)
+        tree->root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+
+    y->left = x;
+    x->parent = y;
+
+    /* y takes over x's subtree, x shrinks to what is left below it */
+    y->size = x->size;
+    update_size(x);
+}
+
+void right_rotate(struct red_black_tree *tree, struct red_black_tree_node *y) {
+    struct red_black_tree_node *x = y->left;
+    y->left = x->right;
+    if (x->right)
+        x->right->parent = y;
+
+    x->parent = y->parent;
+    if (!y->parent)
+        tree->root = x;
+    else if (y == y->parent->right)
+        y->parent->right = x;
+    else
+        y->parent->left = x;
+
+    x->right = y;
+    y->parent = x;
+
+    x->size = y->size;
+    update_size(y);
+}
+
+/*
+ * x may be NULL (a black leaf), so its parent is passed in explicitly
+ * instead of being read back through x.
+ */
+void fix_deletion(struct red_black_tree *tree, struct red_black_tree_node *x,
+                  struct red_black_tree_node *parent) {
+    while (x != tree->root && !is_red(x)) {
+        struct red_black_tree_node *sibling;
+
+        if (x == parent->left) {
+            sibling = parent->right;
+
+            if (is_red(sibling)) {
+                sibling->color = TREE_NODE_BLACK;
+                parent->color = TREE_NODE_RED;
+                left_rotate(tree, parent);
+                sibling = parent->right;
+            }
+
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!is_red(sibling->right)) {
+                    sibling->left->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    right_rotate(tree, sibling);
+                    sibling = parent->right;
+                }
+
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->right)
+                    sibling->right->color = TREE_NODE_BLACK;
+                left_rotate(tree, parent);
+                x = tree->root;
+            }
+        } else {
+            sibling = parent->left;
+
+            if (is_red(sibling)) {
+                sibling->color = TREE_NODE_BLACK;
+                parent->color = TREE_NODE_RED;
+                right_rotate(tree, parent);
+                sibling = parent->left;
+            }
+
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->color = TREE_NODE_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!is_red(sibling->left)) {
+                    sibling->right->color = TREE_NODE_BLACK;
+                    sibling->color = TREE_NODE_RED;
+                    left_rotate(tree, sibling);
+                    sibling = parent->left;
+                }
+
+                sibling->color = parent->color;
+                parent->color = TREE_NODE_BLACK;
+                if (sibling->left)
+                    sibling->left->color = TREE_NODE_BLACK;
+                right_rotate(tree, parent);
+                x = tree->root;
+            }
+        }
+    }
+
+    if (x)
+        x->color = TREE_NODE_BLACK;
+}
+
+int validate_rbtree(struct red_black_tree_node *node, int *black_height) {
+    if (node == NULL) {
+        *black_height = 1;
+        return 1;
+    }
+
+    if (node->color == TREE_NODE_RED) {
+        if ((node->left && node->left->color == TREE_NODE_RED) ||
+            (node->right && node->right->color == TREE_NODE_RED)) {
+            fprintf(stderr, "Red-Red violation at node %d\n", node->data);
+            return 0;
+        }
+    }
+
+    if (node->size != 1 + subtree_size(node->left) + subtree_size(node->right)) {
+        fprintf(stderr, "Size violation at node %d (size=%d, left=%d, right=%d)\n",
+                node->data, node->size, subtree_size(node->left), subtree_size(node->right));
+        return 0;
+    }
+
+    int left_black_height = 0;
+    int right_black_height = 0;
+
+    if (!validate_rbtree(node->left, &left_black_height))
+        return 0;
+    if (!validate_rbtree(node->right, &right_black_height))
+        return 0;
+
+    if (left_black_height != right_black_height) {
+        fprintf(stderr, "Black-height violation at node %d (left height=%d, right height=%d)\n",
+                node->data, left_black_height, right_black_height);
+        return 0;
+    }
+
+    *black_height = left_black_height + (node->color == TREE_NODE_BLACK ? 1 : 0);
+    return 1;
+}
+
+void rb_delete(struct red_black_tree *tree, struct red_black_tree_node *z) {
+    struct red_black_tree_node *y = z;
+    struct red_black_tree_node *x = NULL;
+    struct red_black_tree_node *x_parent = NULL;
+    enum red_black_tree_node_color y_original_color = y->color;
+
+    if (z->left && z->right)
+        y = tree_find_min(z->right);
+
+    /* y is the node that physically leaves its spot: shrink its ancestors */
+    for (struct red_black_tree_node *p = y->parent; p; p = p->parent)
+        p->size--;
+
+    if (z->left == NULL) {
+        x = z->right;
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->right);
+    } else if (z->right == NULL) {
+        x = z->left;
+        x_parent = z->parent;
+        rb_transplant(tree, z, z->left);
+    } else {
+        y_original_color = y->color;
+        x = y->right;
+
+        if (y->parent != z) {
+            x_parent = y->parent;
+            rb_transplant(tree, y, y->right);
+            y->right = z->right;
+            if (y->right)
+                y->right->parent = y;
+        } else {
+            x_parent = y;
+        }
+
+        rb_transplant(tree, z, y);
+        y->left = z->left;
+        if (y->left)
+            y->left->parent = y;
+        y->color = z->color;
+        y->size = z->size;
+    }
+
+    if (y_original_color == TREE_NODE_BLACK) {
+        fix_deletion(tree, x, x_parent);
+    }
+
+    free(z);
+}
+
+struct red_black_tree_node *tree_search(struct red_black_tree_node *root, int data) {
+    while (root && root->data != data) {
+        if (data < root->data)
+            root = root->left;
+        else
+            root = root->right;
+    }
+    return root;
+}
+
+void red_black_tree_remove(struct red_black_tree *tree, int data) {
+    struct red_black_tree_node *node = tree_search(tree->root, data);
+    if (node)
+        rb_delete(tree, node);
+}
+
+void red_black_tree_free(struct red_black_tree_node *root) {
+    if (root == NULL)
+        return;
+    red_black_tree_free(root->left);
+    red_black_tree_free(root->right);
+    root->left = root->right = NULL;
+    free(root);
+}
+
+void fix_insertion(struct red_black_tree *tree, struct red_black_tree_node *node) {
+    while (node != tree->root && node->parent->color == TREE_NODE_RED) {
+        struct red_black_tree_node *parent = node->parent;
+        struct red_black_tree_node *grandparent = parent->parent;
+
+        if (parent == grandparent->left) {
+            struct red_black_tree_node *uncle = grandparent->right;
+            if (uncle && uncle->color == TREE_NODE_RED) {
+                parent->color = TREE_NODE_BLACK;
+                uncle->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                node = grandparent;
+            } else {
+                if (node == parent->right) {
+                    node = parent;
+                    left_rotate(tree, node);
+                    parent = node->parent;
+                }
+                parent->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                right_rotate(tree, grandparent);
+            }
+        } else {
+            struct red_black_tree_node *uncle = grandparent->left;
+            if (uncle && uncle->color == TREE_NODE_RED) {
+                parent->color = TREE_NODE_BLACK;
+                uncle->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                node = grandparent;
+            } else {
+                if (node == parent->left) {
+                    node = parent;
+                    right_rotate(tree, node);
+                    parent = node->parent;
+                }
+                parent->color = TREE_NODE_BLACK;
+                grandparent->color = TREE_NODE_RED;
+                left_rotate(tree, grandparent);
+            }
+        }
+    }
+    tree->root->color = TREE_NODE_BLACK;
+}
+
+void red_black_tree_insert(struct red_black_tree *tree, int data) {
+    struct red_black_tree_node *new_node = malloc(sizeof(struct red_black_tree_node));
+    new_node->data = data;
+    new_node->left = NULL;
+    new_node->right = NULL;
+    new_node->color = TREE_NODE_RED;
+    new_node->size = 1;
+
+    if (tree->root == NULL) {
+        new_node->color = TREE_NODE_BLACK;
+        new_node->parent = NULL;
+        tree->root = new_node;
+        return;
+    }
+
+    /* Every node on the descent path gains one descendant */
+    struct red_black_tree_node *current = tree->root;
+    struct red_black_tree_node *parent = NULL;
+    while (current != NULL) {
+        parent = current;
+        current->size++;
+        if (data < current->data)
+            current = current->left;
+        else
+            current = current->right;
+    }
+
+    new_node->parent = parent;
+    if (data < parent->data)
+        parent->left = new_node;
+    else
+        parent->right = new_node;
+
+    fix_insertion(tree, new_node);
+}
+
+int red_black_tree_size(struct red_black_tree *tree) {
+    return subtree_size(tree->root);
+}
+
+/* k-th smallest key, counting from 0; NULL when k is out of range */
+struct red_black_tree_node *red_black_tree_select(struct red_black_tree *tree, int k) {
+    struct red_black_tree_node *node = tree->root;
+    while (node) {
+        int left_size = subtree_size(node->left);
+        if (k < left_size) {
+            node = node->left;
+        } else if (k > left_size) {
+            k -= left_size + 1;
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Number of keys below data, or at or below it when inclusive is set */
+static int count_below(struct red_black_tree_node *node, int data, int inclusive) {
+    int count = 0;
+    while (node) {
+        if (data < node->data || (!inclusive && data == node->data)) {
+            node = node->left;
+        } else {
+            count += subtree_size(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return count;
+}
+
+/* Number of keys strictly less than data, i.e. the index select() would use */
+int red_black_tree_rank(struct red_black_tree *tree, int data) {
+    return count_below(tree->root, data, 0);
+}
+
+/* Number of keys in the closed range [lo, hi] */
+int red_black_tree_count_range(struct red_black_tree *tree, int lo, int hi) {
+    if (lo > hi)
+        return 0;
+    return count_below(tree->root, hi, 1) - count_below(tree->root, lo, 0);
+}
+
+#define ANSI_RED "\033[31m"
+#define ANSI_RESET "\033[0m"
+#define ANSI_BOLD "\033[1m"
+
+#define RBT_RED ANSI_RED "R" ANSI_RESET
+#define RBT_BLACK ANSI_BOLD "B" ANSI_RESET
+
+void print_inorder(struct red_black_tree_node *node) {
+    if (node == NULL)
+        return;
+    print_inorder(node->left);
+    printf("(%d,%s,%d) ", node->data, node->color == TREE_NODE_RED ? RBT_RED : RBT_BLACK, node->size);
+    print_inorder(node->right);
+}
+
+void export_dot(FILE *fp, struct red_black_tree_node *node) {
+    if (!node)
+        return;
+
+    fprintf(fp, "    \"%d\" [label=\"%d\\n(%d)\", color=%s, fontcolor=%s, style=filled, fillcolor=%s];\n",
+            node->data,
+            node->data,
+            node->size,
+            node->color == TREE_NODE_RED ? "\"red\"" : "\"gray\"",
+            "white",
+            node->color == TREE_NODE_RED ? "\"#ffcccc\"" : "\"#808080\"");
+
+    if (node->left) {
+        fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->left->data);
+        export_dot(fp, node->left);
+    } else {
+        fprintf(fp, "    \"nullL%d\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", node->data);
+        fprintf(fp, "    \"%d\" -> \"nullL%d\";\n", node->data, node->data);
+    }
+
+    if (node->right) {
+        fprintf(fp, "    \"%d\" -> \"%d\";\n", node->data, node->right->data);
+        export_dot(fp, node->right);
+    } else {
+        fprintf(fp, "    \"nullR%d\" [shape=circle, label=\"\", fontcolor=\"black\"];\n", node->data);
+        fprintf(fp, "    \"%d\" -> \"nullR%d\";\n", node->data, node->data);
+    }
+}
+
+void export_tree_to_dot(struct red_black_tree *tree, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+
+    fprintf(fp, "digraph OrderStatisticTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+
+    if (tree->root)
+        export_dot(fp, tree->root);
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#define NUM_REMOVES NUM_INSERTS / 2
+
+int main() {
+    printf("Order-statistic red-black tree... ");
+    fflush(stdout);
+    struct red_black_tree *tree = red_black_tree_create();
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+
+        int duplicate = 0;
+        for (int j = 0; j < i; j++) {
+            if (values[j] == value) {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (duplicate)
+            continue;
+
+        values[i++] = value;
+        red_black_tree_insert(tree, value);
+    }
+
+    int bh = 0;
+    assert(validate_rbtree(tree->root, &bh));
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        red_black_tree_remove(tree, values[i]);
+        assert(validate_rbtree(tree->root, &bh));
+    }
+
+    /* Check the queries against a sorted copy of what is left */
+    int remaining = NUM_INSERTS - NUM_REMOVES;
+    int *sorted = malloc(remaining * sizeof(int));
+    for (int i = 0; i < remaining; i++) {
+        int value = values[NUM_REMOVES + i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+
+    assert(red_black_tree_size(tree) == remaining);
+    assert(red_black_tree_select(tree, remaining) == NULL);
+    for (int k = 0; k < remaining; k++) {
+        assert(red_black_tree_select(tree, k)->data == sorted[k]);
+        assert(red_black_tree_rank(tree, sorted[k]) == k);
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        int lo = rand() % (NUM_INSERTS * 4);
+        int hi = lo + rand() % NUM_INSERTS;
+        int expected = 0;
+        for (int k = 0; k < remaining; k++)
+            expected += sorted[k] >= lo && sorted[k] <= hi;
+        assert(red_black_tree_count_range(tree, lo, hi) == expected);
+    }
+
+    export_tree_to_dot(tree, "rbtree_ostat.dot");
+    printf("complete\n");
+
+    red_black_tree_free(tree->root);
+    free(tree);
+    free(sorted);
+    free(values);
+
+    return 0;
+}
@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "arena.h"
+#include "bench_util.h"
+
 struct splay_node {
     uint64_t key;
     struct splay_node *left;
@@ -11,12 +14,37 @@ struct splay_node {
     struct splay_node *parent;
 };
 
+/*
+ * How splay_search restructures the tree on a hit:
+ *   SPLAY_FULL      splay the node to the root (the classic behaviour)
+ *   SPLAY_SEMI      semi-splay: each zig-zig step lifts the parent instead of
+ *                   the node, roughly halving its depth without making it root
+ *   SPLAY_DEPTH     splay only when the node lies deeper than
+ *                   policy_param * log2(size)
+ *   SPLAY_EVERY_K   splay only on every policy_param-th search
+ * Accesses that do not splay write nothing, except that SPLAY_EVERY_K counts
+ * its searches. Insert and delete always splay.
+ */
+enum splay_policy {
+    SPLAY_FULL,
+    SPLAY_SEMI,
+    SPLAY_DEPTH,
+    SPLAY_EVERY_K,
+};
+
 struct splay_tree {
     struct splay_node *root;
+    size_t size;
+    enum splay_policy policy;
+    unsigned policy_param;
+    unsigned long accesses; /* searches so far, counted only under SPLAY_EVERY_K */
+    unsigned long rotations;
+    struct arena *arena; /* node storage for splay_insert, or NULL to use malloc */
 };
 
 void rotate_left(struct splay_tree *tree, struct splay_node *x) {
     struct splay_node *y = x->right;
+    tree->rotations++;
     x->right = y->left;
     if (y->left)
         y->left->parent = x;
@@ -33,6 +61,7 @@ void rotate_left(struct splay_tree *tree, struct splay_node *x) {
 
 void rotate_right(struct splay_tree *tree, struct splay_node *y) {
     struct splay_node *x = y->left;
+    tree->rotations++;
     y->left = x->right;
     if (x->right)
         x->right->parent = y;
@@ -103,12 +132,72 @@ void splay_verify(struct splay_tree *tree) {
     splay_verify_node(tree->root, NULL, NULL);
 }
 
+/* Rotate the edge between x and its parent */
+static void rotate_up(struct splay_tree *tree, struct splay_node *x) {
+    if (x->parent->left == x)
+        rotate_right(tree, x->parent);
+    else
+        rotate_left(tree, x->parent);
+}
+
+/*
+ * Semi-splay: on a zig-zig step only the parent is rotated up, and the walk
+ * continues from the parent; zig-zag steps are the usual double rotation.
+ * The path to x is about halved and x ends near, not at, the root.
+ */
+void semi_splay(struct splay_tree *tree, struct splay_node *x) {
+    while (x->parent && x->parent->parent) {
+        struct splay_node *y = x->parent;
+        struct splay_node *z = y->parent;
+
+        if ((z->left == y) == (y->left == x)) {
+            rotate_up(tree, y);
+            x = y;
+        } else {
+            rotate_up(tree, x);
+            rotate_up(tree, x);
+        }
+    }
+}
+
+void splay_set_policy(struct splay_tree *tree, enum splay_policy policy, unsigned param) {
+    tree->policy = policy;
+    tree->policy_param = param;
+}
+
+static int floor_log2(size_t n) {
+    return n ? 63 - __builtin_clzll(n) : 0;
+}
+
+/* Restructure after a search reached x at the given depth, as the policy says */
+static void splay_access(struct splay_tree *tree, struct splay_node *x, int depth) {
+    switch (tree->policy) {
+    case SPLAY_FULL:
+        splay(tree, x);
+        break;
+    case SPLAY_SEMI:
+        semi_splay(tree, x);
+        break;
+    case SPLAY_DEPTH:
+        if (depth > (int) tree->policy_param * floor_log2(tree->size))
+            splay(tree, x);
+        break;
+    case SPLAY_EVERY_K:
+        tree->accesses++;
+        if (tree->policy_param <= 1 || tree->accesses % tree->policy_param == 0)
+            splay(tree, x);
+        break;
+    }
+}
+
 struct splay_node *splay_search(struct splay_tree *tree, uint64_t key) {
     struct splay_node *x = tree->root;
     struct splay_node *last = NULL;
+    int depth = -1;
 
     while (x) {
         last = x;
+        depth++;
         if (key == x->key)
             break;
         else if (key < x->key)
@@ -118,7 +207,7 @@ struct splay_node *splay_search(struct splay_tree *tree, uint64_t key) {
     }
 
     if (last)
-        splay(tree, last);
+        splay_access(tree, last, depth);
 
     if (x && x->key == key)
         return x;
@@ -126,42 +215,147 @@ struct splay_node *splay_search(struct splay_tree *tree, uint64_t key) {
         return NULL;
 }
 
-void splay_insert(struct splay_tree *tree, uint64_t key) {
+#ifndef SEARCH_BATCH_LANES
+#define SEARCH_BATCH_LANES 16
+#endif
+
+#ifndef SEARCH_BATCH_CHUNK
+#define SEARCH_BATCH_CHUNK 256
+#endif
+
+/*
+ * Batched splay_search. The keys are taken SEARCH_BATCH_CHUNK at a time. The
+ * descents for a chunk run first, up to SEARCH_BATCH_LANES at a time in
+ * lockstep with a prefetch of each lane's next node, so their cache misses
+ * overlap; every descent sees the tree as it was at the start of its chunk.
+ * Afterwards each accessed node (or the last node on a miss) goes through
+ * the tree's policy in input order, as with splay_search; SPLAY_DEPTH judges
+ * it by its depth in the tree the descent saw.
+ */
+void splay_search_batch(struct splay_tree *tree, const uint64_t *keys, size_t n,
+                        struct splay_node **results) {
+    struct {
+        struct splay_node *node;
+        struct splay_node *last;
+        size_t idx;
+        int depth; /* of node */
+    } lanes[SEARCH_BATCH_LANES];
+    struct splay_node *last[SEARCH_BATCH_CHUNK];
+    int depth[SEARCH_BATCH_CHUNK];
+
+    for (size_t base = 0; base < n; base += SEARCH_BATCH_CHUNK) {
+        size_t count = n - base < SEARCH_BATCH_CHUNK ? n - base : SEARCH_BATCH_CHUNK;
+        size_t next = 0;
+        int active = 0;
+
+        while (active < SEARCH_BATCH_LANES && next < count) {
+            lanes[active].node = tree->root;
+            lanes[active].last = NULL;
+            lanes[active].depth = 0;
+            lanes[active++].idx = next++;
+        }
+
+        while (active) {
+            for (int j = 0; j < active;) {
+                struct splay_node *x = lanes[j].node;
+                uint64_t key = keys[base + lanes[j].idx];
+
+                if (!x || x->key == key) {
+                    results[base + lanes[j].idx] = x;
+                    last[lanes[j].idx] = x ? x : lanes[j].last;
+                    depth[lanes[j].idx] = x ? lanes[j].depth : lanes[j].depth - 1;
+                    if (next < count) {
+                        lanes[j].node = tree->root;
+                        lanes[j].last = NULL;
+                        lanes[j].depth = 0;
+                        lanes[j++].idx = next++;
+                    } else {
+                        lanes[j] = lanes[--active];
+                    }
+                    continue;
+                }
+
+                lanes[j].last = x;
+                x = key < x->key ? x->left : x->right;
+                __builtin_prefetch(x);
+                lanes[j].depth++;
+                lanes[j++].node = x;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (last[i])
+                splay_access(tree, last[i], depth[i]);
+        }
+    }
+}
+
+/*
+ * Link a caller-allocated node whose key is set and splay it to the root. If
+ * the key is already present, that node is splayed and returned instead and
+ * n is left untouched.
+ */
+struct splay_node *splay_insert_node(struct splay_tree *tree, struct splay_node *n) {
     struct splay_node *z = tree->root;
     struct splay_node *p = NULL;
 
     while (z) {
         p = z;
-        if (key < z->key)
+        if (n->key < z->key)
             z = z->left;
-        else if (key > z->key)
+        else if (n->key > z->key)
             z = z->right;
         else {
             splay(tree, z);
-            return;
+            return z;
         }
     }
 
-    struct splay_node *n = malloc(sizeof(*n));
-    n->key = key;
     n->left = n->right = NULL;
     n->parent = p;
+    tree->size++;
 
     if (!p)
         tree->root = n;
-    else if (key < p->key)
+    else if (n->key < p->key)
         p->left = n;
     else
         p->right = n;
 
     splay(tree, n);
+    return n;
+}
+
+/* Start an empty tree whose nodes come from a private arena; see arena.h for the flags */
+void splay_tree_init_arena(struct splay_tree *tree, unsigned arena_flags) {
+    *tree = (struct splay_tree){.arena = malloc(sizeof(struct arena))};
+    arena_init(tree->arena, arena_flags);
+}
+
+static void splay_free_node(struct splay_tree *tree, struct splay_node *n) {
+    if (tree->arena)
+        arena_free(tree->arena, n, sizeof(*n));
+    else
+        free(n);
+}
+
+void splay_insert(struct splay_tree *tree, uint64_t key) {
+    struct splay_node *n = tree->arena ? arena_alloc(tree->arena, sizeof(*n)) : malloc(sizeof(*n));
+    n->key = key;
+    if (splay_insert_node(tree, n) != n)
+        splay_free_node(tree, n);
 }
 
 void splay_delete(struct splay_tree *tree, uint64_t key) {
-    struct splay_node *node = splay_search(tree, key);
-    if (!node || node->key != key)
+    struct splay_node *node = tree->root;
+    while (node && node->key != key)
+        node = key < node->key ? node->left : node->right;
+    if (!node)
         return;
 
+    splay(tree, node);
+    tree->size--;
+
     /* Node now at root */
     if (!node->left) {
         tree->root = node->right;
@@ -185,35 +379,101 @@ void splay_delete(struct splay_tree *tree, uint64_t key) {
         tree->root = max;
     }
 
-    free(node);
+    splay_free_node(tree, node);
 }
 
-void export_splay_dot(FILE *fp, struct splay_node *node) {
-    if (!node)
-        return;
+static struct splay_node *splay_subtree_min(struct splay_node *node) {
+    while (node->left)
+        node = node->left;
+    return node;
+}
+
+/* In-order successor within the subtree at root, by parent pointers */
+static struct splay_node *splay_subtree_next(struct splay_node *root, struct splay_node *node) {
+    if (node->right)
+        return splay_subtree_min(node->right);
+    while (node != root && node == node->parent->right)
+        node = node->parent;
+    return node == root ? NULL : node->parent;
+}
+
+/* Node with the smallest key >= key, or NULL; unlike splay_search it leaves the tree as it is */
+struct splay_node *splay_lower_bound(struct splay_tree *tree, uint64_t key) {
+    struct splay_node *node = tree->root, *bound = NULL;
+    while (node) {
+        if (node->key < key) {
+            node = node->right;
+        } else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return bound;
+}
+
+struct splay_node *splay_next(struct splay_tree *tree, struct splay_node *node) {
+    return splay_subtree_next(tree->root, node);
+}
+
+static void export_splay_dot_node(FILE *fp, struct splay_node *node) {
     fprintf(fp, "    \"%llu\" [label=\"%llu\"];\n", node->key, node->key);
     if (node->left) {
         fprintf(fp, "    \"%llu\" -> \"%llu\";\n", node->key, node->left->key);
-        export_splay_dot(fp, node->left);
     } else {
         fprintf(fp, "    \"nullL%llu\" [shape=circle, label=\"\"];\n", node->key);
         fprintf(fp, "    \"%llu\" -> \"nullL%llu\";\n", node->key, node->key);
     }
     if (node->right) {
         fprintf(fp, "    \"%llu\" -> \"%llu\";\n", node->key, node->right->key);
-        export_splay_dot(fp, node->right);
     } else {
         fprintf(fp, "    \"nullR%llu\" [shape=circle, label=\"\"];\n", node->key);
         fprintf(fp, "    \"%llu\" -> \"nullR%llu\";\n", node->key, node->key);
     }
 }
 
-void splay_tree_free(struct splay_node *root) {
-    if (!root)
+/*
+ * Sorted inserts leave a splay tree as a path n deep, so the export walks
+ * the subtree in-order by parent pointers instead of recursing.
+ */
+void export_splay_dot(FILE *fp, struct splay_node *node) {
+    if (!node)
         return;
-    splay_tree_free(root->left);
-    splay_tree_free(root->right);
-    free(root);
+    for (struct splay_node *n = splay_subtree_min(node); n; n = splay_subtree_next(node, n))
+        export_splay_dot_node(fp, n);
+}
+
+/*
+ * Teardown without recursion, for the same reason: rotate left children up
+ * until the current node has none, then free it and go right. A single
+ * linear pass in constant space.
+ */
+void splay_tree_free(struct splay_node *root) {
+    while (root) {
+        struct splay_node *left = root->left;
+
+        if (left) {
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        } else {
+            struct splay_node *right = root->right;
+            free(root);
+            root = right;
+        }
+    }
+}
+
+/* Free every node, all at once for an arena tree, and leave the tree empty */
+void splay_tree_clear(struct splay_tree *tree) {
+    if (tree->arena) {
+        arena_destroy(tree->arena);
+        free(tree->arena);
+        tree->arena = NULL;
+    } else {
+        splay_tree_free(tree->root);
+    }
+    tree->root = NULL;
+    tree->size = 0;
 }
 
 void export_splay_tree_to_dot(struct splay_tree *tree, const char *filename) {
@@ -237,12 +497,89 @@ void export_splay_tree_to_dot(struct splay_tree *tree, const char *filename) {
 
 #define NUM_REMOVES (NUM_INSERTS / 2)
 
+/*
+ * n accesses to keys 0 .. nkeys - 1 with Zipf (s = 1) distributed ranks,
+ * drawn by inverse CDF; a random permutation scatters the hot keys through
+ * the key space. The benchmarks here and in the files including this one
+ * share it.
+ */
+static __attribute__((unused)) void zipf_trace(uint64_t *trace, size_t n, size_t nkeys) {
+    double *cdf = malloc(nkeys * sizeof(double));
+    uint64_t *perm = malloc(nkeys * sizeof(uint64_t));
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+    double sum = 0;
+
+    for (size_t i = 0; i < nkeys; i++) {
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+        perm[i] = i;
+    }
+    for (size_t i = nkeys - 1; i > 0; i--) {
+        size_t j = xorshift64(&rng) % (i + 1);
+        uint64_t tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        double u = (xorshift64(&rng) >> 11) * 0x1.0p-53 * sum;
+        size_t lo = 0, hi = nkeys - 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        trace[i] = perm[lo];
+    }
+
+    free(perm);
+    free(cdf);
+}
+
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef SPLAY_NO_MAIN
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 16)
+#endif
+
+#ifndef BENCH_ACCESSES
+#define BENCH_ACCESSES (1 << 19)
+#endif
+
+#ifndef DEGENERATE_KEYS
+#define DEGENERATE_KEYS (1 << 21)
+#endif
+
+static void benchmark_policy(const char *name, const uint64_t *trace, enum splay_policy policy, unsigned param) {
+    struct splay_tree tree = {0};
+
+    for (int i = 0; i < BENCH_KEYS; i++)
+        splay_insert(&tree, (i * 0x9e3779b97f4a7c15ULL) % BENCH_KEYS);
+    splay_set_policy(&tree, policy, param);
+    tree.rotations = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ACCESSES / 2; i++)
+        splay_search(&tree, trace[i]);
+    unsigned long first_half = tree.rotations;
+    for (int i = BENCH_ACCESSES / 2; i < BENCH_ACCESSES; i++)
+        splay_search(&tree, trace[i]);
+    double elapsed = now_ns() - start;
+
+    /* The second half of the trace shows the steady state */
+    printf("    %-14s %.1f ns/access, %.2f rotations/access (%.2f once warm)\n",
+           name, elapsed / BENCH_ACCESSES, (double) tree.rotations / BENCH_ACCESSES,
+           (double) (tree.rotations - first_half) / (BENCH_ACCESSES - BENCH_ACCESSES / 2));
+    splay_tree_free(tree.root);
+}
+
 int main() {
     printf("Splay tree... ");
     fflush(stdout);
 
-    struct splay_tree *tree = malloc(sizeof(struct splay_tree));
-    tree->root = NULL;
+    struct splay_tree *tree = calloc(1, sizeof(struct splay_tree));
     int *values = malloc(NUM_INSERTS * sizeof(int));
 
     srand((unsigned) time(NULL));
@@ -281,6 +618,36 @@ int main() {
         splay_search(tree, values[idx]);
     }
 
+    uint64_t *keys = malloc(NUM_INSERTS * sizeof(uint64_t));
+    struct splay_node **found = malloc(NUM_INSERTS * sizeof(struct splay_node *));
+    for (int i = 0; i < NUM_INSERTS; i++)
+        keys[i] = values[i];
+    splay_search_batch(tree, keys, NUM_INSERTS, found);
+    splay_verify(tree);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        assert((found[i] != NULL) == (i >= NUM_REMOVES) && (!found[i] || found[i]->key == keys[i]));
+
+    /* Every policy keeps the tree valid and finds exactly the live keys, batched or not */
+    for (enum splay_policy policy = SPLAY_FULL; policy <= SPLAY_EVERY_K; policy++) {
+        splay_set_policy(tree, policy, policy == SPLAY_EVERY_K ? 3 : 1);
+        for (int i = 0; i < NUM_INSERTS; i++) {
+            struct splay_node *node = splay_search(tree, values[i]);
+            assert(!node == (i < NUM_REMOVES));
+            splay_verify(tree);
+        }
+
+        unsigned long accesses = tree->accesses;
+        splay_search_batch(tree, keys, NUM_INSERTS, found);
+        assert(tree->accesses - accesses == (policy == SPLAY_EVERY_K ? NUM_INSERTS : 0));
+        splay_verify(tree);
+        for (int i = 0; i < NUM_INSERTS; i++)
+            assert(!found[i] == (i < NUM_REMOVES));
+    }
+    free(found);
+    free(keys);
+    assert(tree->size == NUM_INSERTS - NUM_REMOVES);
+    splay_set_policy(tree, SPLAY_FULL, 0);
+
     export_splay_tree_to_dot(tree, "splaytree.dot");
 
     printf("complete\n");
@@ -289,5 +656,44 @@ int main() {
     free(tree);
     free(values);
 
+    /* Arena-backed nodes; deletes hand their slots to later inserts */
+    struct splay_tree pooled;
+    splay_tree_init_arena(&pooled, 0);
+    for (uint64_t key = 0; key < NUM_INSERTS; key++)
+        splay_insert(&pooled, key);
+    size_t carved = pooled.arena->bytes_used;
+    for (uint64_t key = 0; key < NUM_INSERTS; key += 2) {
+        splay_delete(&pooled, key);
+        splay_insert(&pooled, key + NUM_INSERTS);
+    }
+    splay_verify(&pooled);
+    assert(pooled.arena->bytes_used == carved && pooled.size == NUM_INSERTS);
+    splay_tree_clear(&pooled);
+
+    /* Sorted inserts build a path; export and teardown must not recurse */
+    struct splay_tree path = {0};
+    for (uint64_t key = 0; key < DEGENERATE_KEYS; key++)
+        splay_insert(&path, key);
+    FILE *sink = fopen("/dev/null", "w");
+    double start = now_ns();
+    export_splay_dot(sink, path.root);
+    double export_ms = (now_ns() - start) / 1e6;
+    fclose(sink);
+    start = now_ns();
+    splay_tree_free(path.root);
+    printf("    %d-deep path: exported in %.1f ms, freed in %.1f ms\n",
+           DEGENERATE_KEYS, export_ms, (now_ns() - start) / 1e6);
+
+    uint64_t *trace = malloc(BENCH_ACCESSES * sizeof(uint64_t));
+    zipf_trace(trace, BENCH_ACCESSES, BENCH_KEYS);
+    printf("    zipf trace, %d keys:\n", BENCH_KEYS);
+    benchmark_policy("full", trace, SPLAY_FULL, 0);
+    benchmark_policy("semi", trace, SPLAY_SEMI, 0);
+    benchmark_policy("depth > lg n", trace, SPLAY_DEPTH, 1);
+    benchmark_policy("depth > 2 lg n", trace, SPLAY_DEPTH, 2);
+    benchmark_policy("every 16th", trace, SPLAY_EVERY_K, 16);
+    free(trace);
+
     return 0;
 }
+#endif
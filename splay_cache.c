@@ -0,0 +1,344 @@
+/*
+ * Bounded-capacity cache on the splay tree from splay.c. Every get and put
+ * splays the touched key to the root, so the shape of the tree records
+ * recency: hot keys sit in the top levels and keys that have not been
+ * touched for a while sink towards the leaves. Once the cache is full, a put
+ * of a new key evicts a leaf found by short random descents from the root,
+ * keeping the deepest one seen. That approximates LRU without a list or any
+ * per-entry bookkeeping, and unlinking a leaf needs no rotations.
+ *
+ * A hash table with a doubly linked LRU list is the baseline at the end of
+ * main().
+ */
+
+#define SPLAY_NO_MAIN
+#include "splay.c"
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef EVICT_SAMPLES
+#define EVICT_SAMPLES 2
+#endif
+
+struct splay_cache_entry {
+    struct splay_node node; /* first, so splay_tree_free() releases entries */
+    uint64_t value;
+};
+
+struct splay_cache {
+    struct splay_tree tree;
+    size_t capacity;
+    uint64_t rng;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+#define cache_entry(n) ((struct splay_cache_entry *) (n))
+
+struct splay_cache *splay_cache_create(size_t capacity) {
+    assert(capacity > 0);
+    struct splay_cache *cache = calloc(1, sizeof(*cache));
+    cache->capacity = capacity;
+    cache->rng = 0x9e3779b97f4a7c15ULL;
+    return cache;
+}
+
+void splay_cache_destroy(struct splay_cache *cache) {
+    splay_tree_free(cache->tree.root);
+    free(cache);
+}
+
+/* Walk from the root to a leaf, taking a random child where there are two */
+static struct splay_node *random_leaf(struct splay_cache *cache, int *depth) {
+    struct splay_node *x = cache->tree.root;
+    uint64_t bits = 0;
+    int left = 0;
+
+    *depth = 0;
+    for (;;) {
+        if (x->left && x->right) {
+            if (!left) {
+                bits = xorshift64(&cache->rng);
+                left = 64;
+            }
+            x = bits & 1 ? x->right : x->left;
+            bits >>= 1;
+            left--;
+        } else if (x->left) {
+            x = x->left;
+        } else if (x->right) {
+            x = x->right;
+        } else {
+            return x;
+        }
+        (*depth)++;
+    }
+}
+
+/* Unlink the deepest of EVICT_SAMPLES random leaves and return it for reuse */
+static struct splay_cache_entry *evict(struct splay_cache *cache) {
+    struct splay_node *victim = NULL;
+    int victim_depth = -1;
+
+    for (int i = 0; i < EVICT_SAMPLES; i++) {
+        int depth;
+        struct splay_node *leaf = random_leaf(cache, &depth);
+        if (depth > victim_depth) {
+            victim = leaf;
+            victim_depth = depth;
+        }
+    }
+
+    if (!victim->parent)
+        cache->tree.root = NULL;
+    else if (victim->parent->left == victim)
+        victim->parent->left = NULL;
+    else
+        victim->parent->right = NULL;
+    cache->tree.size--;
+    cache->evictions++;
+    return cache_entry(victim);
+}
+
+bool splay_cache_get(struct splay_cache *cache, uint64_t key, uint64_t *value) {
+    struct splay_node *n = splay_search(&cache->tree, key);
+
+    if (!n) {
+        cache->misses++;
+        return false;
+    }
+    cache->hits++;
+    *value = cache_entry(n)->value;
+    return true;
+}
+
+void splay_cache_put(struct splay_cache *cache, uint64_t key, uint64_t value) {
+    struct splay_node *n = splay_search(&cache->tree, key);
+    struct splay_cache_entry *e;
+
+    if (n) {
+        cache_entry(n)->value = value;
+        return;
+    }
+
+    if (cache->tree.size >= cache->capacity)
+        e = evict(cache);
+    else
+        e = malloc(sizeof(*e));
+    e->node.key = key;
+    e->value = value;
+    splay_insert_node(&cache->tree, &e->node);
+}
+
+void splay_cache_verify(struct splay_cache *cache) {
+    splay_verify(&cache->tree);
+    assert(cache->tree.size <= cache->capacity);
+}
+
+/* Baseline: chained hash table over a fixed pool of entries on an LRU list */
+struct lru_entry {
+    uint64_t key;
+    uint64_t value;
+    struct lru_entry *chain;
+    struct lru_entry *prev;
+    struct lru_entry *next;
+};
+
+struct lru_cache {
+    struct lru_entry **buckets;
+    int shift;
+    struct lru_entry *pool;
+    size_t used;
+    size_t capacity;
+    struct lru_entry head; /* head.next is the most recent, head.prev the least */
+    unsigned long hits;
+    unsigned long misses;
+};
+
+struct lru_cache *lru_cache_create(size_t capacity) {
+    struct lru_cache *cache = calloc(1, sizeof(*cache));
+    int bits = 1;
+
+    while (((size_t) 1 << bits) < capacity)
+        bits++;
+    cache->buckets = calloc((size_t) 1 << bits, sizeof(struct lru_entry *));
+    cache->shift = 64 - bits;
+    cache->pool = malloc(capacity * sizeof(struct lru_entry));
+    cache->capacity = capacity;
+    cache->head.prev = cache->head.next = &cache->head;
+    return cache;
+}
+
+void lru_cache_destroy(struct lru_cache *cache) {
+    free(cache->buckets);
+    free(cache->pool);
+    free(cache);
+}
+
+static struct lru_entry **lru_bucket(struct lru_cache *cache, uint64_t key) {
+    return &cache->buckets[(key * 0x9e3779b97f4a7c15ULL) >> cache->shift];
+}
+
+static void lru_unlink(struct lru_entry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+}
+
+static void lru_push_front(struct lru_cache *cache, struct lru_entry *e) {
+    e->prev = &cache->head;
+    e->next = cache->head.next;
+    cache->head.next->prev = e;
+    cache->head.next = e;
+}
+
+static struct lru_entry *lru_find(struct lru_cache *cache, uint64_t key) {
+    struct lru_entry *e = *lru_bucket(cache, key);
+    while (e && e->key != key)
+        e = e->chain;
+    if (e) {
+        lru_unlink(e);
+        lru_push_front(cache, e);
+    }
+    return e;
+}
+
+bool lru_cache_get(struct lru_cache *cache, uint64_t key, uint64_t *value) {
+    struct lru_entry *e = lru_find(cache, key);
+
+    if (!e) {
+        cache->misses++;
+        return false;
+    }
+    cache->hits++;
+    *value = e->value;
+    return true;
+}
+
+void lru_cache_put(struct lru_cache *cache, uint64_t key, uint64_t value) {
+    struct lru_entry *e = lru_find(cache, key);
+
+    if (e) {
+        e->value = value;
+        return;
+    }
+
+    if (cache->used < cache->capacity) {
+        e = &cache->pool[cache->used++];
+    } else {
+        e = cache->head.prev;
+        lru_unlink(e);
+        struct lru_entry **link = lru_bucket(cache, e->key);
+        while (*link != e)
+            link = &(*link)->chain;
+        *link = e->chain;
+    }
+
+    struct lru_entry **bucket = lru_bucket(cache, key);
+    e->key = key;
+    e->value = value;
+    e->chain = *bucket;
+    *bucket = e;
+    lru_push_front(cache, e);
+}
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 20)
+#endif
+
+#ifndef BENCH_CAPACITY
+#define BENCH_CAPACITY (1 << 14)
+#endif
+
+#ifndef BENCH_ACCESSES
+#define BENCH_ACCESSES (1 << 21)
+#endif
+
+/* Read-through: every miss is followed by a put of the key */
+static void benchmark_splay(const char *name, const uint64_t *trace, enum splay_policy policy, unsigned param) {
+    struct splay_cache *cache = splay_cache_create(BENCH_CAPACITY);
+    uint64_t value;
+
+    splay_set_policy(&cache->tree, policy, param);
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ACCESSES; i++) {
+        if (!splay_cache_get(cache, trace[i], &value))
+            splay_cache_put(cache, trace[i], trace[i]);
+    }
+    double elapsed = now_ns() - start;
+
+    printf("    %-14s hit rate %5.2f%%, %.1f ns/access\n", name,
+           100.0 * cache->hits / BENCH_ACCESSES, elapsed / BENCH_ACCESSES);
+    splay_cache_destroy(cache);
+}
+
+static void benchmark_lru(const uint64_t *trace) {
+    struct lru_cache *cache = lru_cache_create(BENCH_CAPACITY);
+    uint64_t value;
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ACCESSES; i++) {
+        if (!lru_cache_get(cache, trace[i], &value))
+            lru_cache_put(cache, trace[i], trace[i]);
+    }
+    double elapsed = now_ns() - start;
+
+    printf("    %-14s hit rate %5.2f%%, %.1f ns/access\n", "hash + LRU",
+           100.0 * cache->hits / BENCH_ACCESSES, elapsed / BENCH_ACCESSES);
+    lru_cache_destroy(cache);
+}
+
+int main() {
+    printf("Splay cache... ");
+    fflush(stdout);
+
+    size_t capacity = NUM_INSERTS / 4 + 1;
+    struct splay_cache *cache = splay_cache_create(capacity);
+    uint64_t *latest = calloc(NUM_INSERTS, sizeof(uint64_t));
+    uint64_t value;
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS * 8; i++) {
+        uint64_t key = rand() % NUM_INSERTS;
+
+        if (rand() % 2) {
+            latest[key] = rand();
+            splay_cache_put(cache, key, latest[key]);
+            assert(cache->tree.root->key == key);
+            assert(splay_cache_get(cache, key, &value) && value == latest[key]);
+        } else if (splay_cache_get(cache, key, &value)) {
+            assert(value == latest[key]);
+        }
+        splay_cache_verify(cache);
+    }
+    assert(cache->tree.size == capacity);
+    assert(cache->evictions > 0);
+
+    /* A burst of new keys replaces entries one for one */
+    unsigned long evictions = cache->evictions;
+    for (uint64_t key = NUM_INSERTS; key < NUM_INSERTS * 2; key++) {
+        splay_cache_put(cache, key, key);
+        assert(splay_cache_get(cache, key, &value) && value == key);
+        assert(cache->tree.size == capacity);
+    }
+    assert(cache->evictions - evictions == NUM_INSERTS);
+    splay_cache_verify(cache);
+
+    export_splay_tree_to_dot(&cache->tree, "splaytree_cache.dot");
+    printf("complete\n");
+
+    splay_cache_destroy(cache);
+    free(latest);
+
+    uint64_t *trace = malloc(BENCH_ACCESSES * sizeof(uint64_t));
+    zipf_trace(trace, BENCH_ACCESSES, BENCH_KEYS);
+    printf("    zipf trace, %d keys, capacity %d:\n", BENCH_KEYS, BENCH_CAPACITY);
+    benchmark_splay("splay", trace, SPLAY_FULL, 0);
+    benchmark_splay("semi-splay", trace, SPLAY_SEMI, 0);
+    benchmark_lru(trace);
+    free(trace);
+
+    return 0;
+}
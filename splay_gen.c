@@ -0,0 +1,191 @@
+/*
+ * Instantiations of the splay tree generator in splay_gen.h: one for
+ * uint64_t keys, timed against the hand-written tree in splay.c, and one for
+ * 128-bit identifiers. Both sides splay the same way, so the same operations
+ * leave the int trees the same shape.
+ */
+
+#define SPLAY_NO_MAIN
+#include "splay.c"
+
+#include "splay_gen.h"
+#include "id128.h"
+
+#define u64_cmp(a, b) ((a) == (b) ? 0 : (a) < (b) ? -1 : 1)
+
+SPLAY_GENERATE(u64_splay, uint64_t, u64_cmp)
+SPLAY_GENERATE(id_splay, struct id128, id128_cmp)
+
+void export_u64_splay_to_dot(struct u64_splay *t, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+    fprintf(fp, "digraph GeneratedSplayTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+    for (struct u64_splay_node *n = u64_splay_min(t); n; n = u64_splay_next(n)) {
+        fprintf(fp, "    \"%llu\" [label=\"%llu\"];\n", n->key, n->key);
+        if (n->left)
+            fprintf(fp, "    \"%llu\" -> \"%llu\";\n", n->key, n->left->key);
+        if (n->right)
+            fprintf(fp, "    \"%llu\" -> \"%llu\";\n", n->key, n->right->key);
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef BENCH_GEN_KEYS
+#define BENCH_GEN_KEYS (1 << 20)
+#endif
+
+/*
+ * Insert, look up and delete the same keys in splay.c and in u64_splay.
+ * Lookups follow a Zipf trace, the access pattern splay trees are for.
+ */
+static void benchmark_parity(void) {
+    uint64_t *keys = malloc(BENCH_GEN_KEYS * sizeof(uint64_t));
+    uint64_t *trace = malloc(BENCH_GEN_KEYS * sizeof(uint64_t));
+    double t[3][3];
+    long found = 0;
+
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        keys[i] = i;
+    for (int i = BENCH_GEN_KEYS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        uint64_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    zipf_trace(trace, BENCH_GEN_KEYS, BENCH_GEN_KEYS);
+
+    struct splay_tree hand = {0};
+    double start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        splay_insert(&hand, keys[i]);
+    t[0][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found += splay_search(&hand, trace[i]) != NULL;
+    t[0][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        splay_delete(&hand, keys[i]);
+    t[0][2] = now_ns() - start;
+    assert(!hand.root);
+
+    struct u64_splay gen;
+    u64_splay_init(&gen);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        u64_splay_insert(&gen, keys[i]);
+    t[1][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found -= u64_splay_find(&gen, trace[i]) != NULL;
+    t[1][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        u64_splay_delete(&gen, keys[i]);
+    t[1][2] = now_ns() - start;
+    assert(found == 0 && !gen.root);
+
+    struct id_splay ids;
+    id_splay_init(&ids);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_splay_insert(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found += id_splay_find(&ids, (struct id128){trace[i] & 7, trace[i]}) != NULL;
+    t[2][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_splay_delete(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][2] = now_ns() - start;
+    assert(found == BENCH_GEN_KEYS && !ids.root);
+
+    const char *names[] = {"splay.c, uint64_t", "generated, uint64_t", "generated, 128-bit"};
+    printf("    %d keys, ns per insert / find / delete:\n", BENCH_GEN_KEYS);
+    for (int i = 0; i < 3; i++)
+        printf("    %-19s %6.1f %6.1f %6.1f\n", names[i], t[i][0] / BENCH_GEN_KEYS,
+               t[i][1] / BENCH_GEN_KEYS, t[i][2] / BENCH_GEN_KEYS);
+    free(trace);
+    free(keys);
+}
+
+int main() {
+    printf("Generated splay trees... ");
+    fflush(stdout);
+
+    struct u64_splay tree;
+    struct id_splay ids;
+    struct splay_tree hand = {0};
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    char *present = calloc(NUM_INSERTS * 4, 1);
+
+    srand((unsigned) time(NULL));
+    u64_splay_init(&tree);
+    id_splay_init(&ids);
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+        if (present[value])
+            continue;
+
+        present[value] = 1;
+        values[i++] = value;
+        struct u64_splay_node *n = u64_splay_insert(&tree, value);
+        assert(n->key == (uint64_t) value && tree.root == n && u64_splay_insert(&tree, value) == n);
+        assert(u64_splay_validate(&tree) == 0);
+        splay_insert(&hand, value);
+        splay_insert(&hand, value);
+
+        /* Same low word, so only the high word separates these */
+        id_splay_insert(&ids, (struct id128){value, 42});
+        id_splay_insert(&ids, (struct id128){value + 1ULL * NUM_INSERTS * 4, 42});
+        assert(id_splay_validate(&ids) == 0);
+    }
+    assert(tree.size == NUM_INSERTS && ids.size == 2 * NUM_INSERTS);
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        assert(u64_splay_delete(&tree, values[i]));
+        assert(!u64_splay_delete(&tree, values[i]));
+        present[values[i]] = 0;
+        assert(u64_splay_validate(&tree) == 0);
+        splay_delete(&hand, values[i]);
+
+        assert(id_splay_delete(&ids, (struct id128){values[i], 42}));
+        assert(id_splay_validate(&ids) == 0);
+    }
+
+    for (int k = 0; k < NUM_INSERTS * 4; k++) {
+        struct u64_splay_node *n = u64_splay_find(&tree, k);
+        assert(!n == !present[k] && (!n || tree.root == n));
+        assert(!splay_search(&hand, k) == !present[k]);
+        assert(!id_splay_find(&ids, (struct id128){k, 42}) == !present[k]);
+    }
+
+    /* Same operations, same splaying: splay.c built the same tree */
+    struct u64_splay_node *n = u64_splay_min(&tree);
+    for (struct splay_node *h = splay_subtree_min(hand.root); h; h = splay_next(&hand, h)) {
+        assert(n && n->key == h->key);
+        assert(!n->parent == !h->parent && (!n->parent || n->parent->key == h->parent->key));
+        n = u64_splay_next(n);
+    }
+    assert(!n);
+
+    export_u64_splay_to_dot(&tree, "splaytree_gen.dot");
+    printf("complete\n");
+
+    u64_splay_free(&tree);
+    id_splay_free(&ids);
+    splay_tree_free(hand.root);
+    free(present);
+    free(values);
+
+    benchmark_parity();
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Splay tree generator in the style of BSD <sys/tree.h>, the counterpart of
+ * rbt_gen.h for the bottom-up tree in splay.c.
+ *
+ *     SPLAY_GENERATE(name, key_type, cmp)
+ *
+ * expands to struct name_node, struct name and a set of static functions
+ * prefixed with name_, all specialised for key_type. cmp is as in
+ * rbt_gen.h and is expanded at every comparison. Keys are unique. Every
+ * find splays fully, like splay.c's default SPLAY_FULL policy; the other
+ * policies and the arena are left to splay.c.
+ *
+ *     name_init(t)            empty tree
+ *     name_insert(t, key)     node for key, added if absent, now the root
+ *     name_find(t, key)       node for key, or NULL; splays the last node seen
+ *     name_delete(t, key)     remove key; 1 if it was present
+ *     name_min(t), name_next(node)   walk in order without splaying
+ *     name_free(t)            free every node, in constant space
+ *     name_validate(t)        0, or -1 if a property is broken
+ */
+
+#ifndef SPLAY_GEN_H
+#define SPLAY_GEN_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define SPLAY_GENERATE(name, key_type, cmp)                                                \
+    struct name##_node {                                                                   \
+        key_type key;                                                                      \
+        struct name##_node *left;                                                          \
+        struct name##_node *right;                                                         \
+        struct name##_node *parent;                                                        \
+    };                                                                                     \
+                                                                                           \
+    struct name {                                                                          \
+        struct name##_node *root;                                                          \
+        size_t size;                                                                       \
+    };                                                                                     \
+                                                                                           \
+    static __attribute__((unused)) void name##_init(struct name *t) {                      \
+        t->root = NULL;                                                                    \
+        t->size = 0;                                                                       \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_replace_child(struct name *t, struct name##_node *parent,    \
+                                            struct name##_node *old,                       \
+                                            struct name##_node *new_child) {               \
+        if (!parent)                                                                       \
+            t->root = new_child;                                                           \
+        else if (parent->left == old)                                                      \
+            parent->left = new_child;                                                      \
+        else                                                                               \
+            parent->right = new_child;                                                     \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_rotate_left(struct name *t, struct name##_node *x) {         \
+        struct name##_node *y = x->right;                                                  \
+        x->right = y->left;                                                                \
+        if (y->left)                                                                       \
+            y->left->parent = x;                                                           \
+        y->parent = x->parent;                                                             \
+        name##_replace_child(t, x->parent, x, y);                                          \
+        y->left = x;                                                                       \
+        x->parent = y;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static inline void name##_rotate_right(struct name *t, struct name##_node *y) {        \
+        struct name##_node *x = y->left;                                                   \
+        y->left = x->right;                                                                \
+        if (x->right)                                                                      \
+            x->right->parent = y;                                                          \
+        x->parent = y->parent;                                                             \
+        name##_replace_child(t, y->parent, y, x);                                          \
+        x->right = y;                                                                      \
+        y->parent = x;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static void name##_splay(struct name *t, struct name##_node *x) {                      \
+        while (x->parent) {                                                                \
+            struct name##_node *p = x->parent, *g = p->parent;                             \
+            if (!g) {                                                                      \
+                if (p->left == x)                                                          \
+                    name##_rotate_right(t, p);                                             \
+                else                                                                       \
+                    name##_rotate_left(t, p);                                              \
+            } else if (p->left == x && g->left == p) {                                     \
+                name##_rotate_right(t, g);                                                 \
+                name##_rotate_right(t, p);                                                 \
+            } else if (p->right == x && g->right == p) {                                   \
+                name##_rotate_left(t, g);                                                  \
+                name##_rotate_left(t, p);                                                  \
+            } else if (p->right == x) {                                                    \
+                name##_rotate_left(t, p);                                                  \
+                name##_rotate_right(t, g);                                                 \
+            } else {                                                                       \
+                name##_rotate_right(t, p);                                                 \
+                name##_rotate_left(t, g);                                                  \
+            }                                                                              \
+        }                                                                                  \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_find(struct name *t,         \
+                                                                   key_type key) {         \
+        struct name##_node *n = t->root, *last = NULL;                                     \
+        /* The two-test form of rbt_gen.h, for the same reason */                          \
+        while (n && cmp(key, n->key) != 0) {                                               \
+            last = n;                                                                      \
+            n = cmp(key, n->key) < 0 ? n->left : n->right;                                 \
+        }                                                                                  \
+        if (n)                                                                             \
+            name##_splay(t, n);                                                            \
+        else if (last)                                                                     \
+            name##_splay(t, last);                                                         \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_insert(struct name *t,       \
+                                                                     key_type key) {       \
+        struct name##_node **link = &t->root;                                              \
+        struct name##_node *parent = NULL;                                                 \
+        while (*link) {                                                                    \
+            if (cmp(key, (*link)->key) == 0) {                                             \
+                struct name##_node *n = *link;                                             \
+                name##_splay(t, n);                                                        \
+                return n;                                                                  \
+            }                                                                              \
+            parent = *link;                                                                \
+            link = cmp(key, parent->key) < 0 ? &parent->left : &parent->right;             \
+        }                                                                                  \
+        struct name##_node *n = malloc(sizeof(*n));                                        \
+        n->key = key;                                                                      \
+        n->left = n->right = NULL;                                                         \
+        n->parent = parent;                                                                \
+        *link = n;                                                                         \
+        t->size++;                                                                         \
+        name##_splay(t, n);                                                                \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Splay the node to the root, then join its subtrees under the left maximum */        \
+    static __attribute__((unused)) int name##_delete(struct name *t, key_type key) {       \
+        struct name##_node *n = t->root;                                                   \
+        while (n && cmp(key, n->key) != 0)                                                 \
+            n = cmp(key, n->key) < 0 ? n->left : n->right;                                 \
+        if (!n)                                                                            \
+            return 0;                                                                      \
+        name##_splay(t, n);                                                                \
+        if (!n->left) {                                                                    \
+            t->root = n->right;                                                            \
+            if (t->root)                                                                   \
+                t->root->parent = NULL;                                                    \
+        } else {                                                                           \
+            struct name##_node *max = n->left;                                             \
+            max->parent = NULL;                                                            \
+            t->root = max;                                                                 \
+            while (max->right)                                                             \
+                max = max->right;                                                          \
+            name##_splay(t, max);                                                          \
+            max->right = n->right;                                                         \
+            if (max->right)                                                                \
+                max->right->parent = max;                                                  \
+        }                                                                                  \
+        t->size--;                                                                         \
+        free(n);                                                                           \
+        return 1;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_min(struct name *t) {        \
+        struct name##_node *n = t->root;                                                   \
+        while (n && n->left)                                                               \
+            n = n->left;                                                                   \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_next(struct name##_node *n) { \
+        if (n->right) {                                                                    \
+            n = n->right;                                                                  \
+            while (n->left)                                                                \
+                n = n->left;                                                               \
+            return n;                                                                      \
+        }                                                                                  \
+        while (n->parent && n == n->parent->right)                                         \
+            n = n->parent;                                                                 \
+        return n->parent;                                                                  \
+    }                                                                                      \
+                                                                                           \
+    /* Rotation-based teardown: linear, no recursion */                                    \
+    static __attribute__((unused)) void name##_free(struct name *t) {                      \
+        struct name##_node *n = t->root;                                                   \
+        while (n) {                                                                        \
+            struct name##_node *left = n->left;                                            \
+            if (left) {                                                                    \
+                n->left = left->right;                                                     \
+                left->right = n;                                                           \
+                n = left;                                                                  \
+            } else {                                                                       \
+                struct name##_node *right = n->right;                                      \
+                free(n);                                                                   \
+                n = right;                                                                 \
+            }                                                                              \
+        }                                                                                  \
+        name##_init(t);                                                                    \
+    }                                                                                      \
+                                                                                           \
+    /* An in-order walk checking links and order; no recursion, as paths get long */       \
+    static __attribute__((unused)) int name##_validate(struct name *t) {                   \
+        if (t->root && t->root->parent)                                                    \
+            return -1;                                                                     \
+        size_t count = 0;                                                                  \
+        for (struct name##_node *n = name##_min(t); n; n = name##_next(n), count++) {      \
+            if ((n->left && n->left->parent != n) || (n->right && n->right->parent != n))  \
+                return -1;                                                                 \
+            struct name##_node *next = name##_next(n);                                     \
+            if (next && cmp(n->key, next->key) >= 0)                                       \
+                return -1;                                                                 \
+        }                                                                                  \
+        return count == t->size ? 0 : -1;                                                  \
+    }
+
+#endif
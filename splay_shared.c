@@ -0,0 +1,381 @@
+/*
+ * Read-mostly concurrent mode for the splay tree from splay.c.
+ *
+ * splay_search restructures the tree on every hit, so a plain splay tree can
+ * only be shared behind an exclusive lock. Here lookups are plain descents
+ * under the read side of a rwlock and change nothing. Each reader thread
+ * samples the keys it hits into its own ring buffer instead. A single
+ * maintenance pass, run periodically under the write lock, drains every ring
+ * and splays those keys, so hot keys still migrate towards the root, just
+ * with a delay. Inserts and deletes take the write lock and splay as usual.
+ *
+ * A ring has one producer (its reader) and one consumer (the maintenance
+ * pass), so it needs no lock. When a ring is full the sample is dropped:
+ * the statistics are only a hint.
+ *
+ * glibc's default rwlock lets new readers in while a writer waits, so under
+ * steady lookups the maintenance pass and writers could wait forever. Where
+ * glibc is available the lock prefers writers instead.
+ */
+
+#define _GNU_SOURCE
+#define SPLAY_NO_MAIN
+#include "splay.c"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef READER_RING
+#define READER_RING 256
+#endif
+
+/* Record one hit in ACCESS_SAMPLE; hot keys still dominate the samples */
+#ifndef ACCESS_SAMPLE
+#define ACCESS_SAMPLE 8
+#endif
+
+struct splay_reader {
+    struct splay_shared *shared;
+    struct splay_reader *next;
+    unsigned long lookups;
+    unsigned long dropped;
+    size_t head; /* next slot to fill, written by the reader */
+    char pad[64];
+    size_t tail; /* next slot to drain, written by the maintenance pass */
+    uint64_t keys[READER_RING];
+};
+
+struct splay_shared {
+    struct splay_tree tree;
+    pthread_rwlock_t lock;
+    pthread_mutex_t readers_lock;
+    struct splay_reader *readers;
+    pthread_t maintainer;
+    unsigned long passes; /* maintenance passes completed */
+    unsigned interval_us;
+    int stop;
+};
+
+void splay_shared_init(struct splay_shared *shared) {
+    pthread_rwlockattr_t attr;
+
+    memset(shared, 0, sizeof(*shared));
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&shared->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&shared->readers_lock, NULL);
+}
+
+void splay_shared_destroy(struct splay_shared *shared) {
+    assert(!shared->readers);
+    splay_tree_free(shared->tree.root);
+    pthread_rwlock_destroy(&shared->lock);
+    pthread_mutex_destroy(&shared->readers_lock);
+}
+
+/* Each thread that looks keys up owns one reader */
+void splay_reader_attach(struct splay_shared *shared, struct splay_reader *reader) {
+    memset(reader, 0, sizeof(*reader));
+    reader->shared = shared;
+    pthread_mutex_lock(&shared->readers_lock);
+    reader->next = shared->readers;
+    shared->readers = reader;
+    pthread_mutex_unlock(&shared->readers_lock);
+}
+
+void splay_reader_detach(struct splay_reader *reader) {
+    struct splay_shared *shared = reader->shared;
+
+    pthread_mutex_lock(&shared->readers_lock);
+    struct splay_reader **link = &shared->readers;
+    while (*link != reader)
+        link = &(*link)->next;
+    *link = reader->next;
+    pthread_mutex_unlock(&shared->readers_lock);
+}
+
+static void record_access(struct splay_reader *reader, uint64_t key) {
+    size_t head = reader->head;
+
+    if (head - __atomic_load_n(&reader->tail, __ATOMIC_ACQUIRE) == READER_RING) {
+        reader->dropped++;
+        return;
+    }
+    reader->keys[head % READER_RING] = key;
+    __atomic_store_n(&reader->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Lookup without restructuring; safe to call from many threads at once */
+bool splay_shared_contains(struct splay_reader *reader, uint64_t key) {
+    struct splay_shared *shared = reader->shared;
+
+    pthread_rwlock_rdlock(&shared->lock);
+    struct splay_node *x = shared->tree.root;
+    while (x && x->key != key)
+        x = key < x->key ? x->left : x->right;
+    pthread_rwlock_unlock(&shared->lock);
+
+    if (x && reader->lookups % ACCESS_SAMPLE == 0)
+        record_access(reader, key);
+    reader->lookups++;
+    return x != NULL;
+}
+
+void splay_shared_insert(struct splay_shared *shared, uint64_t key) {
+    pthread_rwlock_wrlock(&shared->lock);
+    splay_insert(&shared->tree, key);
+    pthread_rwlock_unlock(&shared->lock);
+}
+
+void splay_shared_delete(struct splay_shared *shared, uint64_t key) {
+    pthread_rwlock_wrlock(&shared->lock);
+    splay_delete(&shared->tree, key);
+    pthread_rwlock_unlock(&shared->lock);
+}
+
+/*
+ * Drain every reader's samples and splay them in, as the tree's policy says.
+ * Keys deleted since they were sampled just splay their neighbourhood.
+ * Returns the number of samples applied.
+ */
+size_t splay_shared_maintain(struct splay_shared *shared) {
+    size_t applied = 0;
+
+    pthread_mutex_lock(&shared->readers_lock);
+    pthread_rwlock_wrlock(&shared->lock);
+    for (struct splay_reader *r = shared->readers; r; r = r->next) {
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        size_t tail = r->tail;
+
+        for (; tail != head; tail++, applied++)
+            splay_search(&shared->tree, r->keys[tail % READER_RING]);
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    shared->passes++;
+    pthread_rwlock_unlock(&shared->lock);
+    pthread_mutex_unlock(&shared->readers_lock);
+    return applied;
+}
+
+static void *maintenance_thread(void *arg) {
+    struct splay_shared *shared = arg;
+
+    while (!__atomic_load_n(&shared->stop, __ATOMIC_RELAXED)) {
+        usleep(shared->interval_us);
+        splay_shared_maintain(shared);
+    }
+    return NULL;
+}
+
+/* Run splay_shared_maintain every interval_us on a background thread */
+void splay_shared_start_maintenance(struct splay_shared *shared, unsigned interval_us) {
+    shared->interval_us = interval_us;
+    shared->stop = 0;
+    pthread_create(&shared->maintainer, NULL, maintenance_thread, shared);
+}
+
+void splay_shared_stop_maintenance(struct splay_shared *shared) {
+    __atomic_store_n(&shared->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(shared->maintainer, NULL);
+}
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 16)
+#endif
+
+#ifndef BENCH_ACCESSES
+#define BENCH_ACCESSES (1 << 20)
+#endif
+
+#ifndef BENCH_MS
+#define BENCH_MS 200
+#endif
+
+#ifndef BENCH_MAX_READERS
+#define BENCH_MAX_READERS 4
+#endif
+
+#ifndef BENCH_INTERVAL_US
+#define BENCH_INTERVAL_US 1000
+#endif
+
+struct bench_reader {
+    struct splay_shared *shared;
+    pthread_mutex_t *exclusive; /* set: splay_search under this mutex instead */
+    const uint64_t *trace;
+    size_t start;
+    unsigned long lookups;
+    char pad[64];
+};
+
+static int bench_stop;
+
+static void *bench_reader_thread(void *arg) {
+    struct bench_reader *b = arg;
+    struct splay_reader reader;
+    size_t i = b->start;
+
+    if (!b->exclusive)
+        splay_reader_attach(b->shared, &reader);
+
+    while (!__atomic_load_n(&bench_stop, __ATOMIC_RELAXED)) {
+        uint64_t key = b->trace[i++ % BENCH_ACCESSES];
+        if (b->exclusive) {
+            pthread_mutex_lock(b->exclusive);
+            splay_search(&b->shared->tree, key);
+            pthread_mutex_unlock(b->exclusive);
+        } else {
+            splay_shared_contains(&reader, key);
+        }
+        b->lookups++;
+    }
+
+    if (!b->exclusive)
+        splay_reader_detach(&reader);
+    return NULL;
+}
+
+/* Mean depth of the first accesses in the trace, walking without splaying */
+static double mean_depth(struct splay_tree *tree, const uint64_t *trace) {
+    unsigned long total = 0;
+
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        struct splay_node *x = tree->root;
+        while (x->key != trace[i]) {
+            x = trace[i] < x->key ? x->left : x->right;
+            total++;
+        }
+    }
+    return (double) total / BENCH_KEYS;
+}
+
+static void benchmark(const char *name, const uint64_t *trace, int exclusive, int n) {
+    struct splay_shared shared;
+    struct bench_reader readers[BENCH_MAX_READERS] = {0};
+    pthread_t threads[BENCH_MAX_READERS];
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    splay_shared_init(&shared);
+    for (int i = 0; i < BENCH_KEYS; i++)
+        splay_insert(&shared.tree, (i * 0x9e3779b97f4a7c15ULL) % BENCH_KEYS);
+    double cold = mean_depth(&shared.tree, trace);
+
+    if (!exclusive)
+        splay_shared_start_maintenance(&shared, BENCH_INTERVAL_US);
+
+    bench_stop = 0;
+    double start = now_ns();
+    for (int i = 0; i < n; i++) {
+        readers[i].shared = &shared;
+        readers[i].exclusive = exclusive ? &mutex : NULL;
+        readers[i].trace = trace;
+        readers[i].start = (size_t) i * BENCH_ACCESSES / n;
+        pthread_create(&threads[i], NULL, bench_reader_thread, &readers[i]);
+    }
+
+    usleep(BENCH_MS * 1000);
+    __atomic_store_n(&bench_stop, 1, __ATOMIC_RELAXED);
+
+    unsigned long lookups = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        lookups += readers[i].lookups;
+    }
+    double elapsed = now_ns() - start;
+
+    if (!exclusive)
+        splay_shared_stop_maintenance(&shared);
+    splay_verify(&shared.tree);
+
+    printf("    %-9s %d reader(s): %6.2f M lookups/s, mean depth of hot keys %.1f -> %.1f",
+           name, n, lookups / elapsed * 1e3, cold, mean_depth(&shared.tree, trace));
+    if (!exclusive)
+        printf(", %lu maintenance passes", shared.passes);
+    printf("\n");
+    splay_shared_destroy(&shared);
+}
+
+struct demo_reader {
+    struct splay_shared *shared;
+    int present_below; /* keys [0, present_below) are never deleted */
+    unsigned long hits;
+};
+
+static void *demo_reader_thread(void *arg) {
+    struct demo_reader *d = arg;
+    struct splay_reader reader;
+
+    splay_reader_attach(d->shared, &reader);
+    for (int round = 0; round < 16; round++) {
+        for (int k = 0; k < d->present_below; k++) {
+            assert(splay_shared_contains(&reader, k));
+            d->hits++;
+        }
+    }
+    splay_reader_detach(&reader);
+    return NULL;
+}
+
+int main() {
+    printf("Shared splay tree... ");
+    fflush(stdout);
+
+    struct splay_shared shared;
+    struct demo_reader demo[4];
+    pthread_t threads[4];
+
+    splay_shared_init(&shared);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        splay_shared_insert(&shared, i);
+
+    /* Readers race a writer churning the upper half and the maintenance pass */
+    splay_shared_start_maintenance(&shared, 100);
+    for (int i = 0; i < 4; i++) {
+        demo[i].shared = &shared;
+        demo[i].present_below = NUM_INSERTS / 2;
+        demo[i].hits = 0;
+        pthread_create(&threads[i], NULL, demo_reader_thread, &demo[i]);
+    }
+    for (int round = 0; round < 16; round++) {
+        for (int k = NUM_INSERTS / 2; k < NUM_INSERTS; k++)
+            splay_shared_delete(&shared, k);
+        for (int k = NUM_INSERTS / 2; k < NUM_INSERTS; k++)
+            splay_shared_insert(&shared, k);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        assert(demo[i].hits == 16UL * (NUM_INSERTS / 2));
+    }
+    splay_shared_stop_maintenance(&shared);
+    splay_verify(&shared.tree);
+    assert(shared.tree.size == NUM_INSERTS);
+
+    /* A drained sample comes up to the root */
+    struct splay_reader reader;
+    splay_reader_attach(&shared, &reader);
+    splay_shared_contains(&reader, 0);
+    assert(reader.lookups == 1 && reader.head == 1);
+    assert(splay_shared_maintain(&shared) == 1);
+    assert(shared.tree.root->key == 0);
+    splay_reader_detach(&reader);
+
+    export_splay_tree_to_dot(&shared.tree, "splaytree_shared.dot");
+    printf("complete\n");
+    splay_shared_destroy(&shared);
+
+    uint64_t *trace = malloc(BENCH_ACCESSES * sizeof(uint64_t));
+    zipf_trace(trace, BENCH_ACCESSES, BENCH_KEYS);
+    printf("    zipf trace, %d keys:\n", BENCH_KEYS);
+    for (int n = 1; n <= BENCH_MAX_READERS; n *= 2) {
+        benchmark("exclusive", trace, 1, n);
+        benchmark("shared", trace, 0, n);
+    }
+    free(trace);
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ * Top-down splay tree (Sleator and Tarjan). The splay happens during the
+ * descent itself: nodes passed on the way down are hung off two side trees,
+ * holding everything smaller and everything larger than the key, which are
+ * reassembled under the final node at the end. Nothing ever walks back up,
+ * so nodes need no parent pointer and shrink from 32 to 24 bytes, and a
+ * rotation rewrites two links instead of up to six.
+ *
+ * The bottom-up tree from splay.c is pulled in for the comparison at the end
+ * of main().
+ */
+
+#define SPLAY_NO_MAIN
+#include "splay.c"
+
+#include <string.h>
+
+struct splay_td_node {
+    uint64_t key;
+    struct splay_td_node *left;
+    struct splay_td_node *right;
+};
+
+struct splay_td_tree {
+    struct splay_td_node *root;
+};
+
+/*
+ * Splay key (or the last node on its search path) to the root of t and
+ * return the new root. Same zig-zig/zig/zag cases as the bottom-up version:
+ * two steps in one direction rotate first, then link.
+ */
+static struct splay_td_node *splay_td(struct splay_td_node *t, uint64_t key) {
+    struct splay_td_node header = {0}, *l = &header, *r = &header, *y;
+
+    if (!t)
+        return NULL;
+
+    for (;;) {
+        if (key < t->key) {
+            if (!t->left)
+                break;
+            if (key < t->left->key) {
+                /* Rotate right */
+                y = t->left;
+                t->left = y->right;
+                y->right = t;
+                t = y;
+                if (!t->left)
+                    break;
+            }
+            /* Link right */
+            r->left = t;
+            r = t;
+            t = t->left;
+        } else if (key > t->key) {
+            if (!t->right)
+                break;
+            if (key > t->right->key) {
+                /* Rotate left */
+                y = t->right;
+                t->right = y->left;
+                y->left = t;
+                t = y;
+                if (!t->right)
+                    break;
+            }
+            /* Link left */
+            l->right = t;
+            l = t;
+            t = t->right;
+        } else {
+            break;
+        }
+    }
+
+    /* Assemble */
+    l->right = t->left;
+    r->left = t->right;
+    t->left = header.right;
+    t->right = header.left;
+    return t;
+}
+
+struct splay_td_node *splay_td_search(struct splay_td_tree *tree, uint64_t key) {
+    tree->root = splay_td(tree->root, key);
+    if (tree->root && tree->root->key == key)
+        return tree->root;
+    return NULL;
+}
+
+void splay_td_insert(struct splay_td_tree *tree, uint64_t key) {
+    struct splay_td_node *t = splay_td(tree->root, key);
+
+    if (t && t->key == key) {
+        tree->root = t;
+        return;
+    }
+
+    struct splay_td_node *n = malloc(sizeof(*n));
+    n->key = key;
+
+    if (!t) {
+        n->left = n->right = NULL;
+    } else if (key < t->key) {
+        n->left = t->left;
+        n->right = t;
+        t->left = NULL;
+    } else {
+        n->right = t->right;
+        n->left = t;
+        t->right = NULL;
+    }
+    tree->root = n;
+}
+
+void splay_td_delete(struct splay_td_tree *tree, uint64_t key) {
+    struct splay_td_node *t = splay_td(tree->root, key);
+
+    if (!t || t->key != key) {
+        tree->root = t;
+        return;
+    }
+
+    if (!t->left) {
+        tree->root = t->right;
+    } else {
+        /* key exceeds everything on the left, so its maximum comes up with no right child */
+        tree->root = splay_td(t->left, key);
+        tree->root->right = t->right;
+    }
+    free(t);
+}
+
+static void splay_td_verify_node(struct splay_td_node *node, const uint64_t *min, const uint64_t *max) {
+    if (!node)
+        return;
+
+    assert(!min || node->key > *min);
+    assert(!max || node->key < *max);
+    splay_td_verify_node(node->left, min, &node->key);
+    splay_td_verify_node(node->right, &node->key, max);
+}
+
+void splay_td_verify(struct splay_td_tree *tree) {
+    splay_td_verify_node(tree->root, NULL, NULL);
+}
+
+/* Rotate left children up until the root has none, then free it; no recursion */
+void splay_td_free(struct splay_td_node *root) {
+    while (root) {
+        struct splay_td_node *next;
+        if (root->left) {
+            next = root->left;
+            root->left = next->right;
+            next->right = root;
+        } else {
+            next = root->right;
+            free(root);
+        }
+        root = next;
+    }
+}
+
+static void export_splay_td_dot_one(FILE *fp, struct splay_td_node *node, struct splay_td_node *right) {
+    fprintf(fp, "    \"%llu\" [label=\"%llu\"];\n", node->key, node->key);
+    if (node->left) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", node->key, node->left->key);
+    } else {
+        fprintf(fp, "    \"nullL%llu\" [shape=circle, label=\"\"];\n", node->key);
+        fprintf(fp, "    \"%llu\" -> \"nullL%llu\";\n", node->key, node->key);
+    }
+    if (right) {
+        fprintf(fp, "    \"%llu\" -> \"%llu\";\n", node->key, right->key);
+    } else {
+        fprintf(fp, "    \"nullR%llu\" [shape=circle, label=\"\"];\n", node->key);
+        fprintf(fp, "    \"%llu\" -> \"nullR%llu\";\n", node->key, node->key);
+    }
+}
+
+/*
+ * While the Morris walk below is under way, node->right may be a temporary
+ * thread back to the ancestor whose left subtree ends at node.
+ */
+static int splay_td_is_thread(struct splay_td_node *node) {
+    struct splay_td_node *p = node->right ? node->right->left : NULL;
+    while (p && p != node)
+        p = p->right;
+    return p == node;
+}
+
+/*
+ * Morris in-order walk, as in treap.c: the rightmost node of each left
+ * subtree is pointed back at its ancestor on the way down and restored on
+ * the way up, so long paths need neither recursion nor parent pointers.
+ */
+void export_splay_td_dot(FILE *fp, struct splay_td_node *node) {
+    while (node) {
+        if (!node->left) {
+            export_splay_td_dot_one(fp, node, splay_td_is_thread(node) ? NULL : node->right);
+            node = node->right;
+            continue;
+        }
+
+        struct splay_td_node *pred = node->left;
+        while (pred->right && pred->right != node)
+            pred = pred->right;
+
+        if (!pred->right) {
+            pred->right = node;
+            node = node->left;
+        } else {
+            pred->right = NULL;
+            export_splay_td_dot_one(fp, node, splay_td_is_thread(node) ? NULL : node->right);
+            node = node->right;
+        }
+    }
+}
+
+void export_splay_td_tree_to_dot(struct splay_td_tree *tree, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+    fprintf(fp, "digraph TopDownSplayTree {\n");
+    fprintf(fp, "    node [shape=circle, fontname=Arial, fixedsize=true, width=0.7];\n");
+    fprintf(fp, "    edge [arrowsize=0.7];\n");
+    if (tree->root)
+        export_splay_td_dot(fp, tree->root);
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 16)
+#endif
+
+#ifndef DEGENERATE_KEYS
+#define DEGENERATE_KEYS (1 << 21)
+#endif
+
+#ifndef BENCH_ACCESSES
+#define BENCH_ACCESSES (1 << 19)
+#endif
+
+/* Uniform or Zipf access trace over keys 0 .. BENCH_KEYS - 1 */
+static void make_trace(uint64_t *trace, int zipf) {
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+
+    if (zipf) {
+        zipf_trace(trace, BENCH_ACCESSES, BENCH_KEYS);
+        return;
+    }
+    for (int i = 0; i < BENCH_ACCESSES; i++)
+        trace[i] = xorshift64(&rng) % BENCH_KEYS;
+}
+
+static void benchmark(const char *name, int zipf) {
+    uint64_t *trace = malloc(BENCH_ACCESSES * sizeof(uint64_t));
+    struct splay_tree bottom_up = {NULL};
+    struct splay_td_tree top_down = {NULL};
+    long hits = 0;
+
+    make_trace(trace, zipf);
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        uint64_t key = (i * 0x9e3779b97f4a7c15ULL) % BENCH_KEYS;
+        splay_insert(&bottom_up, key);
+        splay_td_insert(&top_down, key);
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ACCESSES; i++)
+        hits += splay_search(&bottom_up, trace[i]) != NULL;
+    double bottom_up_ns = (now_ns() - start) / BENCH_ACCESSES;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_ACCESSES; i++)
+        hits -= splay_td_search(&top_down, trace[i]) != NULL;
+    double top_down_ns = (now_ns() - start) / BENCH_ACCESSES;
+    assert(hits == 0);
+
+    printf("    %-7s %d keys: bottom-up %.1f ns/access (%zu-byte nodes), top-down %.1f ns/access (%zu-byte nodes)\n",
+           name, BENCH_KEYS, bottom_up_ns, sizeof(struct splay_node), top_down_ns, sizeof(struct splay_td_node));
+
+    splay_tree_free(bottom_up.root);
+    splay_td_free(top_down.root);
+    free(trace);
+}
+
+int main() {
+    printf("Top-down splay tree... ");
+    fflush(stdout);
+
+    struct splay_td_tree tree = {NULL};
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    char *present = calloc(NUM_INSERTS * 4, 1);
+
+    srand((unsigned) time(NULL));
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+        if (present[value])
+            continue;
+
+        present[value] = 1;
+        values[i++] = value;
+        splay_td_insert(&tree, value);
+        splay_td_verify(&tree);
+        assert(tree.root->key == (uint64_t) value);
+    }
+
+    for (int i = NUM_INSERTS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        splay_td_delete(&tree, values[i]);
+        present[values[i]] = 0;
+        splay_td_verify(&tree);
+    }
+
+    for (int k = 0; k < NUM_INSERTS * 4; k++) {
+        struct splay_td_node *node = splay_td_search(&tree, k);
+        assert(!node == !present[k]);
+        assert(!node || tree.root == node);
+        splay_td_verify(&tree);
+    }
+
+    export_splay_td_tree_to_dot(&tree, "splaytree_topdown.dot");
+    splay_td_verify(&tree);
+    printf("complete\n");
+
+    splay_td_free(tree.root);
+    free(present);
+    free(values);
+
+    /* Sorted inserts build a path; export and teardown must not recurse */
+    struct splay_td_tree path = {NULL};
+    for (uint64_t key = 0; key < DEGENERATE_KEYS; key++)
+        splay_td_insert(&path, key);
+    FILE *sink = fopen("/dev/null", "w");
+    double start = now_ns();
+    export_splay_td_dot(sink, path.root);
+    double export_ms = (now_ns() - start) / 1e6;
+    fclose(sink);
+    start = now_ns();
+    splay_td_free(path.root);
+    printf("    %d-deep path: exported in %.1f ms, freed in %.1f ms\n",
+           DEGENERATE_KEYS, export_ms, (now_ns() - start) / 1e6);
+
+    benchmark("uniform", 0);
+    benchmark("zipf", 1);
+    return 0;
+}
@@ -1,10 +1,13 @@
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 struct treap_node {
     uint64_t key;
@@ -12,70 +15,122 @@ struct treap_node {
     struct treap_node *left, *right;
 };
 
+/*
+ * Priorities come from a per-tree xorshift64 generator, or, with
+ * hash_priority set, from a hash of the key and seed, which makes the shape
+ * of the treap a function of its key set alone. A zeroed treap uses the
+ * generator with a fixed seed.
+ */
 struct treap {
     struct treap_node *root;
+    uint64_t seed; /* xorshift state, or the hash seed */
+    bool hash_priority;
 };
 
-static struct treap_node *rotate_right(struct treap_node *y) {
-    struct treap_node *x = y->left;
-    struct treap_node *T2 = x->right;
-    x->right = y;
-    y->left = T2;
-    return x;
+void treap_init(struct treap *t, uint64_t seed, bool hash_priority) {
+    t->root = NULL;
+    t->seed = seed;
+    t->hash_priority = hash_priority;
+}
+
+/* splitmix64's finalizer */
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
 }
 
-static struct treap_node *rotate_left(struct treap_node *x) {
-    struct treap_node *y = x->right;
-    struct treap_node *T2 = y->left;
-    y->left = x;
-    x->right = T2;
-    return y;
+static uint32_t treap_priority(struct treap *t, uint64_t key) {
+    if (t->hash_priority)
+        return mix64(key ^ t->seed) >> 32;
+
+    uint64_t x = t->seed ? t->seed : 0x9e3779b97f4a7c15ULL;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    t->seed = x;
+    return x >> 32;
 }
 
-static struct treap_node *treap_create_node(uint64_t key) {
-    struct treap_node *n = calloc(1, sizeof(*n));
+static struct treap_node *treap_create_node(uint64_t key, uint32_t priority) {
+    struct treap_node *n = malloc(sizeof(*n));
     n->key = key;
-    n->priority = rand();
+    n->priority = priority;
+    n->left = n->right = NULL;
     return n;
 }
 
-static struct treap_node *treap_insert_node(struct treap_node *root, uint64_t key) {
-    if (!root)
-        return treap_create_node(key);
-
-    if (key < root->key) {
-        root->left = treap_insert_node(root->left, key);
-        if (root->left->priority < root->priority)
-            root = rotate_right(root);
-    } else if (key > root->key) {
-        root->right = treap_insert_node(root->right, key);
-        if (root->right->priority < root->priority)
-            root = rotate_left(root);
-    } else {
-        /* duplicate */
-        return root;
+/* Link the merge of a and b, every key of a below every key of b, at *link */
+static void merge_into(struct treap_node **link, struct treap_node *a, struct treap_node *b) {
+    while (a && b) {
+        if (a->priority <= b->priority) {
+            *link = a;
+            link = &a->right;
+            a = a->right;
+        } else {
+            *link = b;
+            link = &b->left;
+            b = b->left;
+        }
     }
-
-    return root;
+    *link = a ? a : b;
 }
 
-void treap_insert(struct treap *t, uint64_t key) {
-    t->root = treap_insert_node(t->root, key);
+/*
+ * Descend to the first link whose subtree the new node should head, check the
+ * rest of the path for a duplicate, then split that subtree around the key
+ * into the new node's children. No recursion and no rotations.
+ */
+/* false if key was already present */
+bool treap_insert(struct treap *t, uint64_t key) {
+    uint32_t priority = treap_priority(t, key);
+    struct treap_node **link = &t->root;
+
+    while (*link && (*link)->priority <= priority) {
+        if (key == (*link)->key)
+            return false;
+        link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+    }
+
+    for (struct treap_node *n = *link; n; n = key < n->key ? n->left : n->right)
+        if (key == n->key)
+            return false;
+
+    struct treap_node *n = treap_create_node(key, priority), *rest = *link;
+    struct treap_node **l = &n->left, **r = &n->right;
+
+    while (rest) {
+        if (rest->key < key) {
+            *l = rest;
+            l = &rest->right;
+            rest = rest->right;
+        } else {
+            *r = rest;
+            r = &rest->left;
+            rest = rest->left;
+        }
+    }
+    *l = *r = NULL;
+    *link = n;
+    return true;
 }
 
+/* min and max are the nearest ancestors bounding node, or NULL when unbounded */
 static bool treap_verify_node(struct treap_node *node,
-                              uint64_t min_key,
-                              uint64_t max_key,
+                              const struct treap_node *min,
+                              const struct treap_node *max,
                               int *count) {
     if (!node)
         return 1;
 
     /* BST invariant */
-    if (node->key <= min_key || node->key >= max_key) {
+    if ((min && node->key <= min->key) || (max && node->key >= max->key)) {
         fprintf(stderr, "BST violation at node %llu: not in range (%llu, %llu)\n",
                 (unsigned long long) node->key,
-                (unsigned long long) min_key,
-                (unsigned long long) max_key);
+                (unsigned long long) (min ? min->key : 0),
+                (unsigned long long) (max ? max->key : UINT64_MAX));
         return false;
     }
 
@@ -97,46 +152,269 @@ static bool treap_verify_node(struct treap_node *node,
 
     (*count)++;
 
-    return treap_verify_node(node->left, min_key, node->key, count) &&
-           treap_verify_node(node->right, node->key, max_key, count);
+    return treap_verify_node(node->left, min, node, count) &&
+           treap_verify_node(node->right, node, max, count);
 }
 
 bool treap_verify(struct treap *t) {
     int count = 0;
-    return treap_verify_node(t->root, 0, UINT64_MAX, &count);
+    return treap_verify_node(t->root, NULL, NULL, &count);
+}
+
+/* Unlink the node and merge its two subtrees into its place */
+/* false if key was not present */
+bool treap_delete(struct treap *t, uint64_t key) {
+    struct treap_node **link = &t->root;
+
+    while (*link && (*link)->key != key)
+        link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+    if (!*link)
+        return false;
+
+    struct treap_node *n = *link;
+    merge_into(link, n->left, n->right);
+    free(n);
+    return true;
+}
+
+static void treap_free_node(struct treap_node *n);
+
+/*
+ * Split n into keys < key (*l) and keys > key (*r). The node holding key
+ * itself is detached into *eq when eq is non-NULL (which the caller must
+ * have cleared), otherwise it goes to *r.
+ */
+static void split_node(struct treap_node *n, uint64_t key, struct treap_node **l,
+                       struct treap_node **eq, struct treap_node **r) {
+    if (!n) {
+        *l = *r = NULL;
+    } else if (n->key < key) {
+        split_node(n->right, key, &n->right, eq, r);
+        *l = n;
+    } else if (n->key > key || !eq) {
+        split_node(n->left, key, l, eq, &n->left);
+        *r = n;
+    } else {
+        *eq = n;
+        *l = n->left;
+        *r = n->right;
+        n->left = n->right = NULL;
+    }
 }
 
-static struct treap_node *treap_delete_node(struct treap_node *root, uint64_t key) {
-    if (!root)
+/* Every key in a must be smaller than every key in b */
+static struct treap_node *merge_node(struct treap_node *a, struct treap_node *b) {
+    struct treap_node *root;
+    merge_into(&root, a, b);
+    return root;
+}
+
+/* Move keys < key from t into lo and the rest into hi; t may be lo or hi */
+void treap_split(struct treap *t, uint64_t key, struct treap *lo, struct treap *hi) {
+    struct treap_node *root = t->root;
+    t->root = NULL;
+    split_node(root, key, &lo->root, NULL, &hi->root);
+}
+
+/* Move all of lo and hi into t, where every key in lo is below every key in hi */
+void treap_merge(struct treap *t, struct treap *lo, struct treap *hi) {
+    struct treap_node *root = merge_node(lo->root, hi->root);
+    lo->root = hi->root = NULL;
+    t->root = root;
+}
+
+/* Delete every key in [lo, hi) with two splits and a merge */
+void treap_delete_range(struct treap *t, uint64_t lo, uint64_t hi) {
+    struct treap_node *below, *rest, *doomed, *above;
+
+    if (lo >= hi)
+        return;
+
+    split_node(t->root, lo, &below, NULL, &rest);
+    split_node(rest, hi, &doomed, NULL, &above);
+    treap_free_node(doomed);
+    t->root = merge_node(below, above);
+}
+
+enum treap_set_op {
+    TREAP_UNION,
+    TREAP_INTERSECTION,
+    TREAP_DIFFERENCE,
+};
+
+/*
+ * Combine a and b, consuming both. The root with the smaller priority (a's,
+ * for the asymmetric difference) splits the other treap; the two halves are
+ * combined recursively and joined back under that root, or merged if the
+ * root's key does not survive. This runs in O(m log(n/m + 1)) expected time
+ * for sizes m <= n.
+ */
+static struct treap_node *set_op_node(enum treap_set_op op, struct treap_node *a, struct treap_node *b) {
+    if (!a || !b) {
+        if (op == TREAP_UNION)
+            return a ? a : b;
+        treap_free_node(b);
+        if (op == TREAP_DIFFERENCE)
+            return a;
+        treap_free_node(a);
         return NULL;
+    }
 
-    if (key < root->key)
-        root->left = treap_delete_node(root->left, key);
-    else if (key > root->key)
-        root->right = treap_delete_node(root->right, key);
-    else {
-        /* found */
-        if (!root->left && !root->right) {
-            free(root);
-            return NULL;
-        } else if (!root->left)
-            root = rotate_left(root);
-        else if (!root->right)
-            root = rotate_right(root);
-        else if (root->left->priority < root->right->priority)
-            root = rotate_right(root);
-        else
-            root = rotate_left(root);
+    if (op != TREAP_DIFFERENCE && b->priority < a->priority) {
+        struct treap_node *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    struct treap_node *bl, *dup = NULL, *br;
+    split_node(b, a->key, &bl, &dup, &br);
+
+    struct treap_node *l = set_op_node(op, a->left, bl);
+    struct treap_node *r = set_op_node(op, a->right, br);
+
+    bool keep = op == TREAP_UNION || (op == TREAP_INTERSECTION) == (dup != NULL);
+    free(dup);
+
+    if (keep) {
+        a->left = l;
+        a->right = r;
+        return a;
+    }
+    free(a);
+    return merge_node(l, r);
+}
+
+/* Inputs smaller than this are combined on one thread */
+#ifndef SET_OP_CUTOFF
+#define SET_OP_CUTOFF 4096
+#endif
+
+/* A pair of subtrees to combine, and where the result goes */
+struct set_op_task {
+    struct treap_node *a, *b;
+    struct treap_node **slot;
+};
+
+/* A root whose key did not survive: its halves are merged once both are done */
+struct set_op_join {
+    struct treap_node *l, *r;
+    struct treap_node **slot;
+};
+
+struct set_op_plan {
+    enum treap_set_op op;
+    struct set_op_task *tasks;
+    struct set_op_join *joins;
+    int ntasks, njoins;
+    atomic_int next; /* first task no worker has claimed yet */
+};
+
+/* Nodes in n's subtree, counting no further than limit */
+static size_t count_upto(const struct treap_node *n, size_t limit) {
+    if (!n || !limit)
+        return 0;
+    size_t count = 1 + count_upto(n->left, limit - 1);
+    return count + count_upto(n->right, limit - count);
+}
+
+/*
+ * The top levels of set_op_node, run on the calling thread: split down to
+ * depth, or until either input is under SET_OP_CUTOFF nodes, and queue the
+ * pairs left there as tasks. Joins are queued parents first.
+ */
+static void set_op_split(struct set_op_plan *plan, struct treap_node *a, struct treap_node *b, int depth,
+                         struct treap_node **slot) {
+    if (depth == 0 || count_upto(a, SET_OP_CUTOFF) < SET_OP_CUTOFF ||
+        count_upto(b, SET_OP_CUTOFF) < SET_OP_CUTOFF) {
+        plan->tasks[plan->ntasks++] = (struct set_op_task) {a, b, slot};
+        return;
+    }
+
+    if (plan->op != TREAP_DIFFERENCE && b->priority < a->priority) {
+        struct treap_node *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    struct treap_node *bl, *dup = NULL, *br;
+    split_node(b, a->key, &bl, &dup, &br);
+
+    bool keep = plan->op == TREAP_UNION || (plan->op == TREAP_INTERSECTION) == (dup != NULL);
+    free(dup);
+
+    if (keep) {
+        *slot = a;
+        set_op_split(plan, a->left, bl, depth - 1, &a->left);
+        set_op_split(plan, a->right, br, depth - 1, &a->right);
+        return;
+    }
+
+    struct set_op_join *join = &plan->joins[plan->njoins++];
+    struct treap_node *al = a->left, *ar = a->right;
+    join->slot = slot;
+    free(a);
+    set_op_split(plan, al, bl, depth - 1, &join->l);
+    set_op_split(plan, ar, br, depth - 1, &join->r);
+}
+
+static void *set_op_worker(void *arg) {
+    struct set_op_plan *plan = arg;
+    int i;
 
-        /* delete again */
-        root = treap_delete_node(root, key);
+    while ((i = atomic_fetch_add(&plan->next, 1)) < plan->ntasks) {
+        struct set_op_task *task = &plan->tasks[i];
+        *task->slot = set_op_node(plan->op, task->a, task->b);
     }
+    return NULL;
+}
+
+/*
+ * Split into about four tasks per thread, since treap halves are only
+ * balanced in expectation, and let a pool of `threads` workers (the caller
+ * included) claim them in turn. Joins run afterwards, children first.
+ */
+static struct treap_node *set_op(enum treap_set_op op, struct treap_node *a, struct treap_node *b, int threads) {
+    int depth = 0;
+    while (threads > 1 && (1 << depth) < threads * 4)
+        depth++;
 
+    struct treap_node *root;
+    struct set_op_plan plan = {op, malloc(sizeof(struct set_op_task) << depth),
+                               malloc(sizeof(struct set_op_join) << depth), 0, 0, 0};
+    set_op_split(&plan, a, b, depth, &root);
+
+    int nworkers = threads < plan.ntasks ? threads : plan.ntasks;
+    pthread_t *workers = malloc(nworkers * sizeof(pthread_t));
+    int started = 0;
+    while (started < nworkers - 1 && pthread_create(&workers[started], NULL, set_op_worker, &plan) == 0)
+        started++;
+    set_op_worker(&plan);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    for (int i = plan.njoins - 1; i >= 0; i--)
+        *plan.joins[i].slot = merge_node(plan.joins[i].l, plan.joins[i].r);
+
+    free(workers);
+    free(plan.tasks);
+    free(plan.joins);
     return root;
 }
 
-void treap_delete(struct treap *t, uint64_t key) {
-    t->root = treap_delete_node(t->root, key);
+/* a becomes a union b, a intersect b or a minus b; b is left empty */
+void treap_union(struct treap *a, struct treap *b, int threads) {
+    a->root = set_op(TREAP_UNION, a->root, b->root, threads);
+    b->root = NULL;
+}
+
+void treap_intersection(struct treap *a, struct treap *b, int threads) {
+    a->root = set_op(TREAP_INTERSECTION, a->root, b->root, threads);
+    b->root = NULL;
+}
+
+void treap_difference(struct treap *a, struct treap *b, int threads) {
+    a->root = set_op(TREAP_DIFFERENCE, a->root, b->root, threads);
+    b->root = NULL;
 }
 
 struct treap_node *treap_lookup(struct treap *t, uint64_t key) {
@@ -152,12 +430,134 @@ struct treap_node *treap_lookup(struct treap *t, uint64_t key) {
     return NULL;
 }
 
+/*
+ * Node with the smallest key >= key, or NULL. Nodes have no parent pointers,
+ * so an ordered walk steps with treap_lower_bound(t, n->key + 1).
+ */
+struct treap_node *treap_lower_bound(struct treap *t, uint64_t key) {
+    struct treap_node *n = t->root, *bound = NULL;
+    while (n) {
+        if (n->key < key) {
+            n = n->right;
+        } else {
+            bound = n;
+            n = n->left;
+        }
+    }
+    return bound;
+}
+
+/* Called by treap_range for each node in range; returning false stops the walk */
+typedef bool (*treap_visit_fn)(struct treap_node *n, void *ctx);
+
+/*
+ * Call visit on the nodes with lo <= key <= hi in key order, and return how
+ * many it was called on. Nodes have no parent pointers, so the walk keeps
+ * its own stack of ancestors still to visit; subtrees wholly below lo are
+ * never entered, and the walk ends at the first key above hi, so it costs
+ * O(log n + k) rather than a lower bound search per key.
+ */
+size_t treap_range(struct treap *t, uint64_t lo, uint64_t hi, treap_visit_fn visit, void *ctx) {
+    struct treap_node *inline_stack[64], **stack = inline_stack, *n = t->root;
+    size_t depth = 0, capacity = 64, count = 0;
+
+    for (;;) {
+        while (n) {
+            if (n->key < lo) {
+                n = n->right;
+                continue;
+            }
+            if (depth == capacity) {
+                struct treap_node **grown = malloc(2 * capacity * sizeof(*grown));
+                memcpy(grown, stack, depth * sizeof(*grown));
+                if (stack != inline_stack)
+                    free(stack);
+                stack = grown;
+                capacity *= 2;
+            }
+            stack[depth++] = n;
+            n = n->left;
+        }
+
+        if (!depth || stack[depth - 1]->key > hi)
+            break;
+        n = stack[--depth];
+        count++;
+        if (!visit(n, ctx))
+            break;
+        n = n->right;
+    }
+
+    if (stack != inline_stack)
+        free(stack);
+    return count;
+}
+
+#ifndef LOOKUP_BATCH_LANES
+#define LOOKUP_BATCH_LANES 16
+#endif
+
+/*
+ * Look up n keys at once, storing each match (or NULL) in results. Up to
+ * LOOKUP_BATCH_LANES descents advance in lockstep, each prefetching the node
+ * it will visit on the next pass, so their cache misses overlap. Finished
+ * lanes are refilled with the next key straight away.
+ */
+void treap_lookup_batch(struct treap *t, const uint64_t *keys, size_t n,
+                        struct treap_node **results) {
+    struct {
+        struct treap_node *node;
+        size_t idx;
+    } lanes[LOOKUP_BATCH_LANES];
+    size_t next = 0;
+    int active = 0;
+
+    while (active < LOOKUP_BATCH_LANES && next < n) {
+        lanes[active].node = t->root;
+        lanes[active++].idx = next++;
+    }
+
+    while (active) {
+        for (int j = 0; j < active;) {
+            struct treap_node *node = lanes[j].node;
+            uint64_t key = keys[lanes[j].idx];
+
+            if (!node || node->key == key) {
+                results[lanes[j].idx] = node;
+                if (next < n) {
+                    lanes[j].node = t->root;
+                    lanes[j++].idx = next++;
+                } else {
+                    lanes[j] = lanes[--active];
+                }
+                continue;
+            }
+
+            node = key < node->key ? node->left : node->right;
+            __builtin_prefetch(node);
+            lanes[j++].node = node;
+        }
+    }
+}
+
+/*
+ * Teardown without recursion: rotate left children up until the current
+ * node has none, then free it and continue right. Linear, constant space.
+ */
 static void treap_free_node(struct treap_node *n) {
-    if (!n)
-        return;
-    treap_free_node(n->left);
-    treap_free_node(n->right);
-    free(n);
+    while (n) {
+        struct treap_node *left = n->left;
+
+        if (left) {
+            n->left = left->right;
+            left->right = n;
+            n = left;
+        } else {
+            struct treap_node *right = n->right;
+            free(n);
+            n = right;
+        }
+    }
 }
 
 void treap_free(struct treap *t) {
@@ -165,24 +565,57 @@ void treap_free(struct treap *t) {
     t->root = NULL;
 }
 
-static void treap_export_dot_node(FILE *f, struct treap_node *n) {
-    if (!n)
-        return;
-
+static void treap_export_dot_one(FILE *f, struct treap_node *n, struct treap_node *right) {
     /* Print current node */
     fprintf(f, "    \"%p\" [label=\"%llu\\n(priority = %u)\"];\n",
             (void *) n, n->key, n->priority);
 
     /* Link left child */
-    if (n->left) {
+    if (n->left)
         fprintf(f, "    \"%p\" -> \"%p\" [label=\"L\"];\n", (void *) n, (void *) n->left);
-        treap_export_dot_node(f, n->left);
-    }
 
     /* Link right child */
-    if (n->right) {
-        fprintf(f, "    \"%p\" -> \"%p\" [label=\"R\"];\n", (void *) n, (void *) n->right);
-        treap_export_dot_node(f, n->right);
+    if (right)
+        fprintf(f, "    \"%p\" -> \"%p\" [label=\"R\"];\n", (void *) n, (void *) right);
+}
+
+/*
+ * While a Morris walk is under way, n->right may be a temporary thread back
+ * to the ancestor whose left subtree ends at n. That is the case exactly
+ * when n is the rightmost node below that ancestor's left child.
+ */
+static bool is_thread(struct treap_node *n) {
+    struct treap_node *p = n->right && n->right->left ? n->right->left : NULL;
+    while (p && p != n)
+        p = p->right;
+    return p == n;
+}
+
+/*
+ * Morris in-order walk: the rightmost node of each left subtree is pointed
+ * back at its ancestor on the way down and restored on the way up, so the
+ * export needs no stack or parent pointers.
+ */
+static void treap_export_dot_node(FILE *f, struct treap_node *n) {
+    while (n) {
+        if (!n->left) {
+            treap_export_dot_one(f, n, is_thread(n) ? NULL : n->right);
+            n = n->right;
+            continue;
+        }
+
+        struct treap_node *pred = n->left;
+        while (pred->right && pred->right != n)
+            pred = pred->right;
+
+        if (!pred->right) {
+            pred->right = n;
+            n = n->left;
+        } else {
+            pred->right = NULL;
+            treap_export_dot_one(f, n, is_thread(n) ? NULL : n->right);
+            n = n->right;
+        }
     }
 }
 
@@ -211,13 +644,166 @@ void treap_export_to_dot(struct treap *t, const char *filename) {
 
 #define NUM_REMOVES (NUM_INSERTS / 2)
 
+/* Other programs can #include this file to reuse the tree without its demo */
+#ifndef TREAP_NO_MAIN
+#ifndef BENCH_SET_KEYS
+#define BENCH_SET_KEYS (1 << 17)
+#endif
+
+static void treap_from_flags(struct treap *t, const bool *flags, int range) {
+    for (int k = 0; k < range; k++)
+        if (flags[k])
+            treap_insert(t, k);
+}
+
+struct range_check {
+    uint64_t lo, hi, last;
+    size_t left; /* nodes to accept before stopping the walk */
+};
+
+static bool check_range_node(struct treap_node *n, void *ctx) {
+    struct range_check *c = ctx;
+    assert(n->key >= c->lo && n->key <= c->hi && (!c->last || n->key > c->last));
+    c->last = n->key;
+    return --c->left > 0;
+}
+
+/* Run a set operation on two random treaps and compare with the flag arrays */
+static void check_set_op(void (*op)(struct treap *, struct treap *, int), int range, int threads) {
+    bool *in_a = calloc(range, sizeof(bool)), *in_b = calloc(range, sizeof(bool));
+    struct treap a = {0}, b = {0};
+
+    for (int k = 0; k < range; k++) {
+        in_a[k] = rand() % 3 == 0;
+        in_b[k] = rand() % 3 == 0;
+    }
+    treap_from_flags(&a, in_a, range);
+    treap_from_flags(&b, in_b, range);
+
+    op(&a, &b, threads);
+    assert(!b.root && treap_verify(&a));
+
+    for (int k = 0; k < range; k++) {
+        bool expected = op == treap_union          ? in_a[k] || in_b[k]
+                        : op == treap_intersection ? in_a[k] && in_b[k]
+                                                   : in_a[k] && !in_b[k];
+        assert(!treap_lookup(&a, k) == !expected);
+    }
+
+    treap_free(&a);
+    free(in_a);
+    free(in_b);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void random_treap(struct treap *t, uint64_t *keys, int n, unsigned seed) {
+    srand(seed);
+    for (int i = 0; i < n; i++) {
+        keys[i] = ((uint64_t) rand() << 16 ^ rand()) % (BENCH_SET_KEYS * 4ULL);
+        treap_insert(t, keys[i]);
+    }
+}
+
+/* Merge two overlapping treaps: key-at-a-time inserts against union */
+static void benchmark_union(void) {
+    uint64_t *keys = malloc(BENCH_SET_KEYS * sizeof(uint64_t));
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    struct treap a = {0}, b = {0};
+    double start, inserts_ms, serial_ms, parallel_ms;
+
+    random_treap(&a, keys, BENCH_SET_KEYS, 1);
+    random_treap(&b, keys, BENCH_SET_KEYS, 2);
+    start = now_ns();
+    for (int i = 0; i < BENCH_SET_KEYS; i++)
+        treap_insert(&a, keys[i]);
+    inserts_ms = (now_ns() - start) / 1e6;
+    treap_free(&a);
+    treap_free(&b);
+
+    random_treap(&a, keys, BENCH_SET_KEYS, 1);
+    random_treap(&b, keys, BENCH_SET_KEYS, 2);
+    start = now_ns();
+    treap_union(&a, &b, 1);
+    serial_ms = (now_ns() - start) / 1e6;
+    treap_free(&a);
+
+    random_treap(&a, keys, BENCH_SET_KEYS, 1);
+    random_treap(&b, keys, BENCH_SET_KEYS, 2);
+    start = now_ns();
+    treap_union(&a, &b, threads);
+    parallel_ms = (now_ns() - start) / 1e6;
+    treap_free(&a);
+
+    printf("    2 x %d keys: inserts %.1f ms, union %.1f ms, union on %d threads %.1f ms\n",
+           BENCH_SET_KEYS, inserts_ms, serial_ms, threads, parallel_ms);
+    free(keys);
+}
+
+#ifndef BENCH_THREAD_KEYS
+#define BENCH_THREAD_KEYS (1 << 16)
+#endif
+
+#ifndef BENCH_THREADS
+#define BENCH_THREADS 4
+#endif
+
+static bool same_shape(const struct treap_node *a, const struct treap_node *b) {
+    if (!a || !b)
+        return a == b;
+    return a->key == b->key && a->priority == b->priority &&
+           same_shape(a->left, b->left) && same_shape(a->right, b->right);
+}
+
+struct churn_job {
+    bool hash_priority;
+    unsigned seed;
+};
+
+/* Insert and delete BENCH_THREAD_KEYS keys in a treap private to this thread */
+static void *churn_thread(void *arg) {
+    struct churn_job *job = arg;
+    struct treap t;
+    uint64_t x = job->seed;
+
+    treap_init(&t, job->seed, job->hash_priority);
+    for (int i = 0; i < BENCH_THREAD_KEYS; i++)
+        treap_insert(&t, mix64(x + i));
+    for (int i = 0; i < BENCH_THREAD_KEYS; i++)
+        treap_delete(&t, mix64(x + i));
+    assert(!t.root);
+    return NULL;
+}
+
+static void benchmark_threads(bool hash_priority) {
+    pthread_t threads[BENCH_THREADS];
+    struct churn_job jobs[BENCH_THREADS];
+    double start = now_ns();
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        jobs[i] = (struct churn_job) {hash_priority, i + 1};
+        pthread_create(&threads[i], NULL, churn_thread, &jobs[i]);
+    }
+    for (int i = 0; i < BENCH_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    printf("    %d threads x %d keys, %s priorities: %.1f ns per insert+delete\n",
+           BENCH_THREADS, BENCH_THREAD_KEYS, hash_priority ? "hashed" : "xorshift",
+           (now_ns() - start) / ((double) BENCH_THREADS * BENCH_THREAD_KEYS));
+}
+
 int main(void) {
     printf("Treap... ");
     fflush(stdout);
 
-    struct treap t = {0};
+    struct treap t;
     int *values = malloc(NUM_INSERTS * sizeof(int));
     srand((unsigned) time(NULL));
+    treap_init(&t, (uint64_t) time(NULL), false);
 
     /* Insert random unique keys */
     for (int i = 0; i < NUM_INSERTS;) {
@@ -237,6 +823,22 @@ int main(void) {
 
     assert(treap_verify(&t));
 
+    /* Duplicates are ignored */
+    treap_insert(&t, values[0]);
+    assert(treap_verify(&t));
+
+    /* Hashed priorities give the same shape whatever the insertion order */
+    struct treap forward, backward;
+    treap_init(&forward, 42, true);
+    treap_init(&backward, 42, true);
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        treap_insert(&forward, values[i]);
+        treap_insert(&backward, values[NUM_INSERTS - 1 - i]);
+    }
+    assert(treap_verify(&forward) && same_shape(forward.root, backward.root));
+    treap_free(&forward);
+    treap_free(&backward);
+
     /* Shuffle keys before removal */
     for (int i = NUM_INSERTS - 1; i > 0; i--) {
         int j = rand() % (i + 1);
@@ -257,10 +859,69 @@ int main(void) {
         assert(n && n->key == (uint64_t) values[i]);
     }
 
+    /* Batched lookups must agree, removed keys included */
+    uint64_t *keys = malloc(NUM_INSERTS * sizeof(uint64_t));
+    struct treap_node **found = malloc(NUM_INSERTS * sizeof(struct treap_node *));
+    for (int i = 0; i < NUM_INSERTS; i++)
+        keys[i] = values[i];
+    treap_lookup_batch(&t, keys, NUM_INSERTS, found);
+    for (int i = 0; i < NUM_INSERTS; i++)
+        assert(found[i] == treap_lookup(&t, keys[i]));
+    free(found);
+    free(keys);
+
+    /* Split and merge back at a random pivot */
+    struct treap lo = {0}, hi = {0};
+    uint64_t pivot = rand() % (NUM_INSERTS * 10);
+    treap_split(&t, pivot, &lo, &hi);
+    assert(!t.root && treap_verify(&lo) && treap_verify(&hi));
+    for (int i = NUM_REMOVES; i < NUM_INSERTS; i++) {
+        struct treap *side = (uint64_t) values[i] < pivot ? &lo : &hi;
+        assert(treap_lookup(side, values[i]));
+    }
+    treap_merge(&t, &lo, &hi);
+    assert(treap_verify(&t) && !lo.root && !hi.root);
+
+    for (int threads = 1; threads <= 4; threads *= 4) {
+        check_set_op(treap_union, NUM_INSERTS * 10, threads);
+        check_set_op(treap_intersection, NUM_INSERTS * 10, threads);
+        check_set_op(treap_difference, NUM_INSERTS * 10, threads);
+    }
+
+    /* Big enough for the split to hand the pool more than one task */
+    check_set_op(treap_union, SET_OP_CUTOFF * 16, 4);
+    check_set_op(treap_intersection, SET_OP_CUTOFF * 16, 4);
+    check_set_op(treap_difference, SET_OP_CUTOFF * 16, 4);
+
     printf("complete\n");
 
     treap_export_to_dot(&t, "treap.dot");
+
+    /* A range walk sees the keys in [lo, hi] in order, and stops when told to */
+    uint64_t range_lo = NUM_INSERTS * 2, range_hi = NUM_INSERTS * 6;
+    struct range_check check = {range_lo, range_hi, 0, SIZE_MAX};
+    size_t in_range = 0;
+    for (int i = NUM_REMOVES; i < NUM_INSERTS; i++)
+        in_range += (uint64_t) values[i] >= range_lo && (uint64_t) values[i] <= range_hi;
+    assert(treap_range(&t, range_lo, range_hi, check_range_node, &check) == in_range);
+    check = (struct range_check) {range_lo, range_hi, 0, 3};
+    assert(treap_range(&t, range_lo, range_hi, check_range_node, &check) == (in_range < 3 ? in_range : 3));
+    assert(treap_range(&t, range_hi, range_lo, check_range_node, &check) == 0);
+
+    /* Range delete keeps everything outside [lo, hi) */
+    treap_delete_range(&t, range_lo, range_hi);
+    assert(treap_verify(&t));
+    for (int i = NUM_REMOVES; i < NUM_INSERTS; i++) {
+        bool deleted = (uint64_t) values[i] >= range_lo && (uint64_t) values[i] < range_hi;
+        assert(!treap_lookup(&t, values[i]) == deleted);
+    }
+
     treap_free(&t);
     free(values);
+
+    benchmark_union();
+    benchmark_threads(false);
+    benchmark_threads(true);
     return 0;
 }
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Instantiations of the treap generator in treap_gen.h: one for uint64_t
+ * keys, timed against the hand-written tree in treap.c, and one for 128-bit
+ * identifiers. Both sides draw priorities from the same xorshift sequence,
+ * so the int trees come out the same shape.
+ */
+
+#define TREAP_NO_MAIN
+#include "treap.c"
+
+#include "treap_gen.h"
+#include "id128.h"
+
+#define u64_cmp(a, b) ((a) == (b) ? 0 : (a) < (b) ? -1 : 1)
+
+TREAP_GENERATE(u64_treap, uint64_t, u64_cmp)
+TREAP_GENERATE(id_treap, struct id128, id128_cmp)
+
+void export_u64_treap_to_dot(struct u64_treap *t, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing: %s\n", filename);
+        return;
+    }
+    fprintf(fp, "digraph GeneratedTreap {\n");
+    fprintf(fp, "    node [shape=record, style=filled, fillcolor=lightgrey];\n");
+    for (struct u64_treap_node *n = u64_treap_min(t); n; n = u64_treap_next(t, n)) {
+        fprintf(fp, "    \"%llu\" [label=\"%llu\\n(priority = %u)\"];\n", n->key, n->key, n->priority);
+        if (n->left)
+            fprintf(fp, "    \"%llu\" -> \"%llu\" [label=\"L\"];\n", n->key, n->left->key);
+        if (n->right)
+            fprintf(fp, "    \"%llu\" -> \"%llu\" [label=\"R\"];\n", n->key, n->right->key);
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+#ifndef BENCH_GEN_KEYS
+#define BENCH_GEN_KEYS (1 << 20)
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Insert, look up and delete the same shuffled keys in treap.c and in u64_treap */
+static void benchmark_parity(void) {
+    uint64_t *keys = malloc(BENCH_GEN_KEYS * sizeof(uint64_t));
+    double t[3][3];
+    long found = 0;
+
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        keys[i] = i;
+    for (int i = BENCH_GEN_KEYS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        uint64_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    struct treap hand = {0};
+    double start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        treap_insert(&hand, keys[i]);
+    t[0][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found += treap_lookup(&hand, keys[BENCH_GEN_KEYS - 1 - i]) != NULL;
+    t[0][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        treap_delete(&hand, keys[i]);
+    t[0][2] = now_ns() - start;
+    assert(!hand.root);
+
+    struct u64_treap gen;
+    u64_treap_init(&gen);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        u64_treap_insert(&gen, keys[i]);
+    t[1][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        found -= u64_treap_find(&gen, keys[BENCH_GEN_KEYS - 1 - i]) != NULL;
+    t[1][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        u64_treap_delete(&gen, keys[i]);
+    t[1][2] = now_ns() - start;
+    assert(found == 0 && !gen.root);
+
+    struct id_treap ids;
+    id_treap_init(&ids);
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_treap_insert(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][0] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++) {
+        uint64_t k = keys[BENCH_GEN_KEYS - 1 - i];
+        found += id_treap_find(&ids, (struct id128){k & 7, k}) != NULL;
+    }
+    t[2][1] = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < BENCH_GEN_KEYS; i++)
+        id_treap_delete(&ids, (struct id128){keys[i] & 7, keys[i]});
+    t[2][2] = now_ns() - start;
+    assert(found == BENCH_GEN_KEYS && !ids.root);
+
+    const char *names[] = {"treap.c, uint64_t", "generated, uint64_t", "generated, 128-bit"};
+    printf("    %d keys, ns per insert / find / delete:\n", BENCH_GEN_KEYS);
+    for (int i = 0; i < 3; i++)
+        printf("    %-19s %6.1f %6.1f %6.1f\n", names[i], t[i][0] / BENCH_GEN_KEYS,
+               t[i][1] / BENCH_GEN_KEYS, t[i][2] / BENCH_GEN_KEYS);
+    free(keys);
+}
+
+int main() {
+    printf("Generated treaps... ");
+    fflush(stdout);
+
+    struct u64_treap tree;
+    struct id_treap ids;
+    struct treap hand = {0};
+    int *values = malloc(NUM_INSERTS * sizeof(int));
+    char *present = calloc(NUM_INSERTS * 4, 1);
+
+    srand((unsigned) time(NULL));
+    u64_treap_init(&tree);
+    id_treap_init(&ids);
+
+    for (int i = 0; i < NUM_INSERTS;) {
+        int value = rand() % (NUM_INSERTS * 4);
+        if (present[value])
+            continue;
+
+        present[value] = 1;
+        values[i++] = value;
+        struct u64_treap_node *n = u64_treap_insert(&tree, value);
+        assert(n->key == (uint64_t) value && u64_treap_insert(&tree, value) == n);
+        assert(u64_treap_validate(&tree) == 0);
+        treap_insert(&hand, value);
+        treap_insert(&hand, value);
+
+        /* Same low word, so only the high word separates these */
+        id_treap_insert(&ids, (struct id128){value, 42});
+        id_treap_insert(&ids, (struct id128){value + 1ULL * NUM_INSERTS * 4, 42});
+        assert(id_treap_validate(&ids) == 0);
+    }
+    assert(tree.size == NUM_INSERTS && ids.size == 2 * NUM_INSERTS);
+
+    for (int i = 0; i < NUM_REMOVES; i++) {
+        assert(u64_treap_delete(&tree, values[i]));
+        assert(!u64_treap_delete(&tree, values[i]));
+        present[values[i]] = 0;
+        assert(u64_treap_validate(&tree) == 0);
+        treap_delete(&hand, values[i]);
+
+        assert(id_treap_delete(&ids, (struct id128){values[i], 42}));
+        assert(id_treap_validate(&ids) == 0);
+    }
+
+    for (int k = 0; k < NUM_INSERTS * 4; k++) {
+        assert(!u64_treap_find(&tree, k) == !present[k]);
+        assert(!id_treap_find(&ids, (struct id128){k, 42}) == !present[k]);
+    }
+
+    /* Same priority sequence, same operations: treap.c built the same tree */
+    assert(hand.root && hand.root->key == tree.root->key);
+    for (struct u64_treap_node *n = u64_treap_min(&tree); n; n = u64_treap_next(&tree, n)) {
+        struct treap_node *h = treap_lookup(&hand, n->key);
+        assert(h && h->priority == n->priority);
+        assert(!h->left == !n->left && (!n->left || h->left->key == n->left->key));
+        assert(!h->right == !n->right && (!n->right || h->right->key == n->right->key));
+    }
+
+    export_u64_treap_to_dot(&tree, "treap_gen.dot");
+    printf("complete\n");
+
+    u64_treap_free(&tree);
+    id_treap_free(&ids);
+    treap_free(&hand);
+    free(present);
+    free(values);
+
+    benchmark_parity();
+    return 0;
+}
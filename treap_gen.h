@@ -0,0 +1,202 @@
+/*
+ * Treap generator in the style of BSD <sys/tree.h>, the counterpart of
+ * rbt_gen.h for the tree in treap.c.
+ *
+ *     TREAP_GENERATE(name, key_type, cmp)
+ *
+ * expands to struct name_node, struct name and a set of static functions
+ * prefixed with name_, all specialised for key_type. cmp is as in
+ * rbt_gen.h and is expanded at every comparison. Keys are unique. Insert
+ * and delete are the rotation-free ones from treap.c, with priorities from
+ * a per-tree xorshift64 generator seeded as treap.c seeds a zeroed treap.
+ * Nodes have no parent pointers, so name_next searches from the root.
+ *
+ *     name_init(t)            empty tree
+ *     name_insert(t, key)     node for key, added if absent
+ *     name_find(t, key)       node for key, or NULL
+ *     name_delete(t, key)     remove key; 1 if it was present
+ *     name_min(t), name_next(t, node)
+ *     name_free(t)            free every node, in constant space
+ *     name_validate(t)        0, or -1 if a property is broken
+ */
+
+#ifndef TREAP_GEN_H
+#define TREAP_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TREAP_GENERATE(name, key_type, cmp)                                                \
+    struct name##_node {                                                                   \
+        key_type key;                                                                      \
+        uint32_t priority;                                                                 \
+        struct name##_node *left;                                                          \
+        struct name##_node *right;                                                         \
+    };                                                                                     \
+                                                                                           \
+    struct name {                                                                          \
+        struct name##_node *root;                                                          \
+        size_t size;                                                                       \
+        uint64_t seed; /* xorshift state */                                                \
+    };                                                                                     \
+                                                                                           \
+    static __attribute__((unused)) void name##_init(struct name *t) {                      \
+        t->root = NULL;                                                                    \
+        t->size = 0;                                                                       \
+        t->seed = 0x9e3779b97f4a7c15ULL;                                                   \
+    }                                                                                      \
+                                                                                           \
+    static inline uint32_t name##_priority(struct name *t) {                               \
+        uint64_t x = t->seed;                                                              \
+        x ^= x << 13;                                                                      \
+        x ^= x >> 7;                                                                       \
+        x ^= x << 17;                                                                      \
+        t->seed = x;                                                                       \
+        return x >> 32;                                                                    \
+    }                                                                                      \
+                                                                                           \
+    /* Link the merge of a and b, every key of a below every key of b, at *link */         \
+    static void name##_merge_into(struct name##_node **link, struct name##_node *a,        \
+                                  struct name##_node *b) {                                 \
+        while (a && b) {                                                                   \
+            if (a->priority <= b->priority) {                                              \
+                *link = a;                                                                 \
+                link = &a->right;                                                          \
+                a = a->right;                                                              \
+            } else {                                                                       \
+                *link = b;                                                                 \
+                link = &b->left;                                                           \
+                b = b->left;                                                               \
+            }                                                                              \
+        }                                                                                  \
+        *link = a ? a : b;                                                                 \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_find(struct name *t,         \
+                                                                   key_type key) {         \
+        struct name##_node *n = t->root;                                                   \
+        /* The two-test form of rbt_gen.h, for the same reason */                          \
+        while (n && cmp(key, n->key) != 0)                                                 \
+            n = cmp(key, n->key) < 0 ? n->left : n->right;                                 \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Descend to where the new node belongs by priority, then split below it */           \
+    static __attribute__((unused)) struct name##_node *name##_insert(struct name *t,       \
+                                                                     key_type key) {       \
+        uint32_t priority = name##_priority(t);                                            \
+        struct name##_node **link = &t->root;                                              \
+        while (*link && (*link)->priority <= priority) {                                   \
+            if (cmp(key, (*link)->key) == 0)                                               \
+                return *link;                                                              \
+            link = cmp(key, (*link)->key) < 0 ? &(*link)->left : &(*link)->right;          \
+        }                                                                                  \
+        for (struct name##_node *n = *link; n; n = cmp(key, n->key) < 0 ? n->left : n->right) \
+            if (cmp(key, n->key) == 0)                                                     \
+                return n;                                                                  \
+        struct name##_node *n = malloc(sizeof(*n)), *rest = *link;                         \
+        struct name##_node **l = &n->left, **r = &n->right;                                \
+        n->key = key;                                                                      \
+        n->priority = priority;                                                            \
+        while (rest) {                                                                     \
+            if (cmp(rest->key, key) < 0) {                                                 \
+                *l = rest;                                                                 \
+                l = &rest->right;                                                          \
+                rest = rest->right;                                                        \
+            } else {                                                                       \
+                *r = rest;                                                                 \
+                r = &rest->left;                                                           \
+                rest = rest->left;                                                         \
+            }                                                                              \
+        }                                                                                  \
+        *l = *r = NULL;                                                                    \
+        *link = n;                                                                         \
+        t->size++;                                                                         \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) int name##_delete(struct name *t, key_type key) {       \
+        struct name##_node **link = &t->root;                                              \
+        while (*link && cmp(key, (*link)->key) != 0)                                       \
+            link = cmp(key, (*link)->key) < 0 ? &(*link)->left : &(*link)->right;          \
+        if (!*link)                                                                        \
+            return 0;                                                                      \
+        struct name##_node *n = *link;                                                     \
+        name##_merge_into(link, n->left, n->right);                                        \
+        t->size--;                                                                         \
+        free(n);                                                                           \
+        return 1;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static __attribute__((unused)) struct name##_node *name##_min(struct name *t) {        \
+        struct name##_node *n = t->root;                                                   \
+        while (n && n->left)                                                               \
+            n = n->left;                                                                   \
+        return n;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Smallest node above n: O(log n), from the root */                                   \
+    static __attribute__((unused)) struct name##_node *name##_next(struct name *t,         \
+                                                                   struct name##_node *n) { \
+        if (n->right) {                                                                    \
+            n = n->right;                                                                  \
+            while (n->left)                                                                \
+                n = n->left;                                                               \
+            return n;                                                                      \
+        }                                                                                  \
+        struct name##_node *x = t->root, *bound = NULL;                                    \
+        while (x != n) {                                                                   \
+            if (cmp(n->key, x->key) < 0) {                                                 \
+                bound = x;                                                                 \
+                x = x->left;                                                               \
+            } else {                                                                       \
+                x = x->right;                                                              \
+            }                                                                              \
+        }                                                                                  \
+        return bound;                                                                      \
+    }                                                                                      \
+                                                                                           \
+    /* Rotation-based teardown: linear, no recursion */                                    \
+    static __attribute__((unused)) void name##_free(struct name *t) {                      \
+        struct name##_node *n = t->root;                                                   \
+        while (n) {                                                                        \
+            struct name##_node *left = n->left;                                            \
+            if (left) {                                                                    \
+                n->left = left->right;                                                     \
+                left->right = n;                                                           \
+                n = left;                                                                  \
+            } else {                                                                       \
+                struct name##_node *right = n->right;                                      \
+                free(n);                                                                   \
+                n = right;                                                                 \
+            }                                                                              \
+        }                                                                                  \
+        t->root = NULL;                                                                    \
+        t->size = 0;                                                                       \
+    }                                                                                      \
+                                                                                           \
+    /* min and max are the nearest ancestors bounding n, or NULL when unbounded */         \
+    static size_t name##_validate_node(const struct name##_node *n,                        \
+                                       const struct name##_node *min,                      \
+                                       const struct name##_node *max) {                    \
+        if (!n)                                                                            \
+            return 0;                                                                      \
+        if ((min && cmp(n->key, min->key) <= 0) || (max && cmp(n->key, max->key) >= 0))    \
+            return SIZE_MAX;                                                               \
+        if ((n->left && n->left->priority < n->priority) ||                                \
+            (n->right && n->right->priority < n->priority))                                \
+            return SIZE_MAX;                                                               \
+        size_t left = name##_validate_node(n->left, min, n);                               \
+        size_t right = name##_validate_node(n->right, n, max);                             \
+        if (left == SIZE_MAX || right == SIZE_MAX)                                         \
+            return SIZE_MAX;                                                               \
+        return left + right + 1;                                                           \
+    }                                                                                      \
+                                                                                           \
+    /* Key order, heap order on priorities, and t->size nodes */                           \
+    static __attribute__((unused)) int name##_validate(struct name *t) {                   \
+        return name##_validate_node(t->root, NULL, NULL) == t->size ? 0 : -1;              \
+    }
+
+#endif
@@ -0,0 +1,421 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Implicit treap: a sequence in which a node's key is its position, never
+ * stored but recovered from subtree sizes on the way down. Splitting and
+ * concatenating by index are the primitives; everything else is a couple of
+ * splits and merges, each O(log n) expected.
+ */
+struct implicit_treap_node {
+    char value;
+    uint32_t priority;
+    size_t size;
+    struct implicit_treap_node *left, *right;
+};
+
+struct implicit_treap {
+    struct implicit_treap_node *root;
+    uint64_t seed; /* xorshift64 state */
+};
+
+static inline size_t node_size(const struct implicit_treap_node *n) {
+    return n ? n->size : 0;
+}
+
+static inline void update_size(struct implicit_treap_node *n) {
+    n->size = 1 + node_size(n->left) + node_size(n->right);
+}
+
+static uint32_t next_priority(struct implicit_treap *t) {
+    uint64_t x = t->seed ? t->seed : 0x9e3779b97f4a7c15ULL;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    t->seed = x;
+    return x >> 32;
+}
+
+static struct implicit_treap_node *create_node(struct implicit_treap *t, char value) {
+    struct implicit_treap_node *n = malloc(sizeof(*n));
+    n->value = value;
+    n->priority = next_priority(t);
+    n->size = 1;
+    n->left = n->right = NULL;
+    return n;
+}
+
+/* First k elements of n into *l, the rest into *r */
+static void split_node(struct implicit_treap_node *n, size_t k,
+                       struct implicit_treap_node **l, struct implicit_treap_node **r) {
+    if (!n) {
+        *l = *r = NULL;
+        return;
+    }
+
+    if (node_size(n->left) < k) {
+        split_node(n->right, k - node_size(n->left) - 1, &n->right, r);
+        *l = n;
+    } else {
+        split_node(n->left, k, l, &n->left);
+        *r = n;
+    }
+    update_size(n);
+}
+
+static struct implicit_treap_node *merge_node(struct implicit_treap_node *a,
+                                              struct implicit_treap_node *b) {
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (a->priority <= b->priority) {
+        a->right = merge_node(a->right, b);
+        update_size(a);
+        return a;
+    }
+    b->left = merge_node(a, b->left);
+    update_size(b);
+    return b;
+}
+
+/* Restore heap order below n, whose children are already heaps */
+static void sift_down(struct implicit_treap_node *n) {
+    for (;;) {
+        struct implicit_treap_node *min = n;
+        if (n->left && n->left->priority < min->priority)
+            min = n->left;
+        if (n->right && n->right->priority < min->priority)
+            min = n->right;
+        if (min == n)
+            return;
+
+        uint32_t tmp = n->priority;
+        n->priority = min->priority;
+        min->priority = tmp;
+        n = min;
+    }
+}
+
+/*
+ * Perfectly balanced tree over data[0, n), then heapified bottom-up: moving
+ * priorities around never changes the shape, and the sift-downs sum to O(n).
+ */
+static struct implicit_treap_node *build_node(struct implicit_treap *t, const char *data, size_t n) {
+    if (!n)
+        return NULL;
+
+    size_t mid = n / 2;
+    struct implicit_treap_node *node = create_node(t, data[mid]);
+    node->left = build_node(t, data, mid);
+    node->right = build_node(t, data + mid + 1, n - mid - 1);
+    node->size = n;
+    sift_down(node);
+    return node;
+}
+
+size_t implicit_treap_size(struct implicit_treap *t) {
+    return node_size(t->root);
+}
+
+/* O(n) construction from an array; t must be empty */
+void implicit_treap_build(struct implicit_treap *t, const char *data, size_t n) {
+    assert(!t->root);
+    t->root = build_node(t, data, n);
+}
+
+/* Move the first k elements of t into lo and the rest into hi; t may be lo or hi */
+void implicit_treap_split(struct implicit_treap *t, size_t k,
+                          struct implicit_treap *lo, struct implicit_treap *hi) {
+    struct implicit_treap_node *root = t->root;
+    t->root = NULL;
+    split_node(root, k, &lo->root, &hi->root);
+}
+
+/* Append all of b to t, leaving b empty */
+void implicit_treap_concat(struct implicit_treap *t, struct implicit_treap *b) {
+    t->root = merge_node(t->root, b->root);
+    b->root = NULL;
+}
+
+struct implicit_treap_node *implicit_treap_at(struct implicit_treap *t, size_t pos) {
+    struct implicit_treap_node *n = t->root;
+    while (n) {
+        size_t left = node_size(n->left);
+        if (pos < left) {
+            n = n->left;
+        } else if (pos > left) {
+            pos -= left + 1;
+            n = n->right;
+        } else {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+/* Insert data[0, n) so that it starts at pos (clamped to the end) */
+void implicit_treap_insert(struct implicit_treap *t, size_t pos, const char *data, size_t n) {
+    struct implicit_treap_node *l, *r;
+    struct implicit_treap piece = {NULL, t->seed};
+
+    implicit_treap_build(&piece, data, n);
+    t->seed = piece.seed;
+    split_node(t->root, pos, &l, &r);
+    t->root = merge_node(merge_node(l, piece.root), r);
+}
+
+/* Cut [pos, pos + len) out of t into out, which must be empty */
+void implicit_treap_slice(struct implicit_treap *t, size_t pos, size_t len,
+                          struct implicit_treap *out) {
+    struct implicit_treap_node *l, *mid, *r;
+
+    assert(!out->root);
+    split_node(t->root, pos, &l, &r);
+    split_node(r, len, &mid, &r);
+    out->root = mid;
+    t->root = merge_node(l, r);
+}
+
+static void free_node(struct implicit_treap_node *n) {
+    if (!n)
+        return;
+    free_node(n->left);
+    free_node(n->right);
+    free(n);
+}
+
+void implicit_treap_free(struct implicit_treap *t) {
+    free_node(t->root);
+    t->root = NULL;
+}
+
+void implicit_treap_delete(struct implicit_treap *t, size_t pos, size_t len) {
+    struct implicit_treap cut = {NULL};
+    implicit_treap_slice(t, pos, len, &cut);
+    implicit_treap_free(&cut);
+}
+
+static size_t to_array_node(const struct implicit_treap_node *n, char *out) {
+    if (!n)
+        return 0;
+    size_t k = to_array_node(n->left, out);
+    out[k++] = n->value;
+    return k + to_array_node(n->right, out + k);
+}
+
+/* Copy the sequence into out, which must hold implicit_treap_size(t) elements */
+size_t implicit_treap_to_array(struct implicit_treap *t, char *out) {
+    return to_array_node(t->root, out);
+}
+
+static bool verify_node(const struct implicit_treap_node *n) {
+    if (!n)
+        return true;
+
+    if (n->size != 1 + node_size(n->left) + node_size(n->right)) {
+        fprintf(stderr, "Size violation: node has size %zu, children %zu + %zu\n",
+                n->size, node_size(n->left), node_size(n->right));
+        return false;
+    }
+
+    if ((n->left && n->left->priority < n->priority) ||
+        (n->right && n->right->priority < n->priority)) {
+        fprintf(stderr, "Heap violation at node with priority %u\n", n->priority);
+        return false;
+    }
+
+    return verify_node(n->left) && verify_node(n->right);
+}
+
+bool implicit_treap_verify(struct implicit_treap *t) {
+    return verify_node(t->root);
+}
+
+static size_t export_dot_node(FILE *f, struct implicit_treap_node *n, size_t base) {
+    if (!n)
+        return 0;
+
+    size_t pos = base + node_size(n->left);
+    fprintf(f, "    \"%p\" [label=\"[%zu] '%c'\\n(size = %zu)\"];\n", (void *) n, pos, n->value, n->size);
+
+    if (n->left) {
+        fprintf(f, "    \"%p\" -> \"%p\" [label=\"L\"];\n", (void *) n, (void *) n->left);
+        export_dot_node(f, n->left, base);
+    }
+
+    if (n->right) {
+        fprintf(f, "    \"%p\" -> \"%p\" [label=\"R\"];\n", (void *) n, (void *) n->right);
+        export_dot_node(f, n->right, pos + 1);
+    }
+    return n->size;
+}
+
+void implicit_treap_export_to_dot(struct implicit_treap *t, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) {
+        perror("fopen");
+        return;
+    }
+
+    fprintf(f, "digraph implicit_treap {\n");
+    fprintf(f, "    node [shape=record, style=filled, fillcolor=lightgrey];\n");
+
+    if (t->root)
+        export_dot_node(f, t->root, 0);
+    else
+        fprintf(f, "    null [label=\"empty\"];\n");
+
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#ifndef BENCH_LENGTH
+#define BENCH_LENGTH (1 << 20)
+#endif
+
+#ifndef BENCH_EDITS
+#define BENCH_EDITS 20000
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Random short inserts and deletes on a large buffer: memmove against splits */
+static void benchmark(void) {
+    char *buffer = malloc(BENCH_LENGTH + BENCH_EDITS * 8);
+    char *check = malloc(BENCH_LENGTH + BENCH_EDITS * 8);
+    size_t len = BENCH_LENGTH, *positions = malloc(BENCH_EDITS * sizeof(size_t));
+    const char text[8] = "abcdefgh";
+    struct implicit_treap t = {NULL, 7};
+
+    for (size_t i = 0; i < len; i++)
+        buffer[i] = 'a' + i % 26;
+    for (int i = 0; i < BENCH_EDITS; i++)
+        positions[i] = rand();
+
+    double start = now_ns();
+    implicit_treap_build(&t, buffer, len);
+    double build_ms = (now_ns() - start) / 1e6;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_EDITS; i++) {
+        size_t pos = positions[i] % len;
+        if (i % 2 == 0) {
+            memmove(buffer + pos + 8, buffer + pos, len - pos);
+            memcpy(buffer + pos, text, 8);
+            len += 8;
+        } else {
+            size_t n = pos + 4 <= len ? 4 : len - pos;
+            memmove(buffer + pos, buffer + pos + n, len - pos - n);
+            len -= n;
+        }
+    }
+    double memmove_ns = (now_ns() - start) / BENCH_EDITS;
+
+    len = BENCH_LENGTH;
+    start = now_ns();
+    for (int i = 0; i < BENCH_EDITS; i++) {
+        size_t pos = positions[i] % len;
+        if (i % 2 == 0) {
+            implicit_treap_insert(&t, pos, text, 8);
+            len += 8;
+        } else {
+            size_t n = pos + 4 <= len ? 4 : len - pos;
+            implicit_treap_delete(&t, pos, n);
+            len -= n;
+        }
+    }
+    double treap_ns = (now_ns() - start) / BENCH_EDITS;
+
+    assert(implicit_treap_size(&t) == len);
+    implicit_treap_to_array(&t, check);
+    assert(memcmp(check, buffer, len) == 0);
+
+    printf("    %d chars: build %.1f ms; per edit memmove %.1f ns, treap %.1f ns\n",
+           BENCH_LENGTH, build_ms, memmove_ns, treap_ns);
+
+    implicit_treap_free(&t);
+    free(positions);
+    free(check);
+    free(buffer);
+}
+
+int main(void) {
+    printf("Implicit treap... ");
+    fflush(stdout);
+
+    srand((unsigned) time(NULL));
+
+    /* Mirror every edit on a plain array */
+    size_t capacity = NUM_INSERTS * 8 + 26, len = 26;
+    char *mirror = malloc(capacity), *check = malloc(capacity);
+    struct implicit_treap t = {NULL, (uint64_t) time(NULL)};
+
+    for (size_t i = 0; i < len; i++)
+        mirror[i] = 'a' + i;
+    implicit_treap_build(&t, mirror, len);
+    assert(implicit_treap_verify(&t));
+
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        size_t pos = rand() % (len + 1);
+        char piece[4];
+        size_t n = 1 + rand() % 4;
+
+        if (rand() % 3) {
+            for (size_t j = 0; j < n; j++)
+                piece[j] = 'A' + rand() % 26;
+            implicit_treap_insert(&t, pos, piece, n);
+            memmove(mirror + pos + n, mirror + pos, len - pos);
+            memcpy(mirror + pos, piece, n);
+            len += n;
+        } else {
+            if (pos + n > len)
+                n = len - pos;
+            implicit_treap_delete(&t, pos, n);
+            memmove(mirror + pos, mirror + pos + n, len - pos - n);
+            len -= n;
+        }
+
+        assert(implicit_treap_verify(&t) && implicit_treap_size(&t) == len);
+        implicit_treap_to_array(&t, check);
+        assert(memcmp(check, mirror, len) == 0);
+    }
+
+    for (size_t i = 0; i < len; i++)
+        assert(implicit_treap_at(&t, i)->value == mirror[i]);
+    assert(!implicit_treap_at(&t, len));
+
+    /* Split anywhere and concatenate back */
+    struct implicit_treap lo = {NULL}, hi = {NULL};
+    size_t k = rand() % (len + 1);
+    implicit_treap_split(&t, k, &lo, &hi);
+    assert(implicit_treap_size(&lo) == k && implicit_treap_size(&hi) == len - k);
+    implicit_treap_concat(&lo, &hi);
+    implicit_treap_to_array(&lo, check);
+    assert(memcmp(check, mirror, len) == 0 && implicit_treap_verify(&lo));
+    t = lo;
+
+    implicit_treap_export_to_dot(&t, "treap_implicit.dot");
+    printf("complete\n");
+
+    implicit_treap_free(&t);
+    free(check);
+    free(mirror);
+
+    benchmark();
+    return 0;
+}
@@ -0,0 +1,399 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Persistent treap. Insert, delete, split and merge copy the nodes they would
+ * have modified and leave the originals alone, so every earlier root stays a
+ * valid set and shares all untouched subtrees with the new one. Forking a set
+ * is taking one more reference to its root.
+ *
+ * Priorities are a hash of the key, so a key has the same priority in every
+ * version and a set's shape depends only on its contents.
+ *
+ * refcount is the number of nodes and roots pointing at a node. A node that
+ * an update reaches through a shared parent has a count of at least two, so
+ * a count of one means the update created it and may modify it in place.
+ */
+struct ptreap_node {
+    uint64_t key;
+    uint32_t priority;
+    uint32_t refcount;
+    struct ptreap_node *left, *right;
+};
+
+static size_t live_nodes;
+
+/* splitmix64's finalizer */
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static struct ptreap_node *ptreap_create_node(uint64_t key) {
+    struct ptreap_node *n = malloc(sizeof(*n));
+    n->key = key;
+    n->priority = mix64(key) >> 32;
+    n->refcount = 1;
+    n->left = n->right = NULL;
+    live_nodes++;
+    return n;
+}
+
+/* O(1) fork: one more reference to the same set */
+struct ptreap_node *ptreap_retain(struct ptreap_node *root) {
+    if (root)
+        root->refcount++;
+    return root;
+}
+
+void ptreap_release(struct ptreap_node *root) {
+    if (!root || --root->refcount)
+        return;
+
+    ptreap_release(root->left);
+    ptreap_release(root->right);
+    free(root);
+    live_nodes--;
+}
+
+/* Consume a reference to n and return a node with its contents that may be modified */
+static struct ptreap_node *unshare(struct ptreap_node *n) {
+    if (n->refcount == 1)
+        return n;
+
+    struct ptreap_node *copy = malloc(sizeof(*copy));
+    copy->key = n->key;
+    copy->priority = n->priority;
+    copy->refcount = 1;
+    copy->left = ptreap_retain(n->left);
+    copy->right = ptreap_retain(n->right);
+    live_nodes++;
+    n->refcount--;
+    return copy;
+}
+
+/* The helpers below consume the references they are given */
+
+/* Keys < key into *l, the rest into *r */
+static void split_node(struct ptreap_node *n, uint64_t key, struct ptreap_node **l, struct ptreap_node **r) {
+    if (!n) {
+        *l = *r = NULL;
+        return;
+    }
+
+    n = unshare(n);
+    if (n->key < key) {
+        split_node(n->right, key, &n->right, r);
+        *l = n;
+    } else {
+        split_node(n->left, key, l, &n->left);
+        *r = n;
+    }
+}
+
+/* Every key in a must be smaller than every key in b */
+static struct ptreap_node *merge_node(struct ptreap_node *a, struct ptreap_node *b) {
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (a->priority <= b->priority) {
+        a = unshare(a);
+        a->right = merge_node(a->right, b);
+        return a;
+    }
+    b = unshare(b);
+    b->left = merge_node(a, b->left);
+    return b;
+}
+
+static struct ptreap_node *insert_node(struct ptreap_node *n, struct ptreap_node *new) {
+    if (!n || new->priority < n->priority) {
+        split_node(n, new->key, &new->left, &new->right);
+        return new;
+    }
+
+    n = unshare(n);
+    if (new->key < n->key)
+        n->left = insert_node(n->left, new);
+    else
+        n->right = insert_node(n->right, new);
+    return n;
+}
+
+static struct ptreap_node *delete_node(struct ptreap_node *n, uint64_t key) {
+    n = unshare(n);
+
+    if (key < n->key) {
+        n->left = delete_node(n->left, key);
+    } else if (key > n->key) {
+        n->right = delete_node(n->right, key);
+    } else {
+        struct ptreap_node *l = n->left, *r = n->right;
+        n->left = n->right = NULL;
+        ptreap_release(n);
+        return merge_node(l, r);
+    }
+    return n;
+}
+
+struct ptreap_node *ptreap_lookup(struct ptreap_node *root, uint64_t key) {
+    while (root && root->key != key)
+        root = key < root->key ? root->left : root->right;
+    return root;
+}
+
+/*
+ * The public operations leave their inputs untouched and valid, and return
+ * new references that the caller must release.
+ */
+struct ptreap_node *ptreap_insert(struct ptreap_node *root, uint64_t key) {
+    if (ptreap_lookup(root, key))
+        return ptreap_retain(root);
+    return insert_node(ptreap_retain(root), ptreap_create_node(key));
+}
+
+struct ptreap_node *ptreap_delete(struct ptreap_node *root, uint64_t key) {
+    if (!ptreap_lookup(root, key))
+        return ptreap_retain(root);
+    return delete_node(ptreap_retain(root), key);
+}
+
+/* Keys < key into *lo, the rest into *hi */
+void ptreap_split(struct ptreap_node *root, uint64_t key, struct ptreap_node **lo, struct ptreap_node **hi) {
+    split_node(ptreap_retain(root), key, lo, hi);
+}
+
+/* Every key in lo must be smaller than every key in hi */
+struct ptreap_node *ptreap_merge(struct ptreap_node *lo, struct ptreap_node *hi) {
+    return merge_node(ptreap_retain(lo), ptreap_retain(hi));
+}
+
+/* lo and hi are the nearest bounding ancestors, or NULL */
+static bool ptreap_verify_node(struct ptreap_node *n, const struct ptreap_node *lo,
+                               const struct ptreap_node *hi) {
+    if (!n)
+        return true;
+
+    if ((lo && n->key <= lo->key) || (hi && n->key >= hi->key)) {
+        fprintf(stderr, "BST violation at node %llu\n", (unsigned long long) n->key);
+        return false;
+    }
+
+    if ((n->left && n->left->priority < n->priority) ||
+        (n->right && n->right->priority < n->priority)) {
+        fprintf(stderr, "Heap violation at node %llu\n", (unsigned long long) n->key);
+        return false;
+    }
+
+    if (!n->refcount || n->priority != mix64(n->key) >> 32) {
+        fprintf(stderr, "Corrupt node %llu\n", (unsigned long long) n->key);
+        return false;
+    }
+
+    return ptreap_verify_node(n->left, lo, n) && ptreap_verify_node(n->right, n, hi);
+}
+
+bool ptreap_verify(struct ptreap_node *root) {
+    return ptreap_verify_node(root, NULL, NULL);
+}
+
+/* Nodes are named by address, so subtrees the versions share are drawn once */
+static void ptreap_export_dot_node(FILE *f, struct ptreap_node *n, struct ptreap_node ***seen,
+                                   size_t *count, size_t *capacity) {
+    for (size_t i = 0; i < *count; i++)
+        if ((*seen)[i] == n)
+            return;
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *seen = realloc(*seen, *capacity * sizeof(**seen));
+    }
+    (*seen)[(*count)++] = n;
+
+    fprintf(f, "    \"%p\" [label=\"%llu\\n(refs = %u)\"%s];\n", (void *) n,
+            (unsigned long long) n->key, n->refcount, n->refcount > 1 ? ", fillcolor=lightblue" : "");
+
+    if (n->left) {
+        fprintf(f, "    \"%p\" -> \"%p\" [label=\"L\"];\n", (void *) n, (void *) n->left);
+        ptreap_export_dot_node(f, n->left, seen, count, capacity);
+    }
+
+    if (n->right) {
+        fprintf(f, "    \"%p\" -> \"%p\" [label=\"R\"];\n", (void *) n, (void *) n->right);
+        ptreap_export_dot_node(f, n->right, seen, count, capacity);
+    }
+}
+
+void ptreap_export_to_dot(struct ptreap_node **roots, int n, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) {
+        perror("fopen");
+        return;
+    }
+
+    struct ptreap_node **seen = NULL;
+    size_t count = 0, capacity = 0;
+
+    fprintf(f, "digraph persistent_treap {\n");
+    fprintf(f, "    node [shape=record, style=filled, fillcolor=lightgrey];\n");
+
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "    \"v%d\" [shape=box, fillcolor=white];\n", i);
+        if (roots[i]) {
+            fprintf(f, "    \"v%d\" -> \"%p\";\n", i, (void *) roots[i]);
+            ptreap_export_dot_node(f, roots[i], &seen, &count, &capacity);
+        }
+    }
+
+    fprintf(f, "}\n");
+    fclose(f);
+    free(seen);
+}
+
+#ifndef NUM_INSERTS
+#define NUM_INSERTS 100
+#endif
+
+#ifndef NUM_FORKS
+#define NUM_FORKS 8
+#endif
+
+#ifndef BENCH_KEYS
+#define BENCH_KEYS (1 << 16)
+#endif
+
+#ifndef BENCH_FORKS
+#define BENCH_FORKS 1000
+#endif
+
+#ifndef BENCH_FORK_UPDATES
+#define BENCH_FORK_UPDATES 8
+#endif
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Many tenants, each a fork of one base set with a few private updates */
+static void benchmark(void) {
+    struct ptreap_node *base = NULL, **tenants = malloc(BENCH_FORKS * sizeof(*tenants));
+
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        struct ptreap_node *next = ptreap_insert(base, mix64(i));
+        ptreap_release(base);
+        base = next;
+    }
+    size_t base_nodes = live_nodes;
+
+    double start = now_ns();
+    for (int i = 0; i < BENCH_FORKS; i++) {
+        tenants[i] = ptreap_retain(base);
+        for (int j = 0; j < BENCH_FORK_UPDATES; j++) {
+            struct ptreap_node *next = j % 2 ? ptreap_delete(tenants[i], mix64(rand() % BENCH_KEYS))
+                                             : ptreap_insert(tenants[i], mix64(BENCH_KEYS + rand()));
+            ptreap_release(tenants[i]);
+            tenants[i] = next;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    printf("    %d forks of %d keys, %d updates each: %.1f ns/update, %.1f new nodes/update, "
+           "%.2fx the nodes of the base\n",
+           BENCH_FORKS, BENCH_KEYS, BENCH_FORK_UPDATES, elapsed / (BENCH_FORKS * BENCH_FORK_UPDATES),
+           (double) (live_nodes - base_nodes) / (BENCH_FORKS * BENCH_FORK_UPDATES),
+           (double) live_nodes / base_nodes);
+
+    for (int i = 0; i < BENCH_FORKS; i++)
+        ptreap_release(tenants[i]);
+    ptreap_release(base);
+    assert(live_nodes == 0);
+    free(tenants);
+}
+
+static void check_set(struct ptreap_node *root, const bool *present, int range) {
+    assert(ptreap_verify(root));
+    for (int k = 0; k < range; k++)
+        assert(!ptreap_lookup(root, k) == !present[k]);
+}
+
+int main(void) {
+    printf("Persistent treap... ");
+    fflush(stdout);
+
+    srand((unsigned) time(NULL));
+
+    int range = NUM_INSERTS * 10;
+    bool *base_keys = calloc(range, sizeof(bool));
+    bool *fork_keys = calloc((size_t) NUM_FORKS * range, sizeof(bool));
+    struct ptreap_node *base = NULL, *forks[NUM_FORKS];
+
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        int key = rand() % range;
+        struct ptreap_node *next = ptreap_insert(base, key);
+        ptreap_release(base);
+        base = next;
+        base_keys[key] = true;
+    }
+    check_set(base, base_keys, range);
+
+    /* Every fork diverges with its own inserts and deletes */
+    for (int f = 0; f < NUM_FORKS; f++) {
+        bool *keys = fork_keys + (size_t) f * range;
+        memcpy(keys, base_keys, range * sizeof(bool));
+        forks[f] = ptreap_retain(base);
+
+        for (int i = 0; i < NUM_INSERTS / 4; i++) {
+            int key = rand() % range;
+            struct ptreap_node *next = rand() % 2 ? ptreap_insert(forks[f], key) : ptreap_delete(forks[f], key);
+            keys[key] = ptreap_lookup(next, key) != NULL;
+            ptreap_release(forks[f]);
+            forks[f] = next;
+            check_set(forks[f], keys, range);
+        }
+    }
+
+    /* ... while the base and the other forks stay as they were */
+    check_set(base, base_keys, range);
+    for (int f = 0; f < NUM_FORKS; f++)
+        check_set(forks[f], fork_keys + (size_t) f * range, range);
+
+    /* Split a fork and merge it back, leaving the fork intact */
+    struct ptreap_node *lo, *hi;
+    uint64_t pivot = rand() % range;
+    ptreap_split(forks[0], pivot, &lo, &hi);
+    assert(ptreap_verify(lo) && ptreap_verify(hi));
+    for (int k = 0; k < range; k++)
+        assert(!ptreap_lookup(k < (int) pivot ? lo : hi, k) == !fork_keys[k]);
+    struct ptreap_node *joined = ptreap_merge(lo, hi);
+    ptreap_release(lo);
+    ptreap_release(hi);
+    check_set(joined, fork_keys, range);
+    check_set(forks[0], fork_keys, range);
+    ptreap_release(joined);
+
+    struct ptreap_node *shown[2] = {base, forks[0]};
+    ptreap_export_to_dot(shown, 2, "treap_persistent.dot");
+
+    for (int f = 0; f < NUM_FORKS; f++)
+        ptreap_release(forks[f]);
+    ptreap_release(base);
+    assert(live_nodes == 0);
+    printf("complete\n");
+
+    free(fork_keys);
+    free(base_keys);
+
+    benchmark();
+    return 0;
+}